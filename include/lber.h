@@ -431,6 +431,22 @@ LBER_F( int )
 ber_put_set LDAP_P((
 	BerElement *ber ));
 
+LBER_F( ber_len_t )
+ber_calc_len LDAP_P((
+	ber_tag_t tag,
+	ber_len_t len ));
+
+LBER_F( ber_len_t )
+ber_calc_int_len LDAP_P((
+	ber_int_t num,
+	ber_tag_t tag ));
+
+LBER_F( int )
+ber_put_header LDAP_P((
+	BerElement *ber,
+	ber_tag_t tag,
+	ber_len_t len ));
+
 LBER_F( int )
 ber_printf LDAP_P((
 	BerElement *ber,
@@ -297,6 +297,7 @@ typedef struct ldapcontrol {
 #define	LDAP_TAG_SYNC_ID_SET			((ber_tag_t) 0xa3U)
 
 #define LDAP_TAG_SYNC_COOKIE			((ber_tag_t) 0x04U)
+#define LDAP_TAG_SYNC_MODS			((ber_tag_t) 0xa0U)
 #define LDAP_TAG_REFRESHDELETES			((ber_tag_t) 0x01U)
 #define LDAP_TAG_REFRESHDONE			((ber_tag_t) 0x01U)
 #define LDAP_TAG_RELOAD_HINT			((ber_tag_t) 0x01U)
@@ -325,6 +326,12 @@ typedef struct ldapcontrol {
 #define	LDAP_CONTROL_X_DEREF			"1.3.6.1.4.1.4203.666.5.16"
 #define	LDAP_CONTROL_X_WHATFAILED		"1.3.6.1.4.1.4203.666.5.17"
 
+/* Sync modifications control: the Sync State control of a
+ * LDAP_SYNC_MODIFY entry may carry the changes made, as a trailing
+ * LDAP_TAG_SYNC_MODS sequence in ModifyRequest changes format, in
+ * which case the entry is sent without attributes */
+#define	LDAP_CONTROL_X_SYNC_MODS		"1.3.6.1.4.1.4203.666.5.19"
+
 /* LDAP Chaining Behavior Control *//* work in progress */
 /* <draft-sermersheim-ldap-chaining>;
  * see also LDAP_NO_REFERRALS_FOUND, LDAP_CANNOT_CHAIN */
@@ -430,6 +437,9 @@ typedef struct ldapcontrol {
 #define LDAP_TAG_EXOP_VERIFY_CREDENTIALS_SCREDS	 ((ber_tag_t) 0x81U)
 #define LDAP_TAG_EXOP_VERIFY_CREDENTIALS_CONTROLS ((ber_tag_t) 0xa2U) /* context specific + constructed + 2 */
 
+/* stream compression; request value is the INTEGER compression level */
+#define LDAP_EXOP_X_START_COMPRESS	"1.3.6.1.4.1.4203.666.6.6"
+
 #define LDAP_EXOP_WHO_AM_I		"1.3.6.1.4.1.4203.1.11.3"		/* RFC 4532 */
 #define LDAP_EXOP_X_WHO_AM_I	LDAP_EXOP_WHO_AM_I
 
@@ -1579,6 +1589,16 @@ ldap_start_tls_s LDAP_P((
 	LDAPControl **serverctrls,
 	LDAPControl **clientctrls ));
 
+/*
+ * in compress.c:
+ */
+LDAP_F( int )
+ldap_start_compress_s LDAP_P((
+	LDAP *ld,
+	int level,
+	LDAPControl **serverctrls,
+	LDAPControl **clientctrls ));
+
 /*
  * in messages.c:
  */
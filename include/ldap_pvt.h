@@ -382,6 +382,19 @@ LDAP_F (int) ldap_open_internal_connection LDAP_P((
 LDAP_F (int) ldap_pvt_sasl_generic_install LDAP_P(( Sockbuf *sb,
 	struct sb_sasl_generic_install *install_arg ));
 LDAP_F (void) ldap_pvt_sasl_generic_remove LDAP_P(( Sockbuf *sb ));
+LDAP_V (Sockbuf_IO) ldap_pvt_sockbuf_io_sasl_generic;
+
+/* compress.c */
+typedef struct ldap_pvt_compress_stats {
+	ber_len_t	cs_wire_in;	/* compressed bytes received */
+	ber_len_t	cs_raw_in;	/* after inflating */
+	ber_len_t	cs_wire_out;	/* compressed bytes sent */
+	ber_len_t	cs_raw_out;	/* before deflating */
+} ldap_pvt_compress_stats;
+
+LDAP_F (int) ldap_pvt_compress_install LDAP_P(( Sockbuf *sb, int level ));
+LDAP_F (int) ldap_pvt_compress_get_stats LDAP_P(( Sockbuf *sb,
+	ldap_pvt_compress_stats *stats ));
 
 /* search.c */
 LDAP_F( char * )
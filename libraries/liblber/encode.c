@@ -482,6 +482,65 @@ ber_put_seqorset( BerElement *ber )
 	return xlen + *SOS_TAG_END(header); /* lenlen + len + taglen */
 }
 
+/*
+ * Exact-size encoding.  A caller that knows the content length of a
+ * constructed element up front writes its header with ber_put_header()
+ * and then the contents, instead of bracketing them with
+ * ber_start_seq()/ber_put_seq().  Nothing is reserved and later moved
+ * to close the gap in the length octets, and when the caller sizes the
+ * buffer with ber_calc_len() the encoding never has to grow it.
+ */
+
+/* Size of an element with the given tag and content length */
+ber_len_t
+ber_calc_len( ber_tag_t tag, ber_len_t len )
+{
+	unsigned char header[HEADER_SIZE], *ptr;
+
+	ptr = ber_prepend_len( &header[sizeof(header)], len );
+	ptr = ber_prepend_tag( ptr, tag );
+
+	return &header[sizeof(header)] - ptr + len;
+}
+
+/* Size of the element ber_put_int() writes for num */
+ber_len_t
+ber_calc_int_len( ber_int_t num, ber_tag_t tag )
+{
+	ber_uint_t unum;
+	ber_len_t len;
+
+	if ( tag == LBER_DEFAULT ) {
+		tag = LBER_INTEGER;
+	}
+
+	unum = num;
+	if ( num < 0 ) {
+		unum = ~unum;
+	}
+	for ( len = 1; unum >= 0x80; unum >>= 8 ) {
+		len++;
+	}
+
+	return ber_calc_len( tag, len );
+}
+
+/* Write the tag and length of an element whose len content octets follow */
+int
+ber_put_header( BerElement *ber, ber_tag_t tag, ber_len_t len )
+{
+	unsigned char header[HEADER_SIZE], *ptr;
+
+	if ( len > MAXINT_BERSIZE ) {
+		return -1;
+	}
+
+	ptr = ber_prepend_len( &header[sizeof(header)], len );
+	ptr = ber_prepend_tag( ptr, tag );
+
+	return ber_write( ber, (char *) ptr, &header[sizeof(header)] - ptr, 0 );
+}
+
 int
 ber_put_seq( BerElement *ber )
 {
@@ -0,0 +1,324 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1998-2024 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/stdlib.h>
+#include <ac/string.h>
+#include <ac/socket.h>
+#include <ac/errno.h>
+
+#include "ldap-int.h"
+
+/*
+ * Stream compression for LBER Sockbufs, negotiated with the
+ * LDAP_EXOP_X_START_COMPRESS extended operation. Once both sides have
+ * installed the layer, everything they write is deflated and framed
+ * in length-prefixed packets, using the same framing as the SASL
+ * security layers.
+ */
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+
+#define COMPRESS_MIN_SEND	4096
+#define COMPRESS_MAX_SEND	(64*1024)
+#define COMPRESS_MAX_RECV	(COMPRESS_MAX_SEND + COMPRESS_MAX_SEND/2)
+/* a peer never deflates more than COMPRESS_MAX_SEND into one packet,
+ * anything inflating far beyond that is hostile */
+#define COMPRESS_MAX_DECODE	(COMPRESS_MAX_SEND * 2)
+
+typedef struct sb_compress_data {
+	z_stream	sc_in;
+	z_stream	sc_out;
+	ldap_pvt_compress_stats	sc_stats;
+} sb_compress_data;
+
+static void
+sb_compress_init(
+	struct sb_sasl_generic_data *p,
+	ber_len_t *min_send,
+	ber_len_t *max_send,
+	ber_len_t *max_recv)
+{
+	*min_send = COMPRESS_MIN_SEND;
+	*max_send = COMPRESS_MAX_SEND;
+	*max_recv = COMPRESS_MAX_RECV;
+}
+
+static ber_int_t
+sb_compress_encode(
+	struct sb_sasl_generic_data *p,
+	unsigned char *buf,
+	ber_len_t len,
+	Sockbuf_Buf *dst)
+{
+	sb_compress_data *sc = p->ops_private;
+	z_stream *zs = &sc->sc_out;
+	ber_len_t size;
+	int rc;
+
+	/* Z_SYNC_FLUSH output for len bytes normally fits in deflateBound */
+	size = 4 + deflateBound( zs, len ) + 16;
+	if ( ber_pvt_sb_grow_buffer( dst, size ) < 0 )
+		return -1;
+
+	zs->next_in = buf;
+	zs->avail_in = len;
+	zs->next_out = (unsigned char *)dst->buf_base + 4;
+	zs->avail_out = dst->buf_size - 4;
+
+	for (;;) {
+		rc = deflate( zs, Z_SYNC_FLUSH );
+		if ( rc != Z_OK && rc != Z_BUF_ERROR ) {
+			ber_log_printf( LDAP_DEBUG_ANY, p->sbiod->sbiod_sb->sb_debug,
+				"sb_compress_encode: deflate failed: %d\n", rc );
+			return -1;
+		}
+		if ( zs->avail_out )
+			break;
+		size = zs->next_out - (unsigned char *)dst->buf_base;
+		if ( ber_pvt_sb_grow_buffer( dst, dst->buf_size * 2 ) < 0 )
+			return -1;
+		zs->next_out = (unsigned char *)dst->buf_base + size;
+		zs->avail_out = dst->buf_size - size;
+	}
+
+	dst->buf_end = zs->next_out - (unsigned char *)dst->buf_base;
+	size = dst->buf_end - 4;
+	dst->buf_base[0] = (size >> 24) & 0xff;
+	dst->buf_base[1] = (size >> 16) & 0xff;
+	dst->buf_base[2] = (size >> 8) & 0xff;
+	dst->buf_base[3] = size & 0xff;
+
+	sc->sc_stats.cs_raw_out += len;
+	sc->sc_stats.cs_wire_out += dst->buf_end;
+
+	return 0;
+}
+
+static ber_int_t
+sb_compress_decode(
+	struct sb_sasl_generic_data *p,
+	const Sockbuf_Buf *src,
+	Sockbuf_Buf *dst)
+{
+	sb_compress_data *sc = p->ops_private;
+	z_stream *zs = &sc->sc_in;
+	ber_len_t used, size;
+	int rc;
+
+	if ( dst->buf_size < COMPRESS_MAX_SEND &&
+		ber_pvt_sb_grow_buffer( dst, COMPRESS_MAX_SEND ) < 0 )
+		return -1;
+
+	zs->next_in = (unsigned char *)src->buf_base + 4;
+	zs->avail_in = src->buf_end - 4;
+	zs->next_out = (unsigned char *)dst->buf_base;
+	zs->avail_out = dst->buf_size < COMPRESS_MAX_DECODE ?
+		dst->buf_size : COMPRESS_MAX_DECODE;
+
+	for (;;) {
+		rc = inflate( zs, Z_SYNC_FLUSH );
+		if ( rc != Z_OK && rc != Z_BUF_ERROR ) {
+			ber_log_printf( LDAP_DEBUG_ANY, p->sbiod->sbiod_sb->sb_debug,
+				"sb_compress_decode: inflate failed: %d\n", rc );
+			return -1;
+		}
+		if ( !zs->avail_in && zs->avail_out )
+			break;
+		if ( rc == Z_BUF_ERROR && zs->avail_out ) {
+			/* no progress possible on a complete packet */
+			return -1;
+		}
+		used = zs->next_out - (unsigned char *)dst->buf_base;
+		if ( used >= COMPRESS_MAX_DECODE ) {
+			ber_log_printf( LDAP_DEBUG_ANY, p->sbiod->sbiod_sb->sb_debug,
+				"sb_compress_decode: packet inflates beyond %d bytes\n",
+				COMPRESS_MAX_DECODE );
+			return -1;
+		}
+		size = dst->buf_size * 2;
+		if ( size > COMPRESS_MAX_DECODE )
+			size = COMPRESS_MAX_DECODE;
+		if ( ber_pvt_sb_grow_buffer( dst, size ) < 0 )
+			return -1;
+		zs->next_out = (unsigned char *)dst->buf_base + used;
+		zs->avail_out = size - used;
+	}
+
+	dst->buf_ptr = 0;
+	dst->buf_end = zs->next_out - (unsigned char *)dst->buf_base;
+
+	sc->sc_stats.cs_wire_in += src->buf_end;
+	sc->sc_stats.cs_raw_in += dst->buf_end;
+
+	return 0;
+}
+
+static void
+sb_compress_reset_buf(
+	struct sb_sasl_generic_data *p,
+	Sockbuf_Buf *buf)
+{
+	buf->buf_ptr = 0;
+	buf->buf_end = 0;
+}
+
+static void
+sb_compress_fini(
+	struct sb_sasl_generic_data *p)
+{
+	sb_compress_data *sc = p->ops_private;
+
+	inflateEnd( &sc->sc_in );
+	deflateEnd( &sc->sc_out );
+	LBER_FREE( sc );
+}
+
+static const struct sb_sasl_generic_ops sb_compress_ops = {
+	sb_compress_init,
+	sb_compress_encode,
+	sb_compress_decode,
+	sb_compress_reset_buf,
+	sb_compress_fini
+};
+
+int
+ldap_pvt_compress_install( Sockbuf *sb, int level )
+{
+	struct sb_sasl_generic_install install_arg;
+	sb_compress_data *sc;
+
+	/* only one framing layer can be in place */
+	if ( ber_sockbuf_ctrl( sb, LBER_SB_OPT_HAS_IO,
+			&ldap_pvt_sockbuf_io_sasl_generic ) )
+		return LDAP_LOCAL_ERROR;
+
+	if ( level < 0 || level > Z_BEST_COMPRESSION )
+		level = Z_DEFAULT_COMPRESSION;
+
+	sc = LBER_CALLOC( 1, sizeof( sb_compress_data ) );
+	if ( sc == NULL )
+		return LDAP_NO_MEMORY;
+
+	if ( deflateInit( &sc->sc_out, level ) != Z_OK ) {
+		LBER_FREE( sc );
+		return LDAP_LOCAL_ERROR;
+	}
+	if ( inflateInit( &sc->sc_in ) != Z_OK ) {
+		deflateEnd( &sc->sc_out );
+		LBER_FREE( sc );
+		return LDAP_LOCAL_ERROR;
+	}
+
+	install_arg.ops = &sb_compress_ops;
+	install_arg.ops_private = sc;
+
+	return ldap_pvt_sasl_generic_install( sb, &install_arg );
+}
+
+int
+ldap_pvt_compress_get_stats( Sockbuf *sb, ldap_pvt_compress_stats *stats )
+{
+	Sockbuf_IO_Desc *sbiod;
+
+	for ( sbiod = sb->sb_iod; sbiod; sbiod = sbiod->sbiod_next ) {
+		struct sb_sasl_generic_data *p;
+
+		if ( sbiod->sbiod_io != &ldap_pvt_sockbuf_io_sasl_generic )
+			continue;
+		p = sbiod->sbiod_pvt;
+		if ( p->ops != &sb_compress_ops )
+			break;
+		*stats = ((sb_compress_data *)p->ops_private)->sc_stats;
+		return 0;
+	}
+	memset( stats, 0, sizeof( *stats ) );
+	return -1;
+}
+
+#else /* !HAVE_ZLIB */
+
+int
+ldap_pvt_compress_install( Sockbuf *sb, int level )
+{
+	return LDAP_NOT_SUPPORTED;
+}
+
+int
+ldap_pvt_compress_get_stats( Sockbuf *sb, ldap_pvt_compress_stats *stats )
+{
+	memset( stats, 0, sizeof( *stats ) );
+	return -1;
+}
+
+#endif /* HAVE_ZLIB */
+
+int
+ldap_start_compress_s(
+	LDAP *ld,
+	int level,
+	LDAPControl **serverctrls,
+	LDAPControl **clientctrls )
+{
+#ifndef HAVE_ZLIB
+	return LDAP_NOT_SUPPORTED;
+#else
+	int rc;
+	char *rspoid = NULL;
+	struct berval *rspdata = NULL;
+	struct berval *reqdata = NULL;
+	BerElementBuffer berbuf;
+	BerElement *ber = (BerElement *)&berbuf;
+	Sockbuf *sb;
+
+	/* like StartTLS, this only applies to the default connection */
+	if ( ld->ld_defconn == NULL )
+		return LDAP_LOCAL_ERROR;
+	sb = ld->ld_defconn->lconn_sb;
+	if ( ber_sockbuf_ctrl( sb, LBER_SB_OPT_HAS_IO,
+			&ldap_pvt_sockbuf_io_sasl_generic ) )
+		return LDAP_LOCAL_ERROR;
+
+	ber_init2( ber, NULL, LBER_USE_DER );
+	if ( ber_printf( ber, "i", (ber_int_t)level ) == -1 ||
+		ber_flatten( ber, &reqdata ) == -1 ) {
+		ber_free_buf( ber );
+		return LDAP_ENCODING_ERROR;
+	}
+	ber_free_buf( ber );
+
+	rc = ldap_extended_operation_s( ld, LDAP_EXOP_X_START_COMPRESS,
+		reqdata, serverctrls, clientctrls, &rspoid, &rspdata );
+	ber_bvfree( reqdata );
+
+	if ( rspoid != NULL ) {
+		LDAP_FREE(rspoid);
+	}
+
+	if ( rspdata != NULL ) {
+		ber_bvfree( rspdata );
+	}
+
+	if ( rc == LDAP_SUCCESS ) {
+		/* what we send is small; keep our side cheap */
+		rc = ldap_pvt_compress_install( sb, Z_BEST_SPEED );
+	}
+
+	return rc;
+#endif
+}
@@ -407,7 +407,7 @@ typedef enum MDB_cursor_op {
 #define MDB_NOTFOUND	(-30798)
 	/** Requested page not found - this usually indicates corruption */
 #define MDB_PAGE_NOTFOUND	(-30797)
-	/** Located page was wrong type */
+	/** Located page was wrong type, or failed its checksum */
 #define MDB_CORRUPTED	(-30796)
 	/** Update of meta page failed or environment had fatal error */
 #define MDB_PANIC		(-30795)
@@ -875,6 +875,47 @@ int  mdb_env_set_maxreaders(MDB_env *env, unsigned int readers);
 	 */
 int  mdb_env_get_maxreaders(MDB_env *env, unsigned int *readers);
 
+	/** @brief Set the page checksum sampling rate for the environment.
+	 *
+	 * A new environment created with a nonzero sampling rate stores a
+	 * 16 bit CRC32C checksum in the header of every branch, leaf and
+	 * overflow page it writes. A compacting copy (#MDB_CP_COMPACT) made
+	 * from an environment with a nonzero rate also has checksums, even if
+	 * the source does not. Once present, checksums are maintained for the
+	 * life of the data file, whatever rate later users set.
+	 *
+	 * Reading a page from the map verifies its checksum once in every
+	 * \b sample pages, so 1 verifies every page read and 0, the default,
+	 * disables verification. A page that fails is reported as
+	 * #MDB_CORRUPTED. Pages are summed with the CPU's CRC32C instruction
+	 * when available.
+	 *
+	 * Builds of LMDB without checksum support write such a data file
+	 * without updating the sums, which will then fail verification.
+	 * This function may only be called after #mdb_env_create() and before #mdb_env_open().
+	 * @param[in] env An environment handle returned by #mdb_env_create()
+	 * @param[in] sample Verify 1 in this many page reads, 0 for none.
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>EINVAL - an invalid parameter was specified, or the environment is already open.
+	 * </ul>
+	 */
+int  mdb_env_set_pagecheck(MDB_env *env, unsigned int sample);
+
+	/** @brief Get the page checksum sampling rate of the environment.
+	 *
+	 * @param[in] env An environment handle returned by #mdb_env_create()
+	 * @param[out] sample Address of an integer to store the rate. Once the
+	 * environment is open, this is 0 if its data file has no checksums.
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 * </ul>
+	 */
+int  mdb_env_get_pagecheck(MDB_env *env, unsigned int *sample);
+
 	/** @brief Set the maximum number of named databases for the environment.
 	 *
 	 * This function is only needed if multiple databases will be used in the
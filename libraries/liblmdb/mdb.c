@@ -1054,6 +1054,11 @@ typedef struct MDB_db {
 
 #define MDB_VALID	0x8000		/**< DB handle is valid, for me_dbflags */
 #define PERSISTENT_FLAGS	(0xffff & ~(MDB_VALID))
+	/** #FREE_DBI flag: every page carries a checksum in #MDB_page.%mp_pad.
+	 *	Set when the environment is created or compacted with
+	 *	#mdb_env_set_pagecheck() enabled, and never cleared.
+	 */
+#define MDB_PGCKSUM	0x2000
 	/** #mdb_dbi_open() flags */
 #define VALID_FLAGS	(MDB_REVERSEKEY|MDB_DUPSORT|MDB_INTEGERKEY|MDB_DUPFIXED|\
 	MDB_INTEGERDUP|MDB_REVERSEDUP|MDB_CREATE)
@@ -1202,6 +1207,8 @@ struct MDB_txn {
 	 *	dirty_list into mt_parent after freeing hidden mt_parent pages.
 	 */
 	unsigned int	mt_dirty_room;
+	/** Mapped pages fetched since the last one whose checksum was verified */
+	unsigned int	mt_pgcheck;
 };
 
 /** Enough space for 2^32 nodes with minimum of 2 keys per node. I.e., plenty.
@@ -1347,6 +1354,7 @@ struct MDB_env {
 	unsigned int	me_maxkey;	/**< max size of a key */
 #endif
 	int		me_live_reader;		/**< have liveness lock in reader table */
+	unsigned int	me_pgcheck;	/**< verify 1 in this many mapped pages, 0 = none */
 #ifdef _WIN32
 	int		me_pidquery;		/**< Used in OpenProcess */
 #endif
@@ -3363,6 +3371,188 @@ mdb_freelist_save(MDB_txn *txn)
 	return rc;
 }
 
+/** @defgroup pagecheck	Page checksums
+ *	When #MDB_PGCKSUM is set, every branch, leaf and overflow page
+ *	stores a 16 bit folded CRC32C in #MDB_page.%mp_pad, which is
+ *	otherwise only used by #P_LEAF2 pages. The sum covers the page
+ *	number the page is stored at, its type flags, and the page contents
+ *	excluding the unused gap between mp_lower and mp_upper.
+ *	@{
+ */
+	/** CRC32C (Castagnoli) table, for CPUs without a CRC instruction */
+static const uint32_t mdb_crc32c_tab[256] = {
+	0x00000000, 0xf26b8303, 0xe13b70f7, 0x1350f3f4, 0xc79a971f, 0x35f1141c,
+	0x26a1e7e8, 0xd4ca64eb, 0x8ad958cf, 0x78b2dbcc, 0x6be22838, 0x9989ab3b,
+	0x4d43cfd0, 0xbf284cd3, 0xac78bf27, 0x5e133c24, 0x105ec76f, 0xe235446c,
+	0xf165b798, 0x030e349b, 0xd7c45070, 0x25afd373, 0x36ff2087, 0xc494a384,
+	0x9a879fa0, 0x68ec1ca3, 0x7bbcef57, 0x89d76c54, 0x5d1d08bf, 0xaf768bbc,
+	0xbc267848, 0x4e4dfb4b, 0x20bd8ede, 0xd2d60ddd, 0xc186fe29, 0x33ed7d2a,
+	0xe72719c1, 0x154c9ac2, 0x061c6936, 0xf477ea35, 0xaa64d611, 0x580f5512,
+	0x4b5fa6e6, 0xb93425e5, 0x6dfe410e, 0x9f95c20d, 0x8cc531f9, 0x7eaeb2fa,
+	0x30e349b1, 0xc288cab2, 0xd1d83946, 0x23b3ba45, 0xf779deae, 0x05125dad,
+	0x1642ae59, 0xe4292d5a, 0xba3a117e, 0x4851927d, 0x5b016189, 0xa96ae28a,
+	0x7da08661, 0x8fcb0562, 0x9c9bf696, 0x6ef07595, 0x417b1dbc, 0xb3109ebf,
+	0xa0406d4b, 0x522bee48, 0x86e18aa3, 0x748a09a0, 0x67dafa54, 0x95b17957,
+	0xcba24573, 0x39c9c670, 0x2a993584, 0xd8f2b687, 0x0c38d26c, 0xfe53516f,
+	0xed03a29b, 0x1f682198, 0x5125dad3, 0xa34e59d0, 0xb01eaa24, 0x42752927,
+	0x96bf4dcc, 0x64d4cecf, 0x77843d3b, 0x85efbe38, 0xdbfc821c, 0x2997011f,
+	0x3ac7f2eb, 0xc8ac71e8, 0x1c661503, 0xee0d9600, 0xfd5d65f4, 0x0f36e6f7,
+	0x61c69362, 0x93ad1061, 0x80fde395, 0x72966096, 0xa65c047d, 0x5437877e,
+	0x4767748a, 0xb50cf789, 0xeb1fcbad, 0x197448ae, 0x0a24bb5a, 0xf84f3859,
+	0x2c855cb2, 0xdeeedfb1, 0xcdbe2c45, 0x3fd5af46, 0x7198540d, 0x83f3d70e,
+	0x90a324fa, 0x62c8a7f9, 0xb602c312, 0x44694011, 0x5739b3e5, 0xa55230e6,
+	0xfb410cc2, 0x092a8fc1, 0x1a7a7c35, 0xe811ff36, 0x3cdb9bdd, 0xceb018de,
+	0xdde0eb2a, 0x2f8b6829, 0x82f63b78, 0x709db87b, 0x63cd4b8f, 0x91a6c88c,
+	0x456cac67, 0xb7072f64, 0xa457dc90, 0x563c5f93, 0x082f63b7, 0xfa44e0b4,
+	0xe9141340, 0x1b7f9043, 0xcfb5f4a8, 0x3dde77ab, 0x2e8e845f, 0xdce5075c,
+	0x92a8fc17, 0x60c37f14, 0x73938ce0, 0x81f80fe3, 0x55326b08, 0xa759e80b,
+	0xb4091bff, 0x466298fc, 0x1871a4d8, 0xea1a27db, 0xf94ad42f, 0x0b21572c,
+	0xdfeb33c7, 0x2d80b0c4, 0x3ed04330, 0xccbbc033, 0xa24bb5a6, 0x502036a5,
+	0x4370c551, 0xb11b4652, 0x65d122b9, 0x97baa1ba, 0x84ea524e, 0x7681d14d,
+	0x2892ed69, 0xdaf96e6a, 0xc9a99d9e, 0x3bc21e9d, 0xef087a76, 0x1d63f975,
+	0x0e330a81, 0xfc588982, 0xb21572c9, 0x407ef1ca, 0x532e023e, 0xa145813d,
+	0x758fe5d6, 0x87e466d5, 0x94b49521, 0x66df1622, 0x38cc2a06, 0xcaa7a905,
+	0xd9f75af1, 0x2b9cd9f2, 0xff56bd19, 0x0d3d3e1a, 0x1e6dcdee, 0xec064eed,
+	0xc38d26c4, 0x31e6a5c7, 0x22b65633, 0xd0ddd530, 0x0417b1db, 0xf67c32d8,
+	0xe52cc12c, 0x1747422f, 0x49547e0b, 0xbb3ffd08, 0xa86f0efc, 0x5a048dff,
+	0x8ecee914, 0x7ca56a17, 0x6ff599e3, 0x9d9e1ae0, 0xd3d3e1ab, 0x21b862a8,
+	0x32e8915c, 0xc083125f, 0x144976b4, 0xe622f5b7, 0xf5720643, 0x07198540,
+	0x590ab964, 0xab613a67, 0xb831c993, 0x4a5a4a90, 0x9e902e7b, 0x6cfbad78,
+	0x7fab5e8c, 0x8dc0dd8f, 0xe330a81a, 0x115b2b19, 0x020bd8ed, 0xf0605bee,
+	0x24aa3f05, 0xd6c1bc06, 0xc5914ff2, 0x37faccf1, 0x69e9f0d5, 0x9b8273d6,
+	0x88d28022, 0x7ab90321, 0xae7367ca, 0x5c18e4c9, 0x4f48173d, 0xbd23943e,
+	0xf36e6f75, 0x0105ec76, 0x12551f82, 0xe03e9c81, 0x34f4f86a, 0xc69f7b69,
+	0xd5cf889d, 0x27a40b9e, 0x79b737ba, 0x8bdcb4b9, 0x988c474d, 0x6ae7c44e,
+	0xbe2da0a5, 0x4c4623a6, 0x5f16d052, 0xad7d5351
+};
+
+static uint32_t
+mdb_crc32c_sw(uint32_t crc, const unsigned char *p, size_t len)
+{
+	while (len--)
+		crc = mdb_crc32c_tab[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <nmmintrin.h>
+	/** SSE4.2 CRC32 instruction, selected at runtime unless the build
+	 *	already targets SSE4.2.
+	 */
+static uint32_t __attribute__((target("sse4.2")))
+mdb_crc32c_hw(uint32_t crc, const unsigned char *p, size_t len)
+{
+	uint64_t c = crc, v;
+	for (; len >= 8; len -= 8, p += 8) {
+		memcpy(&v, p, 8);
+		c = _mm_crc32_u64(c, v);
+	}
+	crc = (uint32_t)c;
+	while (len--)
+		crc = _mm_crc32_u8(crc, *p++);
+	return crc;
+}
+#ifdef __SSE4_2__
+#define MDB_CRC32C_HW()	1
+#else
+#define MDB_CRC32C_HW()	__builtin_cpu_supports("sse4.2")
+#endif
+#elif defined(__ARM_FEATURE_CRC32) && defined(__aarch64__)
+#include <arm_acle.h>
+	/** ARMv8 CRC32C instructions */
+static uint32_t
+mdb_crc32c_hw(uint32_t crc, const unsigned char *p, size_t len)
+{
+	uint64_t v;
+	for (; len >= 8; len -= 8, p += 8) {
+		memcpy(&v, p, 8);
+		crc = __crc32cd(crc, v);
+	}
+	while (len--)
+		crc = __crc32cb(crc, *p++);
+	return crc;
+}
+#define MDB_CRC32C_HW()	1
+#else
+#define mdb_crc32c_hw	mdb_crc32c_sw
+#define MDB_CRC32C_HW()	0
+#endif
+
+	/** Compute the checksum of a page.
+	 * @param[in] mp the page contents. For overflow pages, all
+	 *	\b size bytes must be contiguous.
+	 * @param[in] pgno the page number the page is stored at.
+	 * @param[in] size the page size, times mp_pages for overflow pages.
+	 * @return the checksum, or 0 if the page header is malformed.
+	 */
+static uint16_t
+mdb_page_sum(MDB_page *mp, pgno_t pgno, size_t size)
+{
+	uint32_t (*crc32c)(uint32_t, const unsigned char *, size_t) =
+		MDB_CRC32C_HW() ? mdb_crc32c_hw : mdb_crc32c_sw;
+	const unsigned char *base = (const unsigned char *)mp;
+	uint16_t flags = mp->mp_flags & (P_BRANCH|P_LEAF|P_OVERFLOW|P_LEAF2);
+	size_t lo = offsetof(MDB_page, mp_pb), hi = size;
+	uint32_t crc = ~0U;
+
+	crc = crc32c(crc, (const unsigned char *)&pgno, sizeof(pgno));
+	crc = crc32c(crc, (const unsigned char *)&flags, sizeof(flags));
+	if (!(flags & P_OVERFLOW)) {
+		size_t lower = PAGEBASE + mp->mp_lower, upper = PAGEBASE + mp->mp_upper;
+		if (lower < PAGEHDRSZ || lower > upper || upper > size)
+			return 0;
+		crc = crc32c(crc, base + lo, lower - lo);
+		lo = upper;
+	}
+	crc = ~crc32c(crc, base + lo, hi - lo);
+	crc ^= crc >> 16;
+	/* 0 never matches, so zeroed pages are always caught */
+	return (crc & 0xffff) ? (uint16_t)crc : 1;
+}
+
+	/** Set the checksum of a page about to be written.
+	 * @param[in] env the environment.
+	 * @param[in] mp the page, with its final contents and page number.
+	 */
+static void
+mdb_page_setsum(MDB_env *env, MDB_page *mp)
+{
+	size_t size = env->me_psize;
+
+	if (mp->mp_flags & (P_LEAF2|P_META))
+		return;
+	if (IS_OVERFLOW(mp))
+		size *= mp->mp_pages;
+	mp->mp_pad = mdb_page_sum(mp, mp->mp_pgno, size);
+}
+
+	/** Verify the checksum of a mapped page.
+	 * @param[in] txn the transaction reading the page.
+	 * @param[in] mp the page.
+	 * @param[in] pgno the number of the page.
+	 * @return 0 on success, #MDB_CORRUPTED on a mismatch.
+	 */
+static int
+mdb_page_chksum(MDB_txn *txn, MDB_page *mp, pgno_t pgno)
+{
+	size_t size = txn->mt_env->me_psize;
+
+	/* Pages still dirty in a WRITEMAP txn get their sum at commit */
+	if (mp->mp_flags & (P_LEAF2|P_META|P_DIRTY))
+		return MDB_SUCCESS;
+	if (IS_OVERFLOW(mp)) {
+		if (!mp->mp_pages || mp->mp_pages > txn->mt_next_pgno - pgno)
+			goto bad;
+		size *= mp->mp_pages;
+	}
+	if (mdb_page_sum(mp, pgno, size) == mp->mp_pad)
+		return MDB_SUCCESS;
+bad:
+	DPRINTF(("page %"Z"u failed its checksum", pgno));
+	return MDB_CORRUPTED;
+}
+/** @} */
+
 /** Flush (some) dirty pages to the map, after clearing their dirty flag.
  * @param[in] txn the transaction that's being committed
  * @param[in] keep number of initial pages in dirty_list to keep dirty.
@@ -3378,6 +3568,7 @@ mdb_page_flush(MDB_txn *txn, int keep)
 	size_t		size = 0, pos = 0;
 	pgno_t		pgno = 0;
 	MDB_page	*dp = NULL;
+	int			pgcksum = txn->mt_dbs[FREE_DBI].md_flags & MDB_PGCKSUM;
 #ifdef _WIN32
 	OVERLAPPED	ov;
 #else
@@ -3400,6 +3591,8 @@ mdb_page_flush(MDB_txn *txn, int keep)
 				continue;
 			}
 			dp->mp_flags &= ~P_DIRTY;
+			if (pgcksum)
+				mdb_page_setsum(env, dp);
 		}
 		goto done;
 	}
@@ -3417,6 +3610,8 @@ mdb_page_flush(MDB_txn *txn, int keep)
 			pgno = dl[i].mid;
 			/* clear dirty flag */
 			dp->mp_flags &= ~P_DIRTY;
+			if (pgcksum)
+				mdb_page_setsum(env, dp);
 			pos = pgno * psize;
 			size = psize;
 			if (IS_OVERFLOW(dp)) size *= dp->mp_pages;
@@ -3826,6 +4021,8 @@ mdb_env_init_meta0(MDB_env *env, MDB_meta *meta)
 	meta->mm_last_pg = NUM_METAS-1;
 	meta->mm_flags = env->me_flags & 0xffff;
 	meta->mm_flags |= MDB_INTEGERKEY; /* this is mm_dbs[FREE_DBI].md_flags */
+	if (env->me_pgcheck)
+		meta->mm_flags |= MDB_PGCKSUM;
 	meta->mm_dbs[FREE_DBI].md_root = P_INVALID;
 	meta->mm_dbs[MAIN_DBI].md_root = P_INVALID;
 }
@@ -4204,6 +4401,27 @@ mdb_env_get_maxreaders(MDB_env *env, unsigned int *readers)
 	return MDB_SUCCESS;
 }
 
+int ESECT
+mdb_env_set_pagecheck(MDB_env *env, unsigned int sample)
+{
+	if (env->me_map)
+		return EINVAL;
+	env->me_pgcheck = sample;
+	MDB_TRACE(("%p, %u", env, sample));
+	return MDB_SUCCESS;
+}
+
+int ESECT
+mdb_env_get_pagecheck(MDB_env *env, unsigned int *sample)
+{
+	if (!env || !sample)
+		return EINVAL;
+	*sample = env->me_pgcheck;
+	if (env->me_map && !(mdb_env_pick_meta(env)->mm_flags & MDB_PGCKSUM))
+		*sample = 0;
+	return MDB_SUCCESS;
+}
+
 static int ESECT
 mdb_fsize(HANDLE fd, size_t *size)
 {
@@ -5554,6 +5772,15 @@ mdb_page_get(MDB_cursor *mc, pgno_t pgno, MDB_page **ret, int *lvl)
 	if (pgno < txn->mt_next_pgno) {
 		level = 0;
 		p = (MDB_page *)(env->me_map + env->me_psize * pgno);
+		if (env->me_pgcheck && (txn->mt_dbs[FREE_DBI].md_flags & MDB_PGCKSUM) &&
+			++txn->mt_pgcheck >= env->me_pgcheck) {
+			int rc;
+			txn->mt_pgcheck = 0;
+			if ((rc = mdb_page_chksum(txn, p, pgno)) != MDB_SUCCESS) {
+				txn->mt_flags |= MDB_TXN_ERROR;
+				return rc;
+			}
+		}
 	} else {
 		DPRINTF(("page %"Z"u not found", pgno));
 		txn->mt_flags |= MDB_TXN_ERROR;
@@ -9182,6 +9409,7 @@ typedef struct mdb_copy {
 	HANDLE mc_fd;
 	int mc_toggle;			/**< Buffer number in provider */
 	int mc_new;				/**< (0-2 buffers to write) | (#MDB_EOF at end) */
+	int mc_pgcheck;			/**< Set page checksums in the copy */
 	/** Error code.  Never cleared if set.  Both threads can set nonzero
 	 *	to fail the copy.  Not mutex-protected, LMDB expects atomic int.
 	 */
@@ -9366,6 +9594,9 @@ mdb_env_cwalk(mdb_copy *my, pgno_t *pg, int flags)
 						mo = (MDB_page *)(my->mc_wbuf[toggle] + my->mc_wlen[toggle]);
 						memcpy(mo, omp, my->mc_env->me_psize);
 						mo->mp_pgno = my->mc_next_pgno;
+						if (my->mc_pgcheck)
+							mo->mp_pad = mdb_page_sum(omp, mo->mp_pgno,
+								(size_t)my->mc_env->me_psize * omp->mp_pages);
 						my->mc_next_pgno += omp->mp_pages;
 						my->mc_wlen[toggle] += my->mc_env->me_psize;
 						if (omp->mp_pages > 1) {
@@ -9430,6 +9661,8 @@ again:
 		mo = (MDB_page *)(my->mc_wbuf[toggle] + my->mc_wlen[toggle]);
 		mdb_page_copy(mo, mp, my->mc_env->me_psize);
 		mo->mp_pgno = my->mc_next_pgno++;
+		if (my->mc_pgcheck)
+			mdb_page_setsum(my->mc_env, mo);
 		my->mc_wlen[toggle] += my->mc_env->me_psize;
 		if (mc.mc_top) {
 			/* Update parent if there is one */
@@ -9511,6 +9744,8 @@ mdb_env_copyfd1(MDB_env *env, HANDLE fd)
 	mm = (MDB_meta *)METADATA(mp);
 	mdb_env_init_meta0(env, mm);
 	mm->mm_address = env->me_metas[0]->mm_address;
+	mm->mm_flags |= txn->mt_dbs[FREE_DBI].md_flags & MDB_PGCKSUM;
+	my.mc_pgcheck = mm->mm_flags & MDB_PGCKSUM;
 
 	mp = (MDB_page *)(my.mc_wbuf[0] + env->me_psize);
 	mp->mp_pgno = 1;
@@ -33,14 +33,17 @@ int main(int argc,char * argv[])
 	MDB_env *env;
 	const char *progname = argv[0], *act;
 	unsigned flags = MDB_RDONLY;
-	unsigned cpflags = 0;
+	unsigned cpflags = 0, pagecheck = 0;
 
 	for (; argc > 1 && argv[1][0] == '-'; argc--, argv++) {
 		if (argv[1][1] == 'n' && argv[1][2] == '\0')
 			flags |= MDB_NOSUBDIR;
 		else if (argv[1][1] == 'c' && argv[1][2] == '\0')
 			cpflags |= MDB_CP_COMPACT;
-		else if (argv[1][1] == 'V' && argv[1][2] == '\0') {
+		else if (argv[1][1] == 'k' && argv[1][2] == '\0') {
+			cpflags |= MDB_CP_COMPACT;
+			pagecheck = 1;
+		} else if (argv[1][1] == 'V' && argv[1][2] == '\0') {
 			printf("%s\n", MDB_VERSION_STRING);
 			exit(0);
 		} else
@@ -48,7 +51,7 @@ int main(int argc,char * argv[])
 	}
 
 	if (argc<2 || argc>3) {
-		fprintf(stderr, "usage: %s [-V] [-c] [-n] srcpath [dstpath]\n", progname);
+		fprintf(stderr, "usage: %s [-V] [-c] [-k] [-n] srcpath [dstpath]\n", progname);
 		exit(EXIT_FAILURE);
 	}
 
@@ -63,6 +66,9 @@ int main(int argc,char * argv[])
 
 	act = "opening environment";
 	rc = mdb_env_create(&env);
+	if (rc == MDB_SUCCESS && pagecheck) {
+		rc = mdb_env_set_pagecheck(env, pagecheck);
+	}
 	if (rc == MDB_SUCCESS) {
 		rc = mdb_env_open(env, argv[1], flags, 0600);
 	}
@@ -35,9 +35,31 @@ static void prstat(MDB_stat *ms)
 	printf("  Entries: %"Z"u\n", ms->ms_entries);
 }
 
+/* Read every page of a DB, so that each one's checksum is verified */
+static int pgcheck(MDB_txn *txn, MDB_dbi dbi, char *name)
+{
+	MDB_cursor *cursor;
+	MDB_val key, data;
+	int rc;
+
+	rc = mdb_cursor_open(txn, dbi, &cursor);
+	if (rc) {
+		fprintf(stderr, "mdb_cursor_open failed, error %d %s\n", rc, mdb_strerror(rc));
+		return rc;
+	}
+	while ((rc = mdb_cursor_get(cursor, &key, &data, MDB_NEXT)) == 0) ;
+	mdb_cursor_close(cursor);
+	if (rc == MDB_NOTFOUND) {
+		printf("  %s: ok\n", name);
+		return MDB_SUCCESS;
+	}
+	printf("  %s: failed, error %d %s\n", name, rc, mdb_strerror(rc));
+	return rc;
+}
+
 static void usage(char *prog)
 {
-	fprintf(stderr, "usage: %s [-V] [-n] [-e] [-r[r]] [-f[f[f]]] [-a|-s subdb] dbpath\n", prog);
+	fprintf(stderr, "usage: %s [-V] [-n] [-e] [-k] [-r[r]] [-f[f[f]]] [-a|-s subdb] dbpath\n", prog);
 	exit(EXIT_FAILURE);
 }
 
@@ -53,6 +75,7 @@ int main(int argc, char *argv[])
 	char *envname;
 	char *subname = NULL;
 	int alldbs = 0, envinfo = 0, envflags = 0, freinfo = 0, rdrinfo = 0;
+	int pagecheck = 0;
 
 	if (argc < 2) {
 		usage(prog);
@@ -62,12 +85,13 @@ int main(int argc, char *argv[])
 	 * -s: print stat of only the named subDB
 	 * -e: print env info
 	 * -f: print freelist info
+	 * -k: verify the checksum of every page
 	 * -r: print reader info
 	 * -n: use NOSUBDIR flag on env_open
 	 * -V: print version and exit
 	 * (default) print stat of only the main DB
 	 */
-	while ((i = getopt(argc, argv, "Vaefnrs:")) != EOF) {
+	while ((i = getopt(argc, argv, "Vaefknrs:")) != EOF) {
 		switch(i) {
 		case 'V':
 			printf("%s\n", MDB_VERSION_STRING);
@@ -84,6 +108,9 @@ int main(int argc, char *argv[])
 		case 'f':
 			freinfo++;
 			break;
+		case 'k':
+			pagecheck++;
+			break;
 		case 'n':
 			envflags |= MDB_NOSUBDIR;
 			break;
@@ -110,9 +137,12 @@ int main(int argc, char *argv[])
 		return EXIT_FAILURE;
 	}
 
-	if (alldbs || subname) {
+	if (alldbs || subname || pagecheck) {
 		mdb_env_set_maxdbs(env, 4);
 	}
+	if (pagecheck) {
+		mdb_env_set_pagecheck(env, 1);
+	}
 
 	rc = mdb_env_open(env, envname, envflags | MDB_RDONLY, 0664);
 	if (rc) {
@@ -153,6 +183,58 @@ int main(int argc, char *argv[])
 		goto env_close;
 	}
 
+	if (pagecheck) {
+		unsigned int sample;
+
+		printf("Page Checksums\n");
+		(void)mdb_env_get_pagecheck(env, &sample);
+		if (!sample) {
+			printf("  Not present\n");
+		} else {
+			MDB_cursor *cursor;
+			MDB_val key;
+
+			rc = pgcheck(txn, 0, "Free DB");
+			if (rc)
+				goto txn_abort;
+			rc = mdb_open(txn, NULL, 0, &dbi);
+			if (rc) {
+				fprintf(stderr, "mdb_open failed, error %d %s\n", rc, mdb_strerror(rc));
+				goto txn_abort;
+			}
+			rc = pgcheck(txn, dbi, "Main DB");
+			if (rc)
+				goto txn_abort;
+			rc = mdb_cursor_open(txn, dbi, &cursor);
+			if (rc) {
+				fprintf(stderr, "mdb_cursor_open failed, error %d %s\n", rc, mdb_strerror(rc));
+				goto txn_abort;
+			}
+			while ((rc = mdb_cursor_get(cursor, &key, NULL, MDB_NEXT_NODUP)) == 0) {
+				char *str;
+				MDB_dbi db2;
+				if (memchr(key.mv_data, '\0', key.mv_size))
+					continue;
+				str = malloc(key.mv_size+1);
+				memcpy(str, key.mv_data, key.mv_size);
+				str[key.mv_size] = '\0';
+				rc = mdb_open(txn, str, 0, &db2);
+				if (rc == MDB_SUCCESS) {
+					rc = pgcheck(txn, db2, str);
+					mdb_close(env, db2);
+					if (rc) {
+						free(str);
+						break;
+					}
+				}
+				free(str);
+			}
+			mdb_cursor_close(cursor);
+			if (rc != MDB_NOTFOUND && rc != MDB_SUCCESS)
+				goto txn_abort;
+		}
+	}
+
 	if (freinfo) {
 		MDB_cursor *cursor;
 		MDB_val key, data;
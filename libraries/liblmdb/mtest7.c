@@ -0,0 +1,204 @@
+/* mtest7.c - memory-mapped database tester/toy */
+/*
+ * Copyright 2011-2021 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Tests for page checksums.
+ * With no argument: create an environment with checksums, reopen it
+ * with and without verification, and check an environment created
+ * without checksums behaves as before.
+ * With "corrupt": damage a leaf page of the checksummed environment
+ * and check reading it with verification fails.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lmdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == MDB_SUCCESS, #expr)
+#define RES(err, expr) ((rc = expr) == (err) || (CHECK(!rc, #expr), 0))
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, mdb_strerror(rc)), abort()))
+
+#define SUMDB	"./testdb/sum.mdb"
+#define PLAINDB	"./testdb/plain.mdb"
+#define COUNT	1000
+#define VICTIM	500
+
+static MDB_env *
+envopen(const char *path, unsigned int pagecheck)
+{
+	int rc;
+	MDB_env *env;
+
+	E(mdb_env_create(&env));
+	E(mdb_env_set_mapsize(env, 10485760));
+	E(mdb_env_set_pagecheck(env, pagecheck));
+	E(mdb_env_open(env, path, MDB_NOSUBDIR|MDB_NOSYNC, 0664));
+	return env;
+}
+
+static void
+fill(MDB_env *env, int first, int count)
+{
+	int i, rc;
+	MDB_dbi dbi;
+	MDB_val key, data;
+	MDB_txn *txn;
+	char kval[32], sval[32];
+
+	E(mdb_txn_begin(env, NULL, 0, &txn));
+	E(mdb_dbi_open(txn, NULL, 0, &dbi));
+	for (i = first; i < first + count; i++) {
+		sprintf(kval, "%08d", i);
+		sprintf(sval, "mtest7 value %08d", i);
+		key.mv_size = strlen(kval);
+		key.mv_data = kval;
+		data.mv_size = strlen(sval);
+		data.mv_data = sval;
+		E(mdb_put(txn, dbi, &key, &data, 0));
+	}
+	E(mdb_txn_commit(txn));
+}
+
+#define DIFFERS	1
+
+/* Read every record back, returns the first error or DIFFERS */
+static int
+check(MDB_env *env, int count)
+{
+	int i, rc;
+	MDB_dbi dbi;
+	MDB_val key, data;
+	MDB_txn *txn;
+	char kval[32], sval[32];
+
+	E(mdb_txn_begin(env, NULL, MDB_RDONLY, &txn));
+	E(mdb_dbi_open(txn, NULL, 0, &dbi));
+	for (i = 0; i < count; i++) {
+		sprintf(kval, "%08d", i);
+		sprintf(sval, "mtest7 value %08d", i);
+		key.mv_size = strlen(kval);
+		key.mv_data = kval;
+		rc = mdb_get(txn, dbi, &key, &data);
+		if (rc)
+			break;
+		if (data.mv_size != strlen(sval) ||
+			memcmp(data.mv_data, sval, data.mv_size)) {
+			rc = DIFFERS;
+			break;
+		}
+	}
+	mdb_txn_abort(txn);
+	return rc;
+}
+
+/* Flip a byte of a stored value in the data file */
+static void
+damage(const char *path, int i)
+{
+	FILE *fp;
+	char *buf, sval[32];
+	long len, off;
+	size_t slen;
+	int rc = 0, found = 0;
+
+	sprintf(sval, "mtest7 value %08d", i);
+	slen = strlen(sval);
+	CHECK((fp = fopen(path, "r+b")) != NULL, "fopen");
+	fseek(fp, 0, SEEK_END);
+	len = ftell(fp);
+	buf = malloc(len);
+	rewind(fp);
+	CHECK(fread(buf, 1, len, fp) == (size_t)len, "fread");
+	/* stale copies may be left on free pages, damage them all */
+	for (off = 0; off + (long)slen <= len; off++) {
+		if (memcmp(buf + off, sval, slen))
+			continue;
+		buf[off] ^= 0x20;
+		fseek(fp, off, SEEK_SET);
+		CHECK(fwrite(buf + off, 1, 1, fp) == 1, "fwrite");
+		found++;
+	}
+	CHECK(found, "value not found in data file");
+	fclose(fp);
+	free(buf);
+}
+
+int main(int argc,char * argv[])
+{
+	int rc;
+	MDB_env *env;
+	unsigned int sample;
+
+	if (argc > 1 && !strcmp(argv[1], "corrupt")) {
+		damage(SUMDB, VICTIM);
+
+		/* without verification the damage goes unnoticed */
+		env = envopen(SUMDB, 0);
+		rc = check(env, COUNT);
+		CHECK(rc == DIFFERS, "read unverified");
+		mdb_env_close(env);
+
+		env = envopen(SUMDB, 1);
+		RES(MDB_CORRUPTED, check(env, COUNT));
+		CHECK(rc == MDB_CORRUPTED, "damaged page not detected");
+		mdb_env_close(env);
+		return 0;
+	}
+
+	remove(SUMDB);
+	remove(SUMDB "-lock");
+	remove(PLAINDB);
+	remove(PLAINDB "-lock");
+
+	/* a new environment gets checksums */
+	env = envopen(SUMDB, 1);
+	E(mdb_env_get_pagecheck(env, &sample));
+	CHECK(sample == 1, "checksums not enabled");
+	fill(env, 0, COUNT / 2);
+	E(check(env, COUNT / 2));
+	mdb_env_close(env);
+
+	/* they are kept up to date without verification */
+	env = envopen(SUMDB, 0);
+	fill(env, COUNT / 2, COUNT / 2);
+	E(check(env, COUNT));
+	mdb_env_close(env);
+
+	env = envopen(SUMDB, 1);
+	E(mdb_env_get_pagecheck(env, &sample));
+	CHECK(sample == 1, "checksums lost on reopen");
+	E(check(env, COUNT));
+	mdb_env_close(env);
+
+	/* an environment created without them never has any */
+	env = envopen(PLAINDB, 0);
+	fill(env, 0, COUNT);
+	mdb_env_close(env);
+
+	env = envopen(PLAINDB, 1);
+	E(mdb_env_get_pagecheck(env, &sample));
+	CHECK(sample == 0, "checksums on an environment created without");
+	fill(env, COUNT, 1);
+	E(check(env, COUNT + 1));
+	mdb_env_close(env);
+
+	/* and isn't verified, damage goes unnoticed */
+	damage(PLAINDB, VICTIM);
+	env = envopen(PLAINDB, 1);
+	rc = check(env, COUNT);
+	CHECK(rc == DIFFERS, "read without checksums");
+	mdb_env_close(env);
+
+	return 0;
+}
@@ -20,6 +20,7 @@
 #include <ac/string.h>
 #include <ac/time.h>
 #include <ac/unistd.h>
+#include <math.h>
 
 #include <event2/event.h>
 #include <event2/dns.h>
@@ -27,6 +28,9 @@
 #include "lutil.h"
 #include "lload.h"
 
+/* Percentage by which latency may exceed the baseline, 0 disables */
+unsigned int lload_adaptive_tolerance = 0;
+
 static void
 upstream_connect_cb( evutil_socket_t s, short what, void *arg )
 {
@@ -340,6 +344,9 @@ try_upstream(
         }
 
         b->b_n_ops_executing++;
+        if ( b->b_n_ops_executing > b->b_limit_peak ) {
+            b->b_limit_peak = b->b_n_ops_executing;
+        }
         if ( op->o_tag == LDAP_REQ_BIND ) {
             b->b_counters[LLOAD_STATS_OPS_BIND].lc_ops_received++;
         } else {
@@ -370,7 +377,8 @@ backend_select(
     LloadConnection *c;
 
     assert_locked( &b->b_mutex );
-    if ( b->b_max_pending && b->b_n_ops_executing >= b->b_max_pending ) {
+    if ( ( b->b_max_pending && b->b_n_ops_executing >= b->b_max_pending ) ||
+            ( b->b_limit && b->b_n_ops_executing >= b->b_limit ) ) {
         Debug( LDAP_DEBUG_CONNS, "backend_select: "
                 "backend %s too busy\n",
                 b->b_uri.bv_val );
@@ -428,6 +436,88 @@ upstream_select(
     return finished;
 }
 
+/*
+ * Adjust the backend's concurrency limit based on how its latency compares to
+ * the best we have seen recently. Called once a second:
+ * - if the average time to first response has grown past the tolerance, the
+ *   backend is queueing requests and the limit shrinks in proportion (at most
+ *   halving it each time)
+ * - otherwise, if we came anywhere near the limit, allow for a little more
+ *
+ * Operations over the limit are then rejected by backend_select as busy so
+ * the tier can try its other backends.
+ */
+void
+backend_update_limit( LloadBackend *b )
+{
+    uintptr_t count, total, rtt;
+    long limit, floor, ceiling, peak;
+    float gradient;
+
+    checked_lock( &b->b_mutex );
+    count = __atomic_exchange_n( &b->b_rtt_count, 0, __ATOMIC_RELAXED );
+    total = __atomic_exchange_n( &b->b_rtt_time, 0, __ATOMIC_RELAXED );
+    peak = b->b_limit_peak;
+    b->b_limit_peak = b->b_n_ops_executing;
+
+    if ( !lload_adaptive_tolerance ) {
+        b->b_limit = 0;
+        b->b_min_rtt = 0;
+        goto done;
+    }
+
+    floor = b->b_numconns > 0 ? b->b_numconns : 1;
+    ceiling = b->b_max_pending;
+    if ( !b->b_limit ) {
+        b->b_limit = ceiling ? ceiling : LLOAD_ADAPTIVE_LIMIT_INITIAL;
+    }
+
+    if ( !count ) {
+        /* Nothing to learn from */
+        goto done;
+    }
+    rtt = total / count;
+
+    /* Let the baseline drift up slowly in case the backend just got slower */
+    if ( !b->b_min_rtt || rtt < b->b_min_rtt ) {
+        b->b_min_rtt = rtt;
+    } else {
+        b->b_min_rtt += ( rtt - b->b_min_rtt ) / 256;
+    }
+
+    gradient = (float)b->b_min_rtt * ( 100 + lload_adaptive_tolerance ) /
+            100 / ( rtt ? rtt : 1 );
+    if ( gradient < 0.5 ) {
+        gradient = 0.5;
+    }
+
+    if ( gradient < 1 ) {
+        limit = b->b_limit * gradient;
+    } else if ( peak * 2 >= b->b_limit ) {
+        limit = b->b_limit + sqrt( b->b_limit );
+    } else {
+        limit = b->b_limit;
+    }
+
+    if ( limit < floor ) {
+        limit = floor;
+    } else if ( ceiling && limit > ceiling ) {
+        limit = ceiling;
+    }
+
+    if ( limit != b->b_limit ) {
+        Debug( LDAP_DEBUG_STATS, "backend_update_limit: "
+                "backend %s latency %luus (baseline %luus), "
+                "concurrency limit %ld -> %ld\n",
+                b->b_uri.bv_val, (unsigned long)rtt,
+                (unsigned long)b->b_min_rtt, b->b_limit, limit );
+        b->b_limit = limit;
+    }
+
+done:
+    checked_unlock( &b->b_mutex );
+}
+
 /*
  * Will schedule a connection attempt if there is a need for it. Need exclusive
  * access to backend, its b_mutex is not touched here, though.
@@ -749,6 +839,24 @@ lload_backend_new( void )
     return b;
 }
 
+static void
+backend_free( void *arg )
+{
+    LloadBackend *b = arg;
+
+    ldap_pvt_thread_mutex_destroy( &b->b_mutex );
+
+    ch_free( b->b_host );
+    ch_free( b->b_uri.bv_val );
+    ch_free( b->b_name.bv_val );
+    ch_free( b );
+}
+
+/*
+ * Removing the backend from its tier publishes a new backend array, threads
+ * still in an older epoch might be walking the previous one and lock or read
+ * this backend, so the memory is only released once they have left.
+ */
 void
 lload_backend_destroy( LloadBackend *b )
 {
@@ -777,7 +885,6 @@ lload_backend_destroy( LloadBackend *b )
 #endif /* BALANCER_MODULE */
 
     checked_unlock( &b->b_mutex );
-    ldap_pvt_thread_mutex_destroy( &b->b_mutex );
 
     if ( b->b_retry_event ) {
         event_del( b->b_retry_event );
@@ -785,8 +892,9 @@ lload_backend_destroy( LloadBackend *b )
         b->b_retry_event = NULL;
     }
 
-    ch_free( b->b_host );
-    ch_free( b->b_uri.bv_val );
-    ch_free( b->b_name.bv_val );
-    ch_free( b );
+    if ( daemon_base ) {
+        epoch_append( b, backend_free );
+    } else {
+        backend_free( b );
+    }
 }
@@ -94,10 +94,13 @@ client_bind(
         ber_tag_t tag,
         struct berval *auth )
 {
-    ber_printf( upstream->c_pendingber, "t{titOtO}", LDAP_TAG_MESSAGE,
-            LDAP_TAG_MSGID, op->o_upstream_msgid,
-            LDAP_REQ_BIND, &op->o_request,
-            LDAP_TAG_CONTROLS, BER_BV_OPTIONAL( &op->o_ctrls ) );
+    if ( lload_ber_put_message( upstream->c_pendingber, op->o_upstream_msgid,
+                 LDAP_REQ_BIND, &op->o_request, &op->o_ctrls ) ) {
+        Debug( LDAP_DEBUG_ANY, "client_bind: "
+                "failed to queue bind msgid=%d for upstream connid=%lu\n",
+                op->o_upstream_msgid, op->o_upstream_connid );
+        return -1;
+    }
 
     return 0;
 }
@@ -213,8 +216,7 @@ request_bind( LloadConnection *client, LloadOperation *op )
                 "client connid=%lu is pinned pin=%lu\n",
                 client->c_connid, pin );
 
-        pinned_op =
-                ldap_tavl_delete( &client->c_ops, &needle, operation_client_cmp );
+        pinned_op = operation_table_delete( &client->c_ops, &needle );
         if ( pinned_op ) {
             assert( op->o_tag == pinned_op->o_tag );
 
@@ -232,12 +234,11 @@ request_bind( LloadConnection *client, LloadOperation *op )
             /* No one has seen this operation yet, plant the pin back in its stead */
             client->c_n_ops_executing--;
             op->o_res = LLOAD_OP_COMPLETED;
-            ldap_tavl_delete( &client->c_ops, op, operation_client_cmp );
+            operation_table_delete( &client->c_ops, op );
             op->o_client = NULL;
             assert( op->o_upstream == NULL );
 
-            rc = ldap_tavl_insert( &client->c_ops, pinned_op, operation_client_cmp,
-                    ldap_avl_dup_error );
+            rc = operation_table_insert( &client->c_ops, pinned_op );
             assert( rc == LDAP_SUCCESS );
 
             /* No one has seen this operation yet */
@@ -251,7 +252,7 @@ request_bind( LloadConnection *client, LloadOperation *op )
         }
     }
 
-    ldap_tavl_delete( &client->c_ops, op, operation_client_cmp );
+    operation_table_delete( &client->c_ops, op );
     client->c_n_ops_executing--;
 
     client_reset( client );
@@ -333,13 +334,33 @@ request_bind( LloadConnection *client, LloadOperation *op )
         goto fail;
     }
 
-    rc = ldap_tavl_insert( &client->c_ops, op, operation_client_cmp, ldap_avl_dup_error );
+    rc = operation_table_insert( &client->c_ops, op );
     assert( rc == LDAP_SUCCESS );
     client->c_n_ops_executing++;
 
     client_restricted = client->c_restricted;
     CONNECTION_UNLOCK(client);
 
+    if ( tag == LDAP_AUTH_SIMPLE && !pin &&
+            client_restricted != LLOAD_OP_RESTRICTED_ISOLATE &&
+            lload_bind_cache_lookup( op, &binddn, &auth ) ) {
+        /* A backend accepted these credentials recently, finish it here */
+        CONNECTION_LOCK(client);
+        client->c_state = LLOAD_C_READY;
+        client->c_pin_id = 0;
+        if ( !BER_BVISNULL( &client->c_auth ) &&
+                !ber_bvstrcasecmp( &client->c_auth, &lloadd_identity ) ) {
+            client->c_type = LLOAD_C_PRIVILEGED;
+        }
+        CONNECTION_UNLOCK(client);
+
+        op->o_res = LLOAD_OP_COMPLETED;
+        operation_send_reject( op, LDAP_SUCCESS, "", 1 );
+
+        ber_free( copy, 0 );
+        return LDAP_SUCCESS;
+    }
+
     if ( pin ) {
         checked_lock( &op->o_link_mutex );
         upstream = op->o_upstream;
@@ -422,7 +443,7 @@ request_bind( LloadConnection *client, LloadOperation *op )
     }
 
     if ( pin ) {
-        ldap_tavl_delete( &upstream->c_ops, op, operation_upstream_cmp );
+        operation_table_delete( &upstream->c_ops, op );
         if ( tag == LDAP_AUTH_SIMPLE ) {
             pin = op->o_pin_id = 0;
         }
@@ -439,6 +460,7 @@ request_bind( LloadConnection *client, LloadOperation *op )
     op->o_upstream = upstream;
     op->o_upstream_connid = upstream->c_connid;
     op->o_upstream_msgid = upstream->c_next_msgid++;
+    gettimeofday( &op->o_forwarded, NULL );
     op->o_res = LLOAD_OP_FAILED;
 
     /* Was it unlinked in the meantime? No need to send a response since the
@@ -477,8 +499,7 @@ request_bind( LloadConnection *client, LloadOperation *op )
             "added bind from client connid=%lu to upstream connid=%lu "
             "as msgid=%d\n",
             op->o_client_connid, op->o_upstream_connid, op->o_upstream_msgid );
-    if ( ldap_tavl_insert( &upstream->c_ops, op, operation_upstream_cmp,
-                 ldap_avl_dup_error ) ) {
+    if ( operation_table_insert( &upstream->c_ops, op ) ) {
         assert(0);
     }
     upstream->c_state = LLOAD_C_BINDING;
@@ -536,7 +557,7 @@ finish_sasl_bind(
     int rc;
 
     CONNECTION_ASSERT_LOCKED(upstream);
-    removed = ldap_tavl_delete( &upstream->c_ops, op, operation_upstream_cmp );
+    removed = operation_table_delete( &upstream->c_ops, op );
     if ( !removed ) {
         assert( upstream->c_state != LLOAD_C_BINDING );
         /* FIXME: has client replaced this bind since? */
@@ -572,8 +593,7 @@ finish_sasl_bind(
     op->o_ber = ber;
 
     /* Could we have been unlinked in the meantime? */
-    rc = ldap_tavl_insert(
-            &upstream->c_ops, op, operation_upstream_cmp, ldap_avl_dup_error );
+    rc = operation_table_insert( &upstream->c_ops, op );
     assert( rc == LDAP_SUCCESS );
 
     CONNECTION_UNLOCK(upstream);
@@ -632,7 +652,7 @@ handle_bind_response(
     }
 
     CONNECTION_LOCK(upstream);
-    if ( !ldap_tavl_find( upstream->c_ops, op, operation_upstream_cmp ) ) {
+    if ( !operation_table_find( &upstream->c_ops, op ) ) {
         /*
          * operation might not be found because:
          * - it has timed out (only happens when debugging/hung/...)
@@ -667,10 +687,9 @@ handle_bind_response(
         op->o_pin_id = 0;
 
     } else if ( result == LDAP_SASL_BIND_IN_PROGRESS ) {
-        ldap_tavl_delete( &upstream->c_ops, op, operation_upstream_cmp );
+        operation_table_delete( &upstream->c_ops, op );
         op->o_upstream_msgid = 0;
-        rc = ldap_tavl_insert(
-                &upstream->c_ops, op, operation_upstream_cmp, ldap_avl_dup_error );
+        rc = operation_table_insert( &upstream->c_ops, op );
         assert( rc == LDAP_SUCCESS );
     } else {
         int sasl_finished = 0;
@@ -696,7 +715,7 @@ handle_bind_response(
     }
 
     CONNECTION_LOCK(client);
-    removed = ldap_tavl_delete( &client->c_ops, op, operation_client_cmp );
+    removed = operation_table_delete( &client->c_ops, op );
     assert( !removed || op == removed );
 
     if ( client->c_state == LLOAD_C_BINDING ) {
@@ -705,8 +724,7 @@ handle_bind_response(
             case LDAP_SASL_BIND_IN_PROGRESS:
                 op->o_saved_msgid = op->o_client_msgid;
                 op->o_client_msgid = 0;
-                rc = ldap_tavl_insert( &client->c_ops, op, operation_client_cmp,
-                        ldap_avl_dup_error );
+                rc = operation_table_insert( &client->c_ops, op );
                 assert( rc == LDAP_SUCCESS );
                 break;
             case LDAP_SUCCESS:
@@ -822,7 +840,7 @@ handle_whoami_response(
         }
     }
 
-    removed = ldap_tavl_delete( &client->c_ops, op, operation_client_cmp );
+    removed = operation_table_delete( &client->c_ops, op );
     assert( !removed || op == removed );
     op->o_pin_id = 0;
     if ( removed ) {
@@ -0,0 +1,1008 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1998-2024 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <ac/ctype.h>
+#include <ac/string.h>
+#include <ac/time.h>
+
+#include "lload.h"
+
+#include "lutil.h"
+#include "lutil_sha1.h"
+
+/*
+ * Read-through caches of search responses and simple bind verifications.
+ *
+ * A search is looked up by the identity it will be evaluated as upstream, the
+ * raw request and the raw request controls. On a miss, the responses are
+ * recorded as they are forwarded to the client and a successful result is
+ * kept for cache_ttl seconds. Any write forwarded through us empties the
+ * cache, a generation count makes sure searches that were in progress at the
+ * time are not stored afterwards.
+ *
+ * A simple bind is looked up by its DN, we keep a salted and iterated hash of
+ * the credentials that were last accepted by a backend. Any other outcome of
+ * a bind, a write targeting the DN or an extended operation other than Who am
+ * I? (it might be a password change) forgets it.
+ *
+ * Searches and compares that are eligible can also be coalesced: while an
+ * operation (the leader of a flight) is waiting for its first response,
+ * identical requests join it instead of being forwarded and each response is
+ * copied to the waiters under their own message IDs as it arrives.
+ */
+
+typedef struct LloadCache {
+    ldap_pvt_thread_mutex_t cache_mutex;
+    TAvlnode *cache_tree;
+    LDAP_TAILQ_HEAD(lload_cache_q, LloadCacheEntry) cache_lru;
+    unsigned int cache_entries;
+    ber_len_t cache_size;
+    unsigned long cache_gen;
+
+    int *cache_ttl;
+    unsigned int *cache_max_entries;
+    ber_len_t *cache_max_size;
+} LloadCache;
+
+struct LloadCacheEntry {
+    LloadCache *ce_cache;
+    struct berval ce_key;
+    struct berval ce_pdus;
+    BerElement *ce_ber;
+    ber_len_t ce_size;
+    unsigned long ce_gen;
+    time_t ce_expires;
+    LDAP_TAILQ_ENTRY(LloadCacheEntry) ce_next;
+};
+
+struct LloadFlight {
+    struct berval lf_key;
+    LloadOperation *lf_leader;
+    struct timeval lf_start;
+    LDAP_TAILQ_HEAD(lload_flight_q, LloadOperation) lf_waiters;
+    unsigned int lf_nwaiters;
+    int lf_unlisted;
+};
+
+#define LLOAD_BIND_CACHE_SALT 8
+#define LLOAD_BIND_CACHE_ROUNDS 1000
+#define LLOAD_BIND_CACHE_CRED ( LLOAD_BIND_CACHE_SALT + LUTIL_SHA1_BYTES )
+
+int lload_cache_ttl = 0;
+unsigned int lload_cache_max_entries = LLOAD_CACHE_MAX_ENTRIES_DEFAULT;
+ber_len_t lload_cache_max_size = LLOAD_CACHE_MAX_SIZE_DEFAULT;
+
+int lload_bind_cache_ttl = 0;
+unsigned int lload_bind_cache_max_entries = LLOAD_CACHE_MAX_ENTRIES_DEFAULT;
+
+unsigned int lload_coalesce_max_waiters = 0;
+unsigned int lload_coalesce_timeout = LLOAD_COALESCE_TIMEOUT_DEFAULT;
+
+static ldap_pvt_thread_mutex_t flights_mutex;
+static TAvlnode *flights;
+
+static LloadCache search_cache = {
+    .cache_lru = LDAP_TAILQ_HEAD_INITIALIZER(search_cache.cache_lru),
+    .cache_ttl = &lload_cache_ttl,
+    .cache_max_entries = &lload_cache_max_entries,
+    .cache_max_size = &lload_cache_max_size,
+};
+
+static LloadCache bind_cache = {
+    .cache_lru = LDAP_TAILQ_HEAD_INITIALIZER(bind_cache.cache_lru),
+    .cache_ttl = &lload_bind_cache_ttl,
+    .cache_max_entries = &lload_bind_cache_max_entries,
+};
+
+/* Controls whose responses are tied to a particular upstream connection */
+static const char *uncacheable_controls[] = {
+    LDAP_CONTROL_PAGEDRESULTS,
+    LDAP_CONTROL_VLVREQUEST,
+    LDAP_CONTROL_SYNC,
+    LDAP_CONTROL_PERSIST_REQUEST,
+    NULL
+};
+
+static int
+lload_cache_cmp( const void *l, const void *r )
+{
+    const LloadCacheEntry *le = l, *re = r;
+
+    if ( le->ce_key.bv_len != re->ce_key.bv_len ) {
+        return le->ce_key.bv_len < re->ce_key.bv_len ? -1 : 1;
+    }
+    return memcmp( le->ce_key.bv_val, re->ce_key.bv_val, le->ce_key.bv_len );
+}
+
+void
+lload_cache_entry_free( LloadCacheEntry *entry )
+{
+    if ( entry->ce_ber ) {
+        ber_free( entry->ce_ber, 1 );
+    }
+    ch_free( entry->ce_pdus.bv_val );
+    ch_free( entry->ce_key.bv_val );
+    ch_free( entry );
+}
+
+static LloadCacheEntry *
+cache_entry_new( LloadCache *cache, struct berval *key )
+{
+    LloadCacheEntry *entry = ch_calloc( 1, sizeof(LloadCacheEntry) );
+
+    assert_locked( &cache->cache_mutex );
+
+    entry->ce_cache = cache;
+    entry->ce_key = *key;
+    entry->ce_gen = cache->cache_gen;
+    return entry;
+}
+
+static void
+cache_remove( LloadCache *cache, LloadCacheEntry *entry )
+{
+    LloadCacheEntry *removed;
+
+    assert_locked( &cache->cache_mutex );
+
+    removed = ldap_tavl_delete( &cache->cache_tree, entry, lload_cache_cmp );
+    assert( removed == entry );
+    LDAP_TAILQ_REMOVE( &cache->cache_lru, entry, ce_next );
+    cache->cache_entries--;
+    cache->cache_size -= entry->ce_size;
+
+    lload_cache_entry_free( entry );
+}
+
+/*
+ * Look up an entry, dropping it if it has expired. A hit moves the entry to
+ * the back of the eviction queue.
+ */
+static LloadCacheEntry *
+cache_find( LloadCache *cache, struct berval *key, time_t now )
+{
+    LloadCacheEntry *entry, needle = { .ce_key = *key };
+
+    assert_locked( &cache->cache_mutex );
+
+    entry = ldap_tavl_find( cache->cache_tree, &needle, lload_cache_cmp );
+    if ( entry && entry->ce_expires < now ) {
+        cache_remove( cache, entry );
+        entry = NULL;
+    }
+    if ( entry ) {
+        LDAP_TAILQ_REMOVE( &cache->cache_lru, entry, ce_next );
+        LDAP_TAILQ_INSERT_TAIL( &cache->cache_lru, entry, ce_next );
+    }
+    return entry;
+}
+
+/*
+ * Make a completed entry visible, unless the cache has been invalidated since
+ * the entry was started.
+ */
+static void
+cache_insert( LloadCache *cache, LloadCacheEntry *pending )
+{
+    LloadCacheEntry *old;
+    ber_len_t max_size;
+
+    checked_lock( &cache->cache_mutex );
+    if ( pending->ce_gen != cache->cache_gen || !*cache->cache_ttl ||
+            !*cache->cache_max_entries ) {
+        checked_unlock( &cache->cache_mutex );
+        lload_cache_entry_free( pending );
+        return;
+    }
+    max_size = cache->cache_max_size ? *cache->cache_max_size : 0;
+
+    old = ldap_tavl_find( cache->cache_tree, pending, lload_cache_cmp );
+    if ( old ) {
+        cache_remove( cache, old );
+    }
+    while ( !LDAP_TAILQ_EMPTY( &cache->cache_lru ) &&
+            ( cache->cache_entries >= *cache->cache_max_entries ||
+                    ( max_size &&
+                            cache->cache_size + pending->ce_size >
+                                    max_size ) ) ) {
+        cache_remove( cache, LDAP_TAILQ_FIRST( &cache->cache_lru ) );
+    }
+
+    ldap_tavl_insert(
+            &cache->cache_tree, pending, lload_cache_cmp, ldap_avl_dup_error );
+    LDAP_TAILQ_INSERT_TAIL( &cache->cache_lru, pending, ce_next );
+    cache->cache_entries++;
+    cache->cache_size += pending->ce_size;
+    checked_unlock( &cache->cache_mutex );
+}
+
+static void
+cache_flush( LloadCache *cache )
+{
+    checked_lock( &cache->cache_mutex );
+    cache->cache_gen++;
+    while ( !LDAP_TAILQ_EMPTY( &cache->cache_lru ) ) {
+        cache_remove( cache, LDAP_TAILQ_FIRST( &cache->cache_lru ) );
+    }
+    checked_unlock( &cache->cache_mutex );
+}
+
+static int
+lload_cache_cacheable( LloadOperation *op )
+{
+    BerElementBuffer copy_berbuf;
+    BerElement *copy = (BerElement *)&copy_berbuf;
+    struct berval control;
+
+    switch ( op->o_tag ) {
+        case LDAP_REQ_SEARCH:
+            if ( !lload_cache_ttl && !lload_coalesce_max_waiters ) {
+                return 0;
+            }
+            break;
+        case LDAP_REQ_COMPARE:
+            if ( !lload_coalesce_max_waiters ) {
+                return 0;
+            }
+            break;
+        default:
+            return 0;
+    }
+
+    if ( op->o_restricted != LLOAD_OP_NOT_RESTRICTED ) {
+        return 0;
+    }
+
+    if ( BER_BVISNULL( &op->o_ctrls ) ) {
+        return 1;
+    }
+
+    ber_init2( copy, &op->o_ctrls, 0 );
+    while ( ber_skip_element( copy, &control ) == LBER_SEQUENCE ) {
+        BerElementBuffer control_berbuf;
+        BerElement *control_ber = (BerElement *)&control_berbuf;
+        struct berval oid;
+        int i;
+
+        ber_init2( control_ber, &control, 0 );
+        if ( ber_skip_element( control_ber, &oid ) == LBER_ERROR ) {
+            return 0;
+        }
+        for ( i = 0; uncacheable_controls[i]; i++ ) {
+            if ( !strncmp( oid.bv_val, uncacheable_controls[i], oid.bv_len ) &&
+                    uncacheable_controls[i][oid.bv_len] == '\0' ) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+static int
+flight_cmp( const void *l, const void *r )
+{
+    const LloadFlight *lf = l, *rf = r;
+
+    if ( lf->lf_key.bv_len != rf->lf_key.bv_len ) {
+        return lf->lf_key.bv_len < rf->lf_key.bv_len ? -1 : 1;
+    }
+    return memcmp( lf->lf_key.bv_val, rf->lf_key.bv_val, lf->lf_key.bv_len );
+}
+
+/*
+ * Stop new operations from joining the flight, a new one with the same key
+ * might take its place in the table.
+ */
+static void
+flight_unlist( LloadFlight *flight )
+{
+    LloadFlight *removed;
+
+    assert_locked( &flights_mutex );
+
+    if ( flight->lf_unlisted ) {
+        return;
+    }
+    removed = ldap_tavl_delete( &flights, flight, flight_cmp );
+    assert( removed == flight );
+    flight->lf_unlisted = 1;
+}
+
+static void
+flight_free( LloadFlight *flight )
+{
+    assert( LDAP_TAILQ_EMPTY( &flight->lf_waiters ) );
+    ch_free( flight->lf_key.bv_val );
+    ch_free( flight );
+}
+
+/*
+ * Returns 1 if the operation is now waiting for an identical one to finish,
+ * otherwise it is to be forwarded as usual, possibly leading a new flight.
+ */
+static int
+coalesce_join( LloadOperation *op, struct berval *key )
+{
+    LloadFlight *flight, needle = { .lf_key = *key };
+    struct timeval age;
+
+    checked_lock( &flights_mutex );
+    flight = ldap_tavl_find( flights, &needle, flight_cmp );
+    if ( flight ) {
+        /* Listed flights have not had a response yet */
+        timersub( &op->o_start, &flight->lf_start, &age );
+        if ( age.tv_sec * 1000 + age.tv_usec / 1000 <
+                lload_coalesce_timeout ) {
+            if ( flight->lf_nwaiters >= lload_coalesce_max_waiters ) {
+                /* Too many already, keep the flight to itself */
+                checked_unlock( &flights_mutex );
+                return 0;
+            }
+            LDAP_TAILQ_INSERT_TAIL( &flight->lf_waiters, op, o_flight_next );
+            flight->lf_nwaiters++;
+            op->o_flight = flight;
+
+            Debug( LDAP_DEBUG_STATS, "coalesce_join: "
+                    "connid=%lu msgid=%d waiting on connid=%lu msgid=%d\n",
+                    op->o_client_connid, op->o_client_msgid,
+                    flight->lf_leader->o_client_connid,
+                    flight->lf_leader->o_client_msgid );
+            checked_unlock( &flights_mutex );
+            return 1;
+        }
+
+        /* Too late to join, this one can lead the next flight */
+        flight_unlist( flight );
+    }
+
+    flight = ch_calloc( 1, sizeof(LloadFlight) );
+    ber_dupbv( &flight->lf_key, key );
+    flight->lf_leader = op;
+    flight->lf_start = op->o_start;
+    LDAP_TAILQ_INIT( &flight->lf_waiters );
+    ldap_tavl_insert( &flights, flight, flight_cmp, ldap_avl_dup_error );
+    op->o_flight = flight;
+    checked_unlock( &flights_mutex );
+
+    return 0;
+}
+
+/*
+ * Queue the recorded responses for the client. Either all of them are queued
+ * or none are and -1 is returned.
+ */
+static int
+cache_replay( LloadConnection *client, LloadOperation *op, LloadCacheEntry *entry )
+{
+    BerElementBuffer pdus_berbuf;
+    BerElement *pdus = (BerElement *)&pdus_berbuf;
+    BerElement *output;
+    struct berval pdu;
+    ber_len_t start;
+
+    assert_locked( &entry->ce_cache->cache_mutex );
+
+    checked_lock( &client->c_io_mutex );
+    output = client->c_pendingber;
+    if ( output == NULL && (output = ber_alloc()) == NULL ) {
+        checked_unlock( &client->c_io_mutex );
+        return -1;
+    }
+    client->c_pendingber = output;
+    ber_get_option( output, LBER_OPT_BER_BYTES_TO_WRITE, &start );
+
+    ber_init2( pdus, &entry->ce_pdus, 0 );
+    while ( ber_skip_element( pdus, &pdu ) == LBER_SEQUENCE ) {
+        BerElementBuffer pdu_berbuf;
+        BerElement *pdu_ber = (BerElement *)&pdu_berbuf;
+        BerValue response, controls = BER_BVNULL;
+        ber_tag_t tag, response_tag;
+        ber_len_t len;
+
+        ber_init2( pdu_ber, &pdu, 0 );
+        response_tag = ber_skip_element( pdu_ber, &response );
+        tag = ber_peek_tag( pdu_ber, &len );
+        if ( tag == LDAP_TAG_CONTROLS ) {
+            ber_skip_element( pdu_ber, &controls );
+        }
+
+        if ( lload_ber_put_message( output, op->o_client_msgid,
+                     response_tag, &response, &controls ) ) {
+            ber_set_option( output, LBER_OPT_BER_BYTES_TO_WRITE, &start );
+            checked_unlock( &client->c_io_mutex );
+            return -1;
+        }
+    }
+    checked_unlock( &client->c_io_mutex );
+
+    Debug( LDAP_DEBUG_STATS, "cache_replay: "
+            "connid=%lu msgid=%d answered from cache\n",
+            op->o_client_connid, op->o_client_msgid );
+    return 0;
+}
+
+/*
+ * Serve the search from the cache if we can, otherwise see whether an
+ * identical request is already on its way upstream. Returns 1 if the
+ * operation has been taken care of, otherwise 0 and the operation is set up
+ * to record its responses and/or share them with others if it is eligible.
+ */
+int
+lload_cache_lookup( LloadConnection *client, LloadOperation *op )
+{
+    LloadCacheEntry *entry;
+    BerElementBuffer key_berbuf;
+    BerElement *key_ber = (BerElement *)&key_berbuf;
+    struct berval key;
+    int proxied, rc;
+
+    if ( !lload_cache_cacheable( op ) ) {
+        return 0;
+    }
+
+    /*
+     * Unless the identity is proxied, all searches run as our own bind
+     * identity upstream and share one class.
+     */
+    ber_init2( key_ber, NULL, LBER_USE_DER );
+    CONNECTION_LOCK(client);
+    proxied = (lload_features & LLOAD_FEATURE_PROXYAUTHZ) &&
+            client->c_type != LLOAD_C_PRIVILEGED;
+    rc = ber_printf( key_ber, "{bOOO}", proxied,
+            proxied ? &client->c_auth : &lloadd_identity, &op->o_request,
+            &op->o_ctrls );
+    CONNECTION_UNLOCK(client);
+    if ( rc < 0 || ber_flatten2( key_ber, &key, 1 ) ) {
+        ber_free_buf( key_ber );
+        return 0;
+    }
+    ber_free_buf( key_ber );
+
+    if ( lload_cache_ttl && op->o_tag == LDAP_REQ_SEARCH ) {
+        checked_lock( &search_cache.cache_mutex );
+        entry = cache_find( &search_cache, &key, op->o_start.tv_sec );
+        if ( entry ) {
+            rc = 0;
+            if ( IS_ALIVE( client, c_live ) ) {
+                rc = cache_replay( client, op, entry );
+            }
+            checked_unlock( &search_cache.cache_mutex );
+            ch_free( key.bv_val );
+
+            if ( rc ) {
+                Debug( LDAP_DEBUG_ANY, "lload_cache_lookup: "
+                        "connid=%lu msgid=%d failed to queue cached "
+                        "responses, closing\n",
+                        op->o_client_connid, op->o_client_msgid );
+                CONNECTION_LOCK_DESTROY(client);
+            } else {
+                connection_write_cb( -1, 0, client );
+            }
+            op->o_res = LLOAD_OP_COMPLETED;
+            OPERATION_UNLINK(op);
+            return 1;
+        }
+        checked_unlock( &search_cache.cache_mutex );
+    }
+
+    if ( lload_coalesce_max_waiters && coalesce_join( op, &key ) ) {
+        ch_free( key.bv_val );
+        return 1;
+    }
+
+    if ( lload_cache_ttl && op->o_tag == LDAP_REQ_SEARCH ) {
+        checked_lock( &search_cache.cache_mutex );
+        op->o_cache = cache_entry_new( &search_cache, &key );
+        checked_unlock( &search_cache.cache_mutex );
+    } else {
+        ch_free( key.bv_val );
+    }
+    return 0;
+}
+
+/*
+ * Bind DNs are keyed in normalised form, otherwise a modify naming the entry
+ * with different spacing or escaping would leave the old credentials cached.
+ * Values are folded to lower case like the attributes most DNs are made of.
+ */
+static int
+bind_cache_key( struct berval *binddn, struct berval *key )
+{
+    LDAPDN dn = NULL;
+    ber_len_t i;
+    int rc;
+
+    if ( ldap_bv2dn( binddn, &dn, LDAP_DN_FORMAT_LDAP ) != LDAP_SUCCESS ) {
+        return -1;
+    }
+    rc = ldap_dn2bv( dn, key, LDAP_DN_FORMAT_LDAPV3 );
+    ldap_dnfree( dn );
+    if ( rc != LDAP_SUCCESS ) {
+        return -1;
+    }
+
+    for ( i = 0; i < key->bv_len; i++ ) {
+        key->bv_val[i] = TOLOWER( (unsigned char)key->bv_val[i] );
+    }
+    return 0;
+}
+
+static void
+bind_cache_hash(
+        unsigned char *salt,
+        struct berval *cred,
+        unsigned char *digest )
+{
+    lutil_SHA1_CTX ctx;
+    int i;
+
+    lutil_SHA1Init( &ctx );
+    lutil_SHA1Update( &ctx, salt, LLOAD_BIND_CACHE_SALT );
+    lutil_SHA1Update( &ctx, (unsigned char *)cred->bv_val, cred->bv_len );
+    lutil_SHA1Final( digest, &ctx );
+
+    for ( i = 1; i < LLOAD_BIND_CACHE_ROUNDS; i++ ) {
+        lutil_SHA1Init( &ctx );
+        lutil_SHA1Update( &ctx, digest, LUTIL_SHA1_BYTES );
+        lutil_SHA1Update( &ctx, salt, LLOAD_BIND_CACHE_SALT );
+        lutil_SHA1Final( digest, &ctx );
+    }
+}
+
+static void
+bind_cache_forget( struct berval *key )
+{
+    LloadCacheEntry *entry, needle = { .ce_key = *key };
+
+    checked_lock( &bind_cache.cache_mutex );
+    bind_cache.cache_gen++;
+    entry = ldap_tavl_find( bind_cache.cache_tree, &needle, lload_cache_cmp );
+    if ( entry ) {
+        cache_remove( &bind_cache, entry );
+    }
+    checked_unlock( &bind_cache.cache_mutex );
+}
+
+/*
+ * Check the simple bind credentials against the last ones a backend accepted.
+ * Returns 1 if they match, otherwise 0 and the operation is set up to record
+ * the outcome if it is eligible.
+ */
+int
+lload_bind_cache_lookup(
+        LloadOperation *op,
+        struct berval *binddn,
+        struct berval *cred )
+{
+    LloadCacheEntry *entry;
+    unsigned char stored[LLOAD_BIND_CACHE_CRED], digest[LUTIL_SHA1_BYTES];
+    struct berval key;
+    int i, diff = 0, found = 0;
+
+    if ( !lload_bind_cache_ttl || BER_BVISEMPTY( binddn ) ||
+            BER_BVISEMPTY( cred ) || !BER_BVISNULL( &op->o_ctrls ) ) {
+        return 0;
+    }
+
+    if ( bind_cache_key( binddn, &key ) ) {
+        return 0;
+    }
+
+    checked_lock( &bind_cache.cache_mutex );
+    entry = cache_find( &bind_cache, &key, op->o_start.tv_sec );
+    if ( entry ) {
+        memcpy( stored, entry->ce_pdus.bv_val, LLOAD_BIND_CACHE_CRED );
+        found = 1;
+    }
+    checked_unlock( &bind_cache.cache_mutex );
+
+    if ( !found && lutil_entropy( stored, LLOAD_BIND_CACHE_SALT ) ) {
+        ch_free( key.bv_val );
+        return 0;
+    }
+
+    bind_cache_hash( stored, cred, digest );
+
+    if ( found ) {
+        for ( i = 0; i < LUTIL_SHA1_BYTES; i++ ) {
+            diff |= digest[i] ^ stored[LLOAD_BIND_CACHE_SALT + i];
+        }
+        if ( !diff ) {
+            Debug( LDAP_DEBUG_STATS, "lload_bind_cache_lookup: "
+                    "connid=%lu msgid=%d bind verified from cache\n",
+                    op->o_client_connid, op->o_client_msgid );
+            ch_free( key.bv_val );
+            return 1;
+        }
+    }
+
+    checked_lock( &bind_cache.cache_mutex );
+    entry = cache_entry_new( &bind_cache, &key );
+    checked_unlock( &bind_cache.cache_mutex );
+
+    entry->ce_pdus.bv_len = LLOAD_BIND_CACHE_CRED;
+    entry->ce_pdus.bv_val = ch_malloc( LLOAD_BIND_CACHE_CRED );
+    memcpy( entry->ce_pdus.bv_val, stored, LLOAD_BIND_CACHE_SALT );
+    memcpy( entry->ce_pdus.bv_val + LLOAD_BIND_CACHE_SALT, digest,
+            LUTIL_SHA1_BYTES );
+
+    op->o_cache = entry;
+    return 0;
+}
+
+static void
+bind_cache_response(
+        LloadOperation *op,
+        ber_tag_t response_tag,
+        struct berval *response,
+        struct berval *controls )
+{
+    LloadCacheEntry *pending = op->o_cache;
+    BerElementBuffer result_berbuf;
+    BerElement *result_ber = (BerElement *)&result_berbuf;
+    ber_int_t result;
+
+    op->o_cache = NULL;
+
+    /*
+     * Only remember plain successes, responses with controls (password
+     * policy warnings) need to keep coming from the server.
+     */
+    ber_init2( result_ber, response, 0 );
+    if ( response_tag == LDAP_RES_BIND && BER_BVISNULL( controls ) &&
+            ber_get_enum( result_ber, &result ) != LBER_ERROR &&
+            result == LDAP_SUCCESS ) {
+        pending->ce_expires = op->o_last_response.tv_sec + lload_bind_cache_ttl;
+        cache_insert( &bind_cache, pending );
+        return;
+    }
+
+    bind_cache_forget( &pending->ce_key );
+    lload_cache_entry_free( pending );
+}
+
+/*
+ * Record a response being forwarded for an operation that has a pending cache
+ * entry. Once the operation is done, a successful result is made visible to
+ * other clients.
+ */
+void
+lload_cache_response(
+        LloadOperation *op,
+        ber_tag_t response_tag,
+        struct berval *response,
+        struct berval *controls )
+{
+    LloadCacheEntry *pending = op->o_cache;
+    BerElementBuffer result_berbuf;
+    BerElement *result_ber = (BerElement *)&result_berbuf;
+    ber_int_t result;
+
+    assert( pending );
+
+    if ( pending->ce_cache == &bind_cache ) {
+        bind_cache_response( op, response_tag, response, controls );
+        return;
+    }
+
+    switch ( response_tag ) {
+        case LDAP_RES_SEARCH_ENTRY:
+        case LDAP_RES_SEARCH_REFERENCE:
+        case LDAP_RES_SEARCH_RESULT:
+            break;
+        default:
+            /* Intermediate responses, leave that well alone */
+            goto drop;
+    }
+
+    pending->ce_size += response->bv_len + controls->bv_len;
+    if ( pending->ce_size > lload_cache_max_size ) {
+        goto drop;
+    }
+
+    if ( !pending->ce_ber && (pending->ce_ber = ber_alloc()) == NULL ) {
+        goto drop;
+    }
+    if ( ber_printf( pending->ce_ber, "{tOtO}", response_tag, response,
+                 LDAP_TAG_CONTROLS, BER_BV_OPTIONAL( controls ) ) < 0 ) {
+        goto drop;
+    }
+
+    if ( response_tag != LDAP_RES_SEARCH_RESULT ) {
+        return;
+    }
+
+    ber_init2( result_ber, response, 0 );
+    if ( ber_get_enum( result_ber, &result ) == LBER_ERROR ||
+            result != LDAP_SUCCESS ||
+            ber_flatten2( pending->ce_ber, &pending->ce_pdus, 1 ) ) {
+        goto drop;
+    }
+    ber_free( pending->ce_ber, 1 );
+    pending->ce_ber = NULL;
+    pending->ce_expires = op->o_last_response.tv_sec + lload_cache_ttl;
+    op->o_cache = NULL;
+
+    cache_insert( &search_cache, pending );
+    return;
+
+drop:
+    op->o_cache = NULL;
+    lload_cache_entry_free( pending );
+}
+
+void
+lload_cache_flush( void )
+{
+    cache_flush( &search_cache );
+    cache_flush( &bind_cache );
+}
+
+/*
+ * Anything that is not a search, compare or bind might change what the
+ * backends would return.
+ */
+void
+lload_cache_invalidate( LloadOperation *op )
+{
+    static struct berval whoami = BER_BVC(LDAP_EXOP_WHO_AM_I);
+    BerElementBuffer copy_berbuf;
+    BerElement *copy = (BerElement *)&copy_berbuf;
+    struct berval dn = BER_BVNULL, oid, key;
+
+    switch ( op->o_tag ) {
+        case LDAP_REQ_SEARCH:
+        case LDAP_REQ_COMPARE:
+        case LDAP_REQ_BIND:
+            return;
+        case LDAP_REQ_EXTENDED:
+            /* Clients commonly follow a Bind with a Who am I? */
+            ber_init2( copy, &op->o_request, 0 );
+            if ( ber_get_stringbv( copy, &oid, LBER_BV_NOTERM ) !=
+                            LBER_ERROR &&
+                    !ber_bvcmp( &oid, &whoami ) ) {
+                return;
+            }
+            break;
+        default:
+            break;
+    }
+
+    if ( lload_cache_ttl ) {
+        cache_flush( &search_cache );
+    }
+
+    if ( !lload_bind_cache_ttl ) {
+        return;
+    }
+
+    switch ( op->o_tag ) {
+        case LDAP_REQ_ADD:
+            return;
+        case LDAP_REQ_DELETE:
+            dn = op->o_request;
+            break;
+        case LDAP_REQ_MODIFY:
+        case LDAP_REQ_MODRDN:
+            ber_init2( copy, &op->o_request, 0 );
+            if ( ber_get_stringbv( copy, &dn, LBER_BV_NOTERM ) ==
+                    LBER_ERROR ) {
+                BER_BVZERO( &dn );
+            }
+            break;
+        default:
+            /* Password modify and friends */
+            break;
+    }
+
+    if ( BER_BVISNULL( &dn ) || bind_cache_key( &dn, &key ) ) {
+        cache_flush( &bind_cache );
+        return;
+    }
+
+    bind_cache_forget( &key );
+    ch_free( key.bv_val );
+}
+
+/*
+ * Pass a response received for the leader of a flight on to its waiters.
+ * Once the final response has been passed on, the waiters are done. If
+ * nobody is waiting, the leader leaves the flight and its later responses
+ * are not looked at here.
+ */
+void
+lload_coalesce_response(
+        LloadOperation *op,
+        ber_tag_t response_tag,
+        struct berval *response,
+        struct berval *controls )
+{
+    LloadFlight *flight;
+    LloadOperation *waiter;
+    LloadConnection **clients;
+    LDAP_TAILQ_HEAD(lload_done_q, LloadOperation) done =
+            LDAP_TAILQ_HEAD_INITIALIZER(done);
+    int i, n = 0, failed, nclients, shared = 0, final;
+
+    final = response_tag != LDAP_RES_SEARCH_ENTRY &&
+            response_tag != LDAP_RES_SEARCH_REFERENCE &&
+            response_tag != LDAP_RES_INTERMEDIATE;
+
+    /* The operation might be getting abandoned, taking the flight with it */
+    checked_lock( &flights_mutex );
+    flight = op->o_flight;
+    if ( !flight ) {
+        checked_unlock( &flights_mutex );
+        return;
+    }
+    assert( flight->lf_leader == op );
+    /* Too late for anyone else to join */
+    flight_unlist( flight );
+    if ( !flight->lf_nwaiters ) {
+        /* Nobody to share with, the rest of the responses can skip us */
+        op->o_flight = NULL;
+        checked_unlock( &flights_mutex );
+        flight_free( flight );
+        return;
+    }
+    /* Clients we could queue the response for go first, the others last */
+    nclients = failed = flight->lf_nwaiters;
+    clients = ch_malloc( nclients * sizeof(LloadConnection *) );
+
+    LDAP_TAILQ_FOREACH ( waiter, &flight->lf_waiters, o_flight_next ) {
+        LloadConnection *client;
+        BerElement *output;
+
+        checked_lock( &waiter->o_link_mutex );
+        client = waiter->o_client;
+        checked_unlock( &waiter->o_link_mutex );
+
+        if ( !client || !IS_ALIVE( client, c_live ) ||
+                !acquire_ref( &client->c_refcnt ) ) {
+            continue;
+        }
+
+        checked_lock( &client->c_io_mutex );
+        output = client->c_pendingber;
+        if ( output == NULL && (output = ber_alloc()) == NULL ) {
+            checked_unlock( &client->c_io_mutex );
+            RELEASE_REF( client, c_refcnt, client->c_destroy );
+            continue;
+        }
+        client->c_pendingber = output;
+
+        if ( lload_ber_put_message( output, waiter->o_client_msgid,
+                     response_tag, response, controls ) ) {
+            checked_unlock( &client->c_io_mutex );
+            clients[--failed] = client;
+            continue;
+        }
+        checked_unlock( &client->c_io_mutex );
+
+        clients[n++] = client;
+    }
+
+    if ( final ) {
+        shared = flight->lf_nwaiters;
+        while ( (waiter = LDAP_TAILQ_FIRST( &flight->lf_waiters )) ) {
+            LDAP_TAILQ_REMOVE( &flight->lf_waiters, waiter, o_flight_next );
+            LDAP_TAILQ_INSERT_TAIL( &done, waiter, o_flight_next );
+            waiter->o_flight = NULL;
+        }
+        flight->lf_nwaiters = 0;
+        op->o_flight = NULL;
+    }
+    checked_unlock( &flights_mutex );
+
+    for ( i = 0; i < n; i++ ) {
+        connection_write_cb( -1, 0, clients[i] );
+        RELEASE_REF( clients[i], c_refcnt, clients[i]->c_destroy );
+    }
+    /* They would miss this response, there is no way to tell them */
+    for ( i = failed; i < nclients; i++ ) {
+        Debug( LDAP_DEBUG_ANY, "lload_coalesce_response: "
+                "failed to queue a shared response for connid=%lu, "
+                "closing\n",
+                clients[i]->c_connid );
+        CONNECTION_LOCK_DESTROY(clients[i]);
+        RELEASE_REF( clients[i], c_refcnt, clients[i]->c_destroy );
+    }
+    ch_free( clients );
+
+    if ( !final ) {
+        return;
+    }
+
+    if ( shared ) {
+        Debug( LDAP_DEBUG_STATS, "lload_coalesce_response: "
+                "connid=%lu msgid=%d result shared with %d other operations\n",
+                op->o_client_connid, op->o_client_msgid, shared );
+    }
+
+    while ( (waiter = LDAP_TAILQ_FIRST( &done )) ) {
+        LDAP_TAILQ_REMOVE( &done, waiter, o_flight_next );
+        waiter->o_res = LLOAD_OP_COMPLETED;
+        OPERATION_UNLINK(waiter);
+    }
+    flight_free( flight );
+}
+
+/*
+ * The operation is going away, if it was waiting on a flight, leave it. If
+ * it was leading one, the waiters will not get their answer from it.
+ */
+void
+lload_coalesce_detach( LloadOperation *op )
+{
+    LloadFlight *flight;
+    LloadOperation *waiter;
+    LDAP_TAILQ_HEAD(lload_orphan_q, LloadOperation) orphans =
+            LDAP_TAILQ_HEAD_INITIALIZER(orphans);
+
+    if ( !__atomic_load_n( &op->o_flight, __ATOMIC_ACQUIRE ) ) {
+        return;
+    }
+
+    checked_lock( &flights_mutex );
+    flight = op->o_flight;
+    if ( !flight ) {
+        checked_unlock( &flights_mutex );
+        return;
+    }
+    op->o_flight = NULL;
+
+    if ( flight->lf_leader != op ) {
+        LDAP_TAILQ_REMOVE( &flight->lf_waiters, op, o_flight_next );
+        flight->lf_nwaiters--;
+        checked_unlock( &flights_mutex );
+        return;
+    }
+
+    flight_unlist( flight );
+    while ( (waiter = LDAP_TAILQ_FIRST( &flight->lf_waiters )) ) {
+        LDAP_TAILQ_REMOVE( &flight->lf_waiters, waiter, o_flight_next );
+        LDAP_TAILQ_INSERT_TAIL( &orphans, waiter, o_flight_next );
+        waiter->o_flight = NULL;
+    }
+    flight->lf_nwaiters = 0;
+    checked_unlock( &flights_mutex );
+
+    flight_free( flight );
+
+    while ( (waiter = LDAP_TAILQ_FIRST( &orphans )) ) {
+        LDAP_TAILQ_REMOVE( &orphans, waiter, o_flight_next );
+        operation_send_reject( waiter, LDAP_OTHER,
+                "identical operation being waited on did not complete", 0 );
+    }
+}
+
+void
+lload_cache_init( void )
+{
+    ldap_pvt_thread_mutex_init( &search_cache.cache_mutex );
+    ldap_pvt_thread_mutex_init( &bind_cache.cache_mutex );
+    ldap_pvt_thread_mutex_init( &flights_mutex );
+}
+
+void
+lload_cache_destroy( void )
+{
+    lload_cache_flush();
+    ldap_pvt_thread_mutex_destroy( &search_cache.cache_mutex );
+    ldap_pvt_thread_mutex_destroy( &bind_cache.cache_mutex );
+    ldap_pvt_thread_mutex_destroy( &flights_mutex );
+}
@@ -51,7 +51,7 @@ request_abandon( LloadConnection *c, LloadOperation *op )
     }
 
     CONNECTION_LOCK(c);
-    request = ldap_tavl_find( c->c_ops, &needle, operation_client_cmp );
+    request = operation_table_find( &c->c_ops, &needle );
     if ( !request ) {
         Debug( LDAP_DEBUG_STATS, "request_abandon: "
                 "connid=%lu msgid=%d requests abandon of an operation "
@@ -177,6 +177,11 @@ request_process( LloadConnection *client, LloadOperation *op )
     }
     CONNECTION_UNLOCK(client);
 
+    if ( lload_cache_lookup( client, op ) ) {
+        return rc;
+    }
+    lload_cache_invalidate( op );
+
     if ( upstream ) {
         b = upstream->c_backend;
         checked_lock( &b->b_mutex );
@@ -256,8 +261,8 @@ request_process( LloadConnection *client, LloadOperation *op )
     }
 
     op->o_upstream_msgid = msgid = upstream->c_next_msgid++;
-    rc = ldap_tavl_insert(
-            &upstream->c_ops, op, operation_upstream_cmp, ldap_avl_dup_error );
+    gettimeofday( &op->o_forwarded, NULL );
+    rc = operation_table_insert( &upstream->c_ops, op );
 
     CONNECTION_UNLOCK(upstream);
 
@@ -312,11 +317,14 @@ request_process( LloadConnection *client, LloadOperation *op )
         }
 
         ber_printf( output, /* "{{" */ "}}" );
-    } else {
-        ber_printf( output, "t{titOtO}", LDAP_TAG_MESSAGE,
-                LDAP_TAG_MSGID, msgid,
-                op->o_tag, &op->o_request,
-                LDAP_TAG_CONTROLS, BER_BV_OPTIONAL( &op->o_ctrls ) );
+    } else if ( lload_ber_put_message( output, msgid, op->o_tag,
+                        &op->o_request, &op->o_ctrls ) ) {
+        checked_unlock( &upstream->c_io_mutex );
+
+        Debug( LDAP_DEBUG_ANY, "request_process: "
+                "failed to queue msgid=%d for upstream connid=%lu\n",
+                op->o_upstream_msgid, op->o_upstream_connid );
+        goto fail;
     }
     checked_unlock( &upstream->c_io_mutex );
 
@@ -528,7 +536,7 @@ fail:
             "connid=%lu failed rc=%d\n",
             c->c_connid, rc );
 
-    assert( c->c_ops == NULL );
+    assert( !c->c_ops.ot_count );
     epoch = epoch_join();
     CONNECTION_LOCK_DESTROY(c);
     epoch_leave( epoch );
@@ -552,6 +560,7 @@ client_init(
                     s, &ls->ls_name, peername, flags )) == NULL ) {
         return NULL;
     }
+    operation_table_init( &c->c_ops, 0 );
 
     {
         ber_len_t max = sockbuf_max_incoming_client;
@@ -660,14 +669,13 @@ fail:
 void
 client_reset( LloadConnection *c )
 {
-    TAvlnode *root;
+    LloadOpTable ops;
     long freed = 0, executing;
     LloadConnection *linked_upstream = NULL;
     enum op_restriction restricted = c->c_restricted;
 
     CONNECTION_ASSERT_LOCKED(c);
-    root = c->c_ops;
-    c->c_ops = NULL;
+    operation_table_detach( &c->c_ops, &ops );
     executing = c->c_n_ops_executing;
     c->c_n_ops_executing = 0;
 
@@ -695,8 +703,8 @@ client_reset( LloadConnection *c )
     }
     CONNECTION_UNLOCK(c);
 
-    if ( root ) {
-        freed = ldap_tavl_free( root, (AVL_FREE)operation_abandon );
+    if ( ops.ot_count ) {
+        freed = operation_table_free( &ops, operation_abandon );
         Debug( LDAP_DEBUG_TRACE, "client_reset: "
                 "dropped %ld operations\n",
                 freed );
@@ -780,7 +788,7 @@ client_destroy( LloadConnection *c )
 
     c->c_state = LLOAD_C_INVALID;
 
-    assert( c->c_ops == NULL );
+    assert( !c->c_ops.ot_count );
 
     if ( c->c_read_event ) {
         event_free( c->c_read_event );
@@ -175,6 +175,17 @@ enum {
     CFG_RESTRICT_CONTROL,
     CFG_TIER,
     CFG_WEIGHT,
+    CFG_CACHE_TTL,
+    CFG_CACHE_MAX_ENTRIES,
+    CFG_CACHE_MAX_SIZE,
+    CFG_BIND_CACHE_TTL,
+    CFG_BIND_CACHE_MAX_ENTRIES,
+    CFG_ADAPTIVE_TOLERANCE,
+    CFG_AFFINITY_DEPTH,
+    CFG_AFFINITY_LOAD_FACTOR,
+    CFG_LISTENER_REUSEPORT,
+    CFG_COALESCE_MAX_WAITERS,
+    CFG_COALESCE_TIMEOUT,
 
     CFG_LAST
 };
@@ -686,6 +697,137 @@ static ConfigTable config_back_cf_table[] = {
             "SYNTAX OMsDirectoryString )",
         NULL, NULL
     },
+    { "cache_ttl", "seconds", 2, 2, 0,
+        ARG_MAGIC|ARG_UINT|CFG_CACHE_TTL,
+        &config_generic,
+        "( OLcfgBkAt:13.41 "
+            "NAME 'olcBkLloadCacheTTL' "
+            "DESC 'How long search results are answered from the cache' "
+            "EQUALITY integerMatch "
+            "SYNTAX OMsInteger "
+            "SINGLE-VALUE )",
+        NULL,
+        { .v_uint = 0 }
+    },
+    { "cache_max_entries", "entries", 2, 2, 0,
+        ARG_MAGIC|ARG_UINT|CFG_CACHE_MAX_ENTRIES,
+        &config_generic,
+        "( OLcfgBkAt:13.42 "
+            "NAME 'olcBkLloadCacheMaxEntries' "
+            "DESC 'Maximum number of cached search results' "
+            "EQUALITY integerMatch "
+            "SYNTAX OMsInteger "
+            "SINGLE-VALUE )",
+        NULL,
+        { .v_uint = LLOAD_CACHE_MAX_ENTRIES_DEFAULT }
+    },
+    { "cache_max_size", "bytes", 2, 2, 0,
+        ARG_MAGIC|ARG_BER_LEN_T|CFG_CACHE_MAX_SIZE,
+        &config_generic,
+        "( OLcfgBkAt:13.43 "
+            "NAME 'olcBkLloadCacheMaxSize' "
+            "DESC 'Maximum size of all cached search results' "
+            "EQUALITY integerMatch "
+            "SYNTAX OMsInteger "
+            "SINGLE-VALUE )",
+        NULL,
+        { .v_ber_t = LLOAD_CACHE_MAX_SIZE_DEFAULT }
+    },
+    { "bind_cache_ttl", "seconds", 2, 2, 0,
+        ARG_MAGIC|ARG_UINT|CFG_BIND_CACHE_TTL,
+        &config_generic,
+        "( OLcfgBkAt:13.44 "
+            "NAME 'olcBkLloadBindCacheTTL' "
+            "DESC 'How long simple binds are verified from the cache' "
+            "EQUALITY integerMatch "
+            "SYNTAX OMsInteger "
+            "SINGLE-VALUE )",
+        NULL,
+        { .v_uint = 0 }
+    },
+    { "bind_cache_max_entries", "entries", 2, 2, 0,
+        ARG_MAGIC|ARG_UINT|CFG_BIND_CACHE_MAX_ENTRIES,
+        &config_generic,
+        "( OLcfgBkAt:13.45 "
+            "NAME 'olcBkLloadBindCacheMaxEntries' "
+            "DESC 'Maximum number of cached bind verifications' "
+            "EQUALITY integerMatch "
+            "SYNTAX OMsInteger "
+            "SINGLE-VALUE )",
+        NULL,
+        { .v_uint = LLOAD_CACHE_MAX_ENTRIES_DEFAULT }
+    },
+    { "adaptive_limit_tolerance", "percent", 2, 2, 0,
+        ARG_MAGIC|ARG_UINT|CFG_ADAPTIVE_TOLERANCE,
+        &config_generic,
+        "( OLcfgBkAt:13.46 "
+            "NAME 'olcBkLloadAdaptiveLimitTolerance' "
+            "DESC 'How much backend latency may grow before its concurrency limit is reduced' "
+            "EQUALITY integerMatch "
+            "SYNTAX OMsInteger "
+            "SINGLE-VALUE )",
+        NULL,
+        { .v_uint = 0 }
+    },
+    { "affinity_depth", "rdns", 2, 2, 0,
+        ARG_MAGIC|ARG_UINT|CFG_AFFINITY_DEPTH,
+        &config_generic,
+        "( OLcfgBkAt:13.47 "
+            "NAME 'olcBkLloadAffinityDepth' "
+            "DESC 'Number of RDNs from the root that affinity tiers route by, 0 for the whole DN' "
+            "EQUALITY integerMatch "
+            "SYNTAX OMsInteger "
+            "SINGLE-VALUE )",
+        NULL,
+        { .v_uint = 0 }
+    },
+    { "affinity_load_factor", "percent", 2, 2, 0,
+        ARG_MAGIC|ARG_UINT|CFG_AFFINITY_LOAD_FACTOR,
+        &config_generic,
+        "( OLcfgBkAt:13.48 "
+            "NAME 'olcBkLloadAffinityLoadFactor' "
+            "DESC 'How far above average load a backend in an affinity tier may go' "
+            "EQUALITY integerMatch "
+            "SYNTAX OMsInteger "
+            "SINGLE-VALUE )",
+        NULL,
+        { .v_uint = LLOAD_AFFINITY_LOAD_FACTOR_DEFAULT }
+    },
+    { "listener_reuseport", "on|off", 2, 2, 0,
+        ARG_ON_OFF|ARG_MAGIC|CFG_LISTENER_REUSEPORT,
+        &config_generic,
+        "( OLcfgBkAt:13.49 "
+            "NAME 'olcBkLloadListenerReusePort' "
+            "DESC 'Give each I/O thread its own listening socket' "
+            "EQUALITY booleanMatch "
+            "SYNTAX OMsBoolean "
+            "SINGLE-VALUE )",
+        NULL, NULL
+    },
+    { "coalesce_max_waiters", "operations", 2, 2, 0,
+        ARG_MAGIC|ARG_UINT|CFG_COALESCE_MAX_WAITERS,
+        &config_generic,
+        "( OLcfgBkAt:13.50 "
+            "NAME 'olcBkLloadCoalesceMaxWaiters' "
+            "DESC 'How many identical searches may wait on one in progress, 0 to disable' "
+            "EQUALITY integerMatch "
+            "SYNTAX OMsInteger "
+            "SINGLE-VALUE )",
+        NULL,
+        { .v_uint = 0 }
+    },
+    { "coalesce_timeout", "milliseconds", 2, 2, 0,
+        ARG_MAGIC|ARG_UINT|CFG_COALESCE_TIMEOUT,
+        &config_generic,
+        "( OLcfgBkAt:13.51 "
+            "NAME 'olcBkLloadCoalesceTimeout' "
+            "DESC 'How long after a search was sent identical ones may still wait on it' "
+            "EQUALITY integerMatch "
+            "SYNTAX OMsInteger "
+            "SINGLE-VALUE )",
+        NULL,
+        { .v_uint = LLOAD_COALESCE_TIMEOUT_DEFAULT }
+    },
 
     /* cn=config only options */
 #ifdef BALANCER_MODULE
@@ -823,6 +965,17 @@ static ConfigOCs lloadocs[] = {
             "$ olcBkLloadWriteCoherence "
             "$ olcBkLloadRestrictExop "
             "$ olcBkLloadRestrictControl "
+            "$ olcBkLloadCacheTTL "
+            "$ olcBkLloadCacheMaxEntries "
+            "$ olcBkLloadCacheMaxSize "
+            "$ olcBkLloadBindCacheTTL "
+            "$ olcBkLloadBindCacheMaxEntries "
+            "$ olcBkLloadAdaptiveLimitTolerance "
+            "$ olcBkLloadAffinityDepth "
+            "$ olcBkLloadAffinityLoadFactor "
+            "$ olcBkLloadListenerReusePort "
+            "$ olcBkLloadCoalesceMaxWaiters "
+            "$ olcBkLloadCoalesceTimeout "
             "$ olcBkLloadListen "
         ") )",
         Cft_Backend, config_back_cf_table,
@@ -904,6 +1057,39 @@ config_generic( ConfigArgs *c )
             case CFG_CLIENT_PENDING:
                 c->value_uint = lload_client_max_pending;
                 break;
+            case CFG_CACHE_TTL:
+                c->value_uint = lload_cache_ttl;
+                break;
+            case CFG_CACHE_MAX_ENTRIES:
+                c->value_uint = lload_cache_max_entries;
+                break;
+            case CFG_CACHE_MAX_SIZE:
+                c->value_ber_t = lload_cache_max_size;
+                break;
+            case CFG_BIND_CACHE_TTL:
+                c->value_uint = lload_bind_cache_ttl;
+                break;
+            case CFG_BIND_CACHE_MAX_ENTRIES:
+                c->value_uint = lload_bind_cache_max_entries;
+                break;
+            case CFG_ADAPTIVE_TOLERANCE:
+                c->value_uint = lload_adaptive_tolerance;
+                break;
+            case CFG_AFFINITY_DEPTH:
+                c->value_uint = lload_affinity_depth;
+                break;
+            case CFG_AFFINITY_LOAD_FACTOR:
+                c->value_uint = lload_affinity_load_factor;
+                break;
+            case CFG_LISTENER_REUSEPORT:
+                c->value_int = lload_listener_reuseport;
+                break;
+            case CFG_COALESCE_MAX_WAITERS:
+                c->value_uint = lload_coalesce_max_waiters;
+                break;
+            case CFG_COALESCE_TIMEOUT:
+                c->value_uint = lload_coalesce_timeout;
+                break;
             default:
                 rc = 1;
                 break;
@@ -950,6 +1136,41 @@ config_generic( ConfigArgs *c )
                     ll[i]->sl_removed = 1;
                 }
             } break;
+            case CFG_CACHE_TTL:
+                lload_cache_ttl = 0;
+                lload_cache_flush();
+                break;
+            case CFG_CACHE_MAX_ENTRIES:
+                lload_cache_max_entries = LLOAD_CACHE_MAX_ENTRIES_DEFAULT;
+                break;
+            case CFG_CACHE_MAX_SIZE:
+                lload_cache_max_size = LLOAD_CACHE_MAX_SIZE_DEFAULT;
+                break;
+            case CFG_BIND_CACHE_TTL:
+                lload_bind_cache_ttl = 0;
+                lload_cache_flush();
+                break;
+            case CFG_BIND_CACHE_MAX_ENTRIES:
+                lload_bind_cache_max_entries = LLOAD_CACHE_MAX_ENTRIES_DEFAULT;
+                break;
+            case CFG_ADAPTIVE_TOLERANCE:
+                lload_adaptive_tolerance = 0;
+                break;
+            case CFG_AFFINITY_DEPTH:
+                lload_affinity_depth = 0;
+                break;
+            case CFG_AFFINITY_LOAD_FACTOR:
+                lload_affinity_load_factor = LLOAD_AFFINITY_LOAD_FACTOR_DEFAULT;
+                break;
+            case CFG_LISTENER_REUSEPORT:
+                lload_listener_reuseport = 0;
+                break;
+            case CFG_COALESCE_MAX_WAITERS:
+                lload_coalesce_max_waiters = 0;
+                break;
+            case CFG_COALESCE_TIMEOUT:
+                lload_coalesce_timeout = LLOAD_COALESCE_TIMEOUT_DEFAULT;
+                break;
             default:
                 break;
         }
@@ -1100,6 +1321,58 @@ config_generic( ConfigArgs *c )
         case CFG_CLIENT_PENDING:
             lload_client_max_pending = c->value_uint;
             break;
+        case CFG_CACHE_TTL:
+            lload_cache_ttl = c->value_uint;
+            /* Forget anything stored under the old settings */
+            lload_cache_flush();
+            break;
+        case CFG_CACHE_MAX_ENTRIES:
+            lload_cache_max_entries = c->value_uint;
+            lload_cache_flush();
+            break;
+        case CFG_CACHE_MAX_SIZE:
+            lload_cache_max_size = c->value_ber_t;
+            lload_cache_flush();
+            break;
+        case CFG_BIND_CACHE_TTL:
+            lload_bind_cache_ttl = c->value_uint;
+            lload_cache_flush();
+            break;
+        case CFG_BIND_CACHE_MAX_ENTRIES:
+            lload_bind_cache_max_entries = c->value_uint;
+            lload_cache_flush();
+            break;
+        case CFG_ADAPTIVE_TOLERANCE:
+            lload_adaptive_tolerance = c->value_uint;
+            break;
+        case CFG_AFFINITY_DEPTH:
+            lload_affinity_depth = c->value_uint;
+            break;
+        case CFG_AFFINITY_LOAD_FACTOR:
+            lload_affinity_load_factor = c->value_uint;
+            break;
+        case CFG_LISTENER_REUSEPORT:
+#ifndef SO_REUSEPORT
+            if ( c->value_int ) {
+                snprintf( c->cr_msg, sizeof(c->cr_msg),
+                        "SO_REUSEPORT not supported on this platform" );
+                goto fail;
+            }
+#endif /* ! SO_REUSEPORT */
+            if ( lloadd_inited ) {
+                snprintf( c->cr_msg, sizeof(c->cr_msg),
+                        "listener_reuseport changes only apply to listeners "
+                        "opened from now on" );
+                Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg );
+            }
+            lload_listener_reuseport = c->value_int;
+            break;
+        case CFG_COALESCE_MAX_WAITERS:
+            lload_coalesce_max_waiters = c->value_uint;
+            break;
+        case CFG_COALESCE_TIMEOUT:
+            lload_coalesce_timeout = c->value_uint;
+            break;
         default:
             Debug( LDAP_DEBUG_ANY, "%s: unknown CFG_TYPE %d\n",
                     c->log, c->type );
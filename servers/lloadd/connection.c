@@ -381,6 +381,53 @@ done:
     }
 }
 
+/*
+ * Append an LDAPMessage to output, the protocolOp contents and the controls
+ * (if any) are already encoded and are copied over as they are. Every length
+ * is known upfront so nothing is reserved to be patched up later.
+ *
+ * Returns -1 if the buffer could not be grown, output is then left as it was
+ * so that the messages already queued in it can still be sent.
+ */
+int
+lload_ber_put_message(
+        BerElement *output,
+        ber_int_t msgid,
+        ber_tag_t tag,
+        struct berval *pdu,
+        struct berval *controls )
+{
+    ber_len_t len, start;
+
+    ber_get_option( output, LBER_OPT_BER_BYTES_TO_WRITE, &start );
+
+    len = ber_calc_int_len( msgid, LDAP_TAG_MSGID ) +
+            ber_calc_len( tag, pdu->bv_len );
+    if ( !BER_BVISNULL( controls ) ) {
+        len += ber_calc_len( LDAP_TAG_CONTROLS, controls->bv_len );
+    }
+
+    if ( ber_put_header( output, LDAP_TAG_MESSAGE, len ) < 0 ||
+            ber_put_int( output, msgid, LDAP_TAG_MSGID ) < 0 ||
+            ber_put_header( output, tag, pdu->bv_len ) < 0 ||
+            ber_write( output, pdu->bv_val, pdu->bv_len, 0 ) < 0 ) {
+        goto fail;
+    }
+
+    if ( !BER_BVISNULL( controls ) &&
+            ( ber_put_header( output, LDAP_TAG_CONTROLS, controls->bv_len ) <
+                            0 ||
+                    ber_write( output, controls->bv_val, controls->bv_len,
+                            0 ) < 0 ) ) {
+        goto fail;
+    }
+    return 0;
+
+fail:
+    ber_set_option( output, LBER_OPT_BER_BYTES_TO_WRITE, &start );
+    return -1;
+}
+
 void
 connection_destroy( LloadConnection *c )
 {
@@ -405,6 +452,8 @@ connection_destroy( LloadConnection *c )
         c->c_pendingber = NULL;
     }
 
+    operation_table_destroy( &c->c_ops );
+
     if ( !BER_BVISNULL( &c->c_sasl_bind_mech ) ) {
         ber_memfree( c->c_sasl_bind_mech.bv_val );
         BER_BVZERO( &c->c_sasl_bind_mech );
@@ -558,7 +607,7 @@ lload_connection_close( LloadConnection *c, void *arg )
     if ( unlock )
         checked_unlock( &c->c_io_mutex );
 
-    if ( !gentle || !c->c_ops ) {
+    if ( !gentle || !c->c_ops.ot_count ) {
         CONNECTION_DESTROY(c);
         return LDAP_SUCCESS;
     }
@@ -567,19 +616,21 @@ lload_connection_close( LloadConnection *c, void *arg )
     c->c_state = LLOAD_C_CLOSING;
 
     do {
-        TAvlnode *node = ldap_tavl_end( c->c_ops, TAVL_DIR_LEFT );
-        op = node->avl_data;
+        unsigned int cursor = 0;
 
         /* Close operations that would need client action to resolve,
          * only SASL binds in progress do that right now */
-        if ( op->o_client_msgid || op->o_upstream_msgid ) {
+        while ( (op = operation_table_next( &c->c_ops, &cursor )) &&
+                op->o_client_msgid )
+            /* skip */;
+        if ( !op || op->o_upstream_msgid ) {
             break;
         }
 
         CONNECTION_UNLOCK(c);
         OPERATION_UNLINK(op);
         CONNECTION_LOCK(c);
-    } while ( c->c_ops );
+    } while ( c->c_ops.ot_count );
 
     CONNECTION_UNLOCK(c);
     return LDAP_SUCCESS;
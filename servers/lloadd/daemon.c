@@ -86,6 +86,7 @@ ldap_pvt_thread_cond_t lload_pause_cond;
 #endif
 int lload_daemon_threads = 1;
 int lload_daemon_mask;
+int lload_listener_reuseport = 0;
 
 /*
  * We might be a module, so concerns about listeners are different from slapd,
@@ -658,6 +659,30 @@ listener_error_cb( struct evconnlistener *lev, void *arg )
                 "too many open files, cannot accept new connections on "
                 "url=%s\n",
                 ls->ls_lr->sl_url.bv_val );
+    } else if ( ls->base != listener_base ) {
+        LloadListenerSocket **prev;
+        char ebuf[128];
+        /*
+         * Only this socket is affected, the I/O thread has to keep going.
+         * Close it rather than just stop accepting, or the kernel would
+         * keep handing it a share of new connections.
+         */
+        Debug( LDAP_DEBUG_ANY, "listener_error_cb: "
+                "received an error on a listener, closing it: '%s'\n",
+                sock_errstr( err, ebuf, sizeof(ebuf) ) );
+
+        ldap_pvt_thread_mutex_lock( &lload_daemon[0].sd_mutex );
+        for ( prev = &ls->ls_lr->sl_sockets; *prev != ls;
+                prev = &(*prev)->ls_next )
+            /* find it */;
+        *prev = ls->ls_next;
+        ldap_pvt_thread_mutex_unlock( &lload_daemon[0].sd_mutex );
+
+        /* libevent holds a reference while the callback runs */
+        evconnlistener_free( lev );
+        lloadd_close( ls->ls_sd );
+        ber_memfree( ls->ls_name.bv_val );
+        ch_free( ls );
     } else {
         char ebuf[128];
         Debug( LDAP_DEBUG_ANY, "listener_error_cb: "
@@ -731,6 +756,7 @@ lload_listener(
     LloadListenerSocket *ls = arg;
     LloadListener *l = ls->ls_lr;
     LloadConnection *c;
+    struct event_base *base;
     Sockaddr *from = (Sockaddr *)a;
     char peername[LDAP_IPADDRLEN];
     struct berval peerbv = BER_BVC(peername);
@@ -818,7 +844,10 @@ lload_listener(
 #ifdef HAVE_TLS
     if ( l->sl_is_tls ) cflag |= CONN_IS_TLS;
 #endif
-    c = client_init( s, ls, &peerbv, lload_daemon[tid].base, cflag );
+    /* A per-thread listener hands out connections to its own I/O thread */
+    base = ( ls->base == listener_base ) ? lload_daemon[tid].base : ls->base;
+
+    c = client_init( s, ls, &peerbv, base, cflag );
 
     if ( !c ) {
         Debug( LDAP_DEBUG_ANY, "lload_listener: "
@@ -830,6 +859,111 @@ lload_listener(
     return;
 }
 
+#ifdef SO_REUSEPORT
+/*
+ * Give each I/O thread a socket of its own bound to the same address, the
+ * kernel then spreads new connections between them and accepting (and the
+ * TLS handshake that follows) no longer funnels through the listener thread.
+ * The original socket has already been bound, it goes to the first thread
+ * once at least one more socket could join it, the others are inserted right
+ * after it so lload_sockets_activate() sets them up in turn.
+ *
+ * The kernel only lets sockets created by the same user share the port, so
+ * this fails if privileges have been dropped since the original socket was
+ * created (-u), the listener thread keeps accepting for everyone then.
+ */
+static void
+lload_sockets_reuseport( LloadListenerSocket *ls )
+{
+    LloadListenerSocket *prev = ls;
+    struct sockaddr *sa = (struct sockaddr *)&ls->ls_sa;
+    socklen_t addrlen;
+    char ebuf[128];
+    int i, rc, tmp = 1;
+
+    switch ( sa->sa_family ) {
+        case AF_INET:
+            addrlen = sizeof(struct sockaddr_in);
+            break;
+#ifdef LDAP_PF_INET6
+        case AF_INET6:
+            addrlen = sizeof(struct sockaddr_in6);
+            break;
+#endif /* LDAP_PF_INET6 */
+        default:
+            return;
+    }
+
+    rc = setsockopt( ls->ls_sd, SOL_SOCKET, SO_REUSEPORT, (char *)&tmp,
+            sizeof(tmp) );
+    if ( rc == AC_SOCKET_ERROR ) {
+        int err = sock_errno();
+        Debug( LDAP_DEBUG_ANY, "lload_sockets_reuseport(%ld): "
+                "setsockopt(SO_REUSEPORT) failed errno=%d (%s)\n",
+                (long)ls->ls_sd, err, sock_errstr( err, ebuf, sizeof(ebuf) ) );
+        return;
+    }
+
+    for ( i = 1; i < lload_daemon_threads; i++ ) {
+        LloadListenerSocket *clone;
+        ber_socket_t s;
+
+        s = socket( sa->sa_family, SOCK_STREAM, 0 );
+        if ( s == AC_SOCKET_INVALID ) {
+            int err = sock_errno();
+            Debug( LDAP_DEBUG_ANY, "lload_sockets_reuseport: "
+                    "socket() failed errno=%d (%s)\n",
+                    err, sock_errstr( err, ebuf, sizeof(ebuf) ) );
+            break;
+        }
+        ber_pvt_socket_set_nonblock( s, 1 );
+
+#ifdef SO_REUSEADDR
+        setsockopt( s, SOL_SOCKET, SO_REUSEADDR, (char *)&tmp, sizeof(tmp) );
+#endif /* SO_REUSEADDR */
+        setsockopt( s, SOL_SOCKET, SO_REUSEPORT, (char *)&tmp, sizeof(tmp) );
+#if defined(LDAP_PF_INET6) && defined(IPV6_V6ONLY)
+        if ( sa->sa_family == AF_INET6 ) {
+            setsockopt( s, IPPROTO_IPV6, IPV6_V6ONLY, (char *)&tmp,
+                    sizeof(tmp) );
+        }
+#endif /* LDAP_PF_INET6 && IPV6_V6ONLY */
+
+        if ( bind( s, sa, addrlen ) ) {
+            int err = sock_errno();
+            Debug( LDAP_DEBUG_ANY, "lload_sockets_reuseport: "
+                    "bind(%s) for I/O thread %d failed errno=%d (%s), "
+                    "it and later threads will not accept connections of "
+                    "their own\n",
+                    ls->ls_name.bv_val, i, err,
+                    sock_errstr( err, ebuf, sizeof(ebuf) ) );
+            tcp_close( s );
+            break;
+        }
+
+        clone = ch_calloc( 1, sizeof(LloadListenerSocket) );
+        clone->ls_lr = ls->ls_lr;
+        ber_dupbv( &clone->ls_name, &ls->ls_name );
+        clone->ls_sa = ls->ls_sa;
+        clone->ls_sd = s;
+        clone->base = lload_daemon[i].base;
+
+        clone->ls_next = prev->ls_next;
+        prev->ls_next = clone;
+        prev = clone;
+    }
+
+    if ( prev != ls ) {
+        ls->base = lload_daemon[0].base;
+    } else {
+        Debug( LDAP_DEBUG_ANY, "lload_sockets_reuseport: "
+                "no I/O thread got a socket of its own for %s, "
+                "connections will be accepted by the listener thread\n",
+                ls->ls_name.bv_val );
+    }
+}
+#endif /* SO_REUSEPORT */
+
 static int
 lload_sockets_activate( LloadListener *l )
 {
@@ -839,6 +973,12 @@ lload_sockets_activate( LloadListener *l )
     int rc;
 
     for ( ls = l->sl_sockets; ls; ls = ls->ls_next ) {
+#ifdef SO_REUSEPORT
+        if ( lload_listener_reuseport && lload_daemon_threads > 1 &&
+                !ls->base ) {
+            lload_sockets_reuseport( ls );
+        }
+#endif /* SO_REUSEPORT */
 #ifdef LDAP_TCP_BUFFER
         /* FIXME: TCP-only! */
         int origsize, size, realsize;
@@ -939,7 +1079,8 @@ lload_sockets_activate( LloadListener *l )
         }
 #endif /* LDAP_TCP_BUFFER */
 
-        listener = evconnlistener_new( listener_base, lload_listener, ls,
+        listener = evconnlistener_new( ls->base ? ls->base : listener_base,
+                lload_listener, ls,
                 LEV_OPT_THREADSAFE|LEV_OPT_DEFERRED_ACCEPT,
                 SLAPD_LISTEN_BACKLOG, ls->ls_sd );
         if ( !listener ) {
@@ -995,7 +1136,9 @@ lload_sockets_activate( LloadListener *l )
         }
 
         evconnlistener_set_error_cb( listener, listener_error_cb );
-        ls->base = listener_base;
+        if ( !ls->base ) {
+            ls->base = listener_base;
+        }
         ls->listener = listener;
     }
 
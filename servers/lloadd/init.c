@@ -99,6 +99,8 @@ lload_global_init( void )
     ldap_pvt_thread_mutex_init( &clients_mutex );
     ldap_pvt_thread_mutex_init( &lload_pin_mutex );
 
+    lload_cache_init();
+
     if ( lload_exop_init() ) {
         return -1;
     }
@@ -136,6 +138,8 @@ lload_global_destroy( void )
     ldap_pvt_thread_mutex_destroy( &clients_mutex );
     ldap_pvt_thread_mutex_destroy( &lload_pin_mutex );
 
+    lload_cache_destroy();
+
     lload_libevent_destroy();
 
     return 0;
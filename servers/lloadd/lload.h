@@ -82,6 +82,14 @@ LDAP_BEGIN_DECL
 
 #define LLOAD_CONN_MAX_PDUS_PER_CYCLE_DEFAULT 10
 
+#define LLOAD_CACHE_MAX_ENTRIES_DEFAULT 1000
+#define LLOAD_CACHE_MAX_SIZE_DEFAULT ( 1 << 24 )
+#define LLOAD_COALESCE_TIMEOUT_DEFAULT 1000
+
+#define LLOAD_ADAPTIVE_LIMIT_INITIAL 100
+
+#define LLOAD_AFFINITY_LOAD_FACTOR_DEFAULT 25
+
 #define BER_BV_OPTIONAL( bv ) ( BER_BVISNULL( bv ) ? NULL : ( bv ) )
 
 #include <epoch.h>
@@ -99,10 +107,13 @@ LDAP_BEGIN_DECL
 #endif
 
 typedef struct LloadTier LloadTier;
+typedef struct LloadBackendSet LloadBackendSet;
 typedef struct LloadBackend LloadBackend;
 typedef struct LloadPendingConnection LloadPendingConnection;
 typedef struct LloadConnection LloadConnection;
 typedef struct LloadOperation LloadOperation;
+typedef struct LloadCacheEntry LloadCacheEntry;
+typedef struct LloadFlight LloadFlight;
 typedef struct LloadChange LloadChange;
 typedef struct LloadListenerSocket LloadListenerSocket;
 typedef struct LloadListener LloadListener;
@@ -111,6 +122,7 @@ typedef struct LloadListener LloadListener;
 typedef LDAP_STAILQ_HEAD(TierSt, LloadTier) lload_t_head;
 typedef LDAP_CIRCLEQ_HEAD(BeSt, LloadBackend) lload_b_head;
 typedef LDAP_CIRCLEQ_HEAD(ConnSt, LloadConnection) lload_c_head;
+typedef LDAP_TAILQ_HEAD(OpSt, LloadOperation) lload_o_head;
 
 LDAP_SLAPD_V (lload_t_head) tiers;
 LDAP_SLAPD_V (lload_c_head) clients;
@@ -227,6 +239,37 @@ enum {
     LLOAD_STATS_OPS_LAST
 };
 
+/*
+ * Log-linear latency histogram in microseconds. Values up to
+ * 2^(LLOAD_HISTOGRAM_SUB_BITS+1) get a bucket each, each power of two above
+ * that is split into 2^LLOAD_HISTOGRAM_SUB_BITS buckets. Anything from 2^32
+ * microseconds (over an hour) up lands in the last bucket.
+ */
+#define LLOAD_HISTOGRAM_SUB_BITS 2
+#define LLOAD_HISTOGRAM_BUCKETS \
+    ( ( 33 - LLOAD_HISTOGRAM_SUB_BITS ) << LLOAD_HISTOGRAM_SUB_BITS )
+
+typedef struct lload_histogram_t {
+    uintptr_t lh_count;
+    uintptr_t lh_buckets[LLOAD_HISTOGRAM_BUCKETS];
+} lload_histogram_t;
+
+enum {
+    LLOAD_LATENCY_BIND = 0,
+    LLOAD_LATENCY_SEARCH,
+    LLOAD_LATENCY_COMPARE,
+    LLOAD_LATENCY_WRITE,
+    LLOAD_LATENCY_EXTENDED,
+    LLOAD_LATENCY_LAST
+};
+
+typedef struct lload_latency_t {
+    /* From receiving the request to forwarding it */
+    lload_histogram_t ll_queue[LLOAD_LATENCY_LAST];
+    /* From forwarding the request to the final response */
+    lload_histogram_t ll_upstream[LLOAD_LATENCY_LAST];
+} lload_latency_t;
+
 typedef struct lload_global_stats_t {
     ldap_pvt_mp_t global_incoming;
     ldap_pvt_mp_t global_outgoing;
@@ -266,6 +309,16 @@ struct lload_tier_type {
     LloadTierSelect *tier_select;
 };
 
+/*
+ * Immutable snapshot of a tier's backends so tier_select can pick one without
+ * walking t_backends. Republished whenever the list changes, the old one is
+ * freed through epoch_append() so callers have to be inside an epoch.
+ */
+struct LloadBackendSet {
+    int bs_nbackends;
+    LloadBackend **bs_backends;
+};
+
 struct LloadTier {
     struct lload_tier_type t_type;
     ldap_pvt_thread_mutex_t t_mutex;
@@ -273,6 +326,9 @@ struct LloadTier {
     lload_b_head t_backends;
     int t_nbackends;
 
+    LloadBackendSet *t_backend_set;
+    uintptr_t t_rotate; /* Round-robin position in t_backend_set */
+
     enum {
         LLOAD_TIER_EXCLUSIVE = 1 << 0, /* Reject if busy */
     } t_flags;
@@ -286,6 +342,20 @@ struct LloadTier {
     LDAP_STAILQ_ENTRY(LloadTier) t_next;
 };
 
+/*
+ * Operations pending on a connection, keyed by the msgid on that side of the
+ * operation or the pin if that is 0. Open addressing with linear probing, so
+ * there are no per-operation allocations. Upstream tables also keep their
+ * operations in the order they were sent (ot_sent) for connection_timeout.
+ */
+typedef struct LloadOpTable {
+    LloadOperation **ot_slots;
+    unsigned int ot_bits; /* log2 of the number of slots, 0 if unallocated */
+    unsigned int ot_count;
+    int ot_upstream;
+    lload_o_head ot_sent;
+} LloadOpTable;
+
 /* Can hold mutex when locking a linked connection */
 struct LloadBackend {
     ldap_pvt_thread_mutex_t b_mutex;
@@ -308,7 +378,13 @@ struct LloadBackend {
     long b_max_pending, b_max_conn_pending;
     long b_n_ops_executing;
 
+    /* Adaptive concurrency limit, see backend_update_limit() */
+    long b_limit, b_limit_peak;
+    uintptr_t b_min_rtt;
+    uintptr_t b_rtt_count, b_rtt_time;
+
     lload_counters_t b_counters[LLOAD_STATS_OPS_LAST];
+    lload_latency_t b_latency;
 
     LloadTier *b_tier;
 
@@ -481,7 +557,7 @@ struct LloadConnection {
     BerElement *c_currentber; /* ber we're attempting to read */
     BerElement *c_pendingber; /* ber we're attempting to write */
 
-    TAvlnode *c_ops; /* Operations pending on the connection */
+    LloadOpTable c_ops; /* Operations pending on the connection */
 
 #ifdef HAVE_TLS
     enum lload_tls_type c_is_tls; /* true if this LDAP over raw TLS */
@@ -551,17 +627,25 @@ struct LloadOperation {
     unsigned long o_upstream_connid;
     ber_int_t o_upstream_msgid;
     struct timeval o_last_response;
+    LDAP_TAILQ_ENTRY(LloadOperation) o_sent_next; /* o_upstream's ot_sent */
 
     /* Protects o_client, o_upstream links */
     ldap_pvt_thread_mutex_t o_link_mutex;
 
     ber_tag_t o_tag;
-    struct timeval o_start;
+    struct timeval o_start, o_forwarded;
     unsigned long o_pin_id;
 
     enum op_result o_res;
     BerElement *o_ber;
     BerValue o_request, o_ctrls;
+
+    /* Responses recorded for the search cache, if eligible */
+    LloadCacheEntry *o_cache;
+
+    /* Identical operation in progress we lead or wait on */
+    LloadFlight *o_flight;
+    LDAP_TAILQ_ENTRY(LloadOperation) o_flight_next;
 };
 
 struct restriction_entry {
@@ -76,6 +76,7 @@ static ObjectClass *oc_olmBalancer;
 static ObjectClass *oc_olmBalancerServer;
 static ObjectClass *oc_olmBalancerConnection;
 static ObjectClass *oc_olmBalancerOperation;
+static ObjectClass *oc_olmBalancerLatency;
 
 static ObjectClass *oc_monitorContainer;
 static ObjectClass *oc_monitorCounterObject;
@@ -96,6 +97,9 @@ static AttributeDescription *ad_olmPendingConnections;
 static AttributeDescription *ad_olmActiveConnections;
 static AttributeDescription *ad_olmIncomingConnections;
 static AttributeDescription *ad_olmOutgoingConnections;
+static AttributeDescription *ad_olmConcurrencyLimit;
+static AttributeDescription *ad_olmQueueLatency;
+static AttributeDescription *ad_olmUpstreamLatency;
 
 monitor_subsys_t *lload_monitor_client_subsys;
 
@@ -233,6 +237,30 @@ static struct {
       "SYNTAX 1.3.6.1.4.1.1466.115.121.1.12 "
       "USAGE dSAOperation )",
         &ad_olmConnectionAuthzDN },
+    { "( olmBalancerAttributes:17 "
+      "NAME ( 'olmConcurrencyLimit' ) "
+      "DESC 'Current limit on pending operations, 0 if unlimited' "
+      "EQUALITY integerMatch "
+      "SYNTAX 1.3.6.1.4.1.1466.115.121.1.27 "
+      "NO-USER-MODIFICATION "
+      "USAGE dSAOperation )",
+        &ad_olmConcurrencyLimit },
+    { "( olmBalancerAttributes:18 "
+      "NAME ( 'olmQueueLatency' ) "
+      "DESC 'Time from receiving operations to forwarding them, per type' "
+      "EQUALITY caseIgnoreMatch "
+      "SYNTAX 1.3.6.1.4.1.1466.115.121.1.15 "
+      "NO-USER-MODIFICATION "
+      "USAGE dSAOperation )",
+        &ad_olmQueueLatency },
+    { "( olmBalancerAttributes:19 "
+      "NAME ( 'olmUpstreamLatency' ) "
+      "DESC 'Time from forwarding operations to their final response, per type' "
+      "EQUALITY caseIgnoreMatch "
+      "SYNTAX 1.3.6.1.4.1.1466.115.121.1.15 "
+      "NO-USER-MODIFICATION "
+      "USAGE dSAOperation )",
+        &ad_olmUpstreamLatency },
 
     { NULL }
 };
@@ -270,6 +298,7 @@ static struct {
       "$ olmReceivedOps "
       "$ olmCompletedOps "
       "$ olmFailedOps "
+      "$ olmConcurrencyLimit "
       ") )",
         &oc_olmBalancerServer },
 
@@ -299,6 +328,14 @@ static struct {
       "$ olmFailedOps "
       ") )",
         &oc_olmBalancerConnection },
+    { "( olmBalancerObjectClasses:5 "
+      "NAME ( 'olmBalancerLatency' ) "
+      "SUP top AUXILIARY "
+      "MAY ( "
+      "olmQueueLatency "
+      "$ olmUpstreamLatency "
+      ") )",
+        &oc_olmBalancerLatency },
     { NULL }
 };
 
@@ -359,6 +396,46 @@ lload_monitor_tier_destroy( BackendDB *be, monitor_subsys_t *ms )
     return ms->mss_destroy( be, ms );
 }
 
+static char *lload_latency_class[] = {
+    "bind",
+    "search",
+    "compare",
+    "write",
+    "extended",
+    NULL
+};
+
+/*
+ * Replace the attribute with one value per operation type that has been
+ * seen, giving the sample count and percentiles in microseconds.
+ */
+static void
+lload_monitor_latency_update(
+        Entry *e,
+        AttributeDescription *ad,
+        lload_histogram_t *h )
+{
+    char buf[256];
+    struct berval bv = { .bv_val = buf };
+    int i;
+
+    attr_delete( &e->e_attrs, ad );
+    for ( i = 0; i < LLOAD_LATENCY_LAST; i++ ) {
+        if ( !h[i].lh_count ) {
+            continue;
+        }
+        bv.bv_len = snprintf( buf, sizeof(buf),
+                "%s count=%lu p50=%lu p90=%lu p99=%lu p999=%lu max=%lu",
+                lload_latency_class[i], (unsigned long)h[i].lh_count,
+                (unsigned long)lload_histogram_value( &h[i], 500 ),
+                (unsigned long)lload_histogram_value( &h[i], 900 ),
+                (unsigned long)lload_histogram_value( &h[i], 990 ),
+                (unsigned long)lload_histogram_value( &h[i], 999 ),
+                (unsigned long)lload_histogram_value( &h[i], 1000 ) );
+        attr_merge_normalize_one( e, ad, &bv, NULL );
+    }
+}
+
 static void
 lload_monitor_balancer_dispose( void **priv )
 {
@@ -371,6 +448,43 @@ lload_monitor_balancer_free( Entry *e, void **priv )
     return LDAP_SUCCESS;
 }
 
+/* Merge the latency histograms of all backends */
+static void
+lload_monitor_latency_merge( Entry *e )
+{
+    lload_latency_t *latency = ch_calloc( 1, sizeof(lload_latency_t) );
+    LloadTier *tier;
+
+    LDAP_STAILQ_FOREACH ( tier, &tiers, t_next ) {
+        LloadBackend *b;
+
+        LDAP_CIRCLEQ_FOREACH ( b, &tier->t_backends, b_next ) {
+            int i, j;
+
+            checked_lock( &b->b_mutex );
+            for ( i = 0; i < LLOAD_LATENCY_LAST; i++ ) {
+                lload_histogram_t *queue = &b->b_latency.ll_queue[i],
+                                  *upstream = &b->b_latency.ll_upstream[i];
+
+                latency->ll_queue[i].lh_count += queue->lh_count;
+                latency->ll_upstream[i].lh_count += upstream->lh_count;
+                for ( j = 0; j < LLOAD_HISTOGRAM_BUCKETS; j++ ) {
+                    latency->ll_queue[i].lh_buckets[j] +=
+                            queue->lh_buckets[j];
+                    latency->ll_upstream[i].lh_buckets[j] +=
+                            upstream->lh_buckets[j];
+                }
+            }
+            checked_unlock( &b->b_mutex );
+        }
+    }
+
+    lload_monitor_latency_update( e, ad_olmQueueLatency, latency->ll_queue );
+    lload_monitor_latency_update(
+            e, ad_olmUpstreamLatency, latency->ll_upstream );
+    ch_free( latency );
+}
+
 static int
 lload_monitor_balancer_update(
         Operation *op,
@@ -389,6 +503,8 @@ lload_monitor_balancer_update(
     assert( a != NULL );
 
     UI2BV( &a->a_vals[0], lload_stats.global_outgoing );
+
+    lload_monitor_latency_merge( e );
     return SLAP_CB_CONTINUE;
 }
 
@@ -469,6 +585,8 @@ lload_monitor_balancer_init( BackendDB *be, monitor_subsys_t *ms )
 
     attr_merge_normalize_one( e, ad_olmIncomingConnections, &value, NULL );
     attr_merge_normalize_one( e, ad_olmOutgoingConnections, &value, NULL );
+    attr_merge_one( e, slap_schema.si_ad_objectClass,
+            &oc_olmBalancerLatency->soc_cname, NULL );
 
     rc = mbe->register_entry( e, cb, ms, 0 );
     if ( rc != LDAP_SUCCESS ) {
@@ -913,6 +1031,15 @@ lload_monitor_server_update(
     assert( a != NULL );
     UI2BV( &a->a_vals[0], (long long unsigned int)b->b_n_ops_executing );
 
+    a = attr_find( e->e_attrs, ad_olmConcurrencyLimit );
+    assert( a != NULL );
+    UI2BV( &a->a_vals[0], (long long unsigned int)( b->b_limit ?
+                    b->b_limit : b->b_max_pending ) );
+
+    lload_monitor_latency_update( e, ad_olmQueueLatency, b->b_latency.ll_queue );
+    lload_monitor_latency_update(
+            e, ad_olmUpstreamLatency, b->b_latency.ll_upstream );
+
     checked_unlock( &b->b_mutex );
 
     /* Right now, there is no way to retrieve the entry from monitor's
@@ -983,6 +1110,9 @@ lload_monitor_backend_open( BackendDB *be, monitor_subsys_t *ms )
     attr_merge_normalize_one( e, ad_olmReceivedOps, &value, NULL );
     attr_merge_normalize_one( e, ad_olmCompletedOps, &value, NULL );
     attr_merge_normalize_one( e, ad_olmFailedOps, &value, NULL );
+    attr_merge_normalize_one( e, ad_olmConcurrencyLimit, &value, NULL );
+    attr_merge_one( e, slap_schema.si_ad_objectClass,
+            &oc_olmBalancerLatency->soc_cname, NULL );
 
     rc = mbe->register_entry( e, cb, ms, 0 );
 
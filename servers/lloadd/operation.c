@@ -95,36 +95,258 @@ lload_restriction_cmp( const void *left, const void *right )
     return ber_bvcmp( &l->oid, &r->oid );
 }
 
-int
-operation_client_cmp( const void *left, const void *right )
+/*
+ * Operation tables
+ *
+ * Message IDs (and pins) are mostly handed out sequentially so we use
+ * Fibonacci hashing which keeps those well spread while not letting a client
+ * pick msgids that all land in the same slot.
+ */
+#define OPERATION_TABLE_MIN_BITS 3
+
+static ber_int_t
+operation_table_msgid( const LloadOpTable *table, const LloadOperation *op )
 {
-    const LloadOperation *l = left, *r = right;
+    return table->ot_upstream ? op->o_upstream_msgid : op->o_client_msgid;
+}
 
-    assert( l->o_client_connid == r->o_client_connid );
-    if ( l->o_client_msgid || r->o_client_msgid ) {
-        return ( l->o_client_msgid < r->o_client_msgid ) ?
-                -1 :
-                ( l->o_client_msgid > r->o_client_msgid );
-    } else {
-        return ( l->o_pin_id < r->o_pin_id ) ? -1 :
-                ( l->o_pin_id > r->o_pin_id );
+static unsigned int
+operation_table_hash(
+        const LloadOpTable *table,
+        const LloadOperation *op,
+        unsigned int bits )
+{
+    ber_int_t msgid = operation_table_msgid( table, op );
+    uint32_t key = msgid ? (uint32_t)msgid : (uint32_t)op->o_pin_id;
+
+    return ( key * 2654435769U ) >> ( 32 - bits );
+}
+
+static int
+operation_table_match(
+        const LloadOpTable *table,
+        const LloadOperation *l,
+        const LloadOperation *r )
+{
+    ber_int_t lmsgid = operation_table_msgid( table, l ),
+              rmsgid = operation_table_msgid( table, r );
+
+    if ( lmsgid || rmsgid ) {
+        return lmsgid == rmsgid;
     }
+    return l->o_pin_id == r->o_pin_id;
 }
 
+static void
+operation_table_resize( LloadOpTable *table, unsigned int bits )
+{
+    LloadOperation **old = table->ot_slots;
+    unsigned int i, size = 1U << bits, mask = size - 1,
+                    oldsize = table->ot_bits ? 1U << table->ot_bits : 0;
+
+    table->ot_slots = ch_calloc( size, sizeof(LloadOperation *) );
+    for ( i = 0; i < oldsize; i++ ) {
+        unsigned int j;
+
+        if ( !old[i] ) continue;
+
+        j = operation_table_hash( table, old[i], bits );
+        while ( table->ot_slots[j] ) {
+            j = ( j + 1 ) & mask;
+        }
+        table->ot_slots[j] = old[i];
+    }
+    table->ot_bits = bits;
+    ch_free( old );
+}
+
+static unsigned int
+operation_table_lookup(
+        const LloadOpTable *table,
+        const LloadOperation *needle,
+        LloadOperation **found )
+{
+    unsigned int i, mask = ( 1U << table->ot_bits ) - 1;
+
+    assert( table->ot_bits );
+    for ( i = operation_table_hash( table, needle, table->ot_bits );
+            table->ot_slots[i]; i = ( i + 1 ) & mask ) {
+        if ( operation_table_match( table, table->ot_slots[i], needle ) ) {
+            *found = table->ot_slots[i];
+            return i;
+        }
+    }
+    *found = NULL;
+    return i;
+}
+
+void
+operation_table_init( LloadOpTable *table, int upstream )
+{
+    table->ot_slots = NULL;
+    table->ot_bits = 0;
+    table->ot_count = 0;
+    table->ot_upstream = upstream;
+    LDAP_TAILQ_INIT( &table->ot_sent );
+}
+
+void
+operation_table_destroy( LloadOpTable *table )
+{
+    assert( table->ot_count == 0 );
+    ch_free( table->ot_slots );
+    table->ot_slots = NULL;
+    table->ot_bits = 0;
+}
+
+/*
+ * Returns LDAP_SUCCESS or -1 if an operation with the same key is already
+ * present.
+ */
 int
-operation_upstream_cmp( const void *left, const void *right )
+operation_table_insert( LloadOpTable *table, LloadOperation *op )
 {
-    const LloadOperation *l = left, *r = right;
+    LloadOperation *found;
+    unsigned int i;
+
+    /* Keep the load factor at or below 1/2 */
+    if ( !table->ot_bits ) {
+        operation_table_resize( table, OPERATION_TABLE_MIN_BITS );
+    } else if ( ( table->ot_count + 1 ) * 2 > 1U << table->ot_bits ) {
+        operation_table_resize( table, table->ot_bits + 1 );
+    }
 
-    assert( l->o_upstream_connid == r->o_upstream_connid );
-    if ( l->o_upstream_msgid || r->o_upstream_msgid ) {
-        return ( l->o_upstream_msgid < r->o_upstream_msgid ) ?
-                -1 :
-                ( l->o_upstream_msgid > r->o_upstream_msgid );
-    } else {
-        return ( l->o_pin_id < r->o_pin_id ) ? -1 :
-                ( l->o_pin_id > r->o_pin_id );
+    i = operation_table_lookup( table, op, &found );
+    if ( found ) {
+        return -1;
+    }
+
+    table->ot_slots[i] = op;
+    table->ot_count++;
+    if ( table->ot_upstream ) {
+        LDAP_TAILQ_INSERT_TAIL( &table->ot_sent, op, o_sent_next );
+    }
+    return LDAP_SUCCESS;
+}
+
+LloadOperation *
+operation_table_find( LloadOpTable *table, LloadOperation *needle )
+{
+    LloadOperation *found;
+
+    if ( !table->ot_count ) {
+        return NULL;
     }
+
+    operation_table_lookup( table, needle, &found );
+    return found;
+}
+
+LloadOperation *
+operation_table_delete( LloadOpTable *table, LloadOperation *needle )
+{
+    LloadOperation *found;
+    unsigned int i, j, mask;
+
+    if ( !table->ot_count ) {
+        return NULL;
+    }
+
+    i = operation_table_lookup( table, needle, &found );
+    if ( !found ) {
+        return NULL;
+    }
+
+    /*
+     * Backward shift deletion: move up any entry in the same run that would
+     * not be reachable from its home slot across the gap we just made.
+     */
+    mask = ( 1U << table->ot_bits ) - 1;
+    table->ot_slots[i] = NULL;
+    for ( j = ( i + 1 ) & mask; table->ot_slots[j]; j = ( j + 1 ) & mask ) {
+        unsigned int home = operation_table_hash(
+                table, table->ot_slots[j], table->ot_bits );
+
+        if ( ( ( j - home ) & mask ) >= ( ( j - i ) & mask ) ) {
+            table->ot_slots[i] = table->ot_slots[j];
+            table->ot_slots[j] = NULL;
+            i = j;
+        }
+    }
+
+    table->ot_count--;
+    if ( table->ot_upstream ) {
+        LDAP_TAILQ_REMOVE( &table->ot_sent, found, o_sent_next );
+    }
+
+    if ( table->ot_bits > OPERATION_TABLE_MIN_BITS &&
+            table->ot_count * 8 < 1U << table->ot_bits ) {
+        operation_table_resize( table, table->ot_bits - 1 );
+    }
+    return found;
+}
+
+/*
+ * Iterate over the operations in no particular order, *cursor should start at
+ * 0 and the table must not be modified while iterating.
+ */
+LloadOperation *
+operation_table_next( LloadOpTable *table, unsigned int *cursor )
+{
+    unsigned int size = table->ot_bits ? 1U << table->ot_bits : 0;
+
+    while ( *cursor < size ) {
+        LloadOperation *op = table->ot_slots[( *cursor )++];
+        if ( op ) {
+            return op;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Take over all operations in table, leaving it empty. The result is only
+ * good to be passed to operation_table_free(). An empty table keeps its slots
+ * since connections get reset on every Bind.
+ */
+void
+operation_table_detach( LloadOpTable *table, LloadOpTable *into )
+{
+    *into = *table;
+    if ( !table->ot_count ) {
+        into->ot_slots = NULL;
+        into->ot_bits = 0;
+        return;
+    }
+
+    table->ot_slots = NULL;
+    table->ot_bits = 0;
+    table->ot_count = 0;
+    LDAP_TAILQ_INIT( &table->ot_sent );
+}
+
+/*
+ * Call cb on every operation in a detached table and release it, returns the
+ * number of operations processed.
+ */
+long
+operation_table_free( LloadOpTable *table, void (*cb)( LloadOperation * ) )
+{
+    LloadOperation *op;
+    unsigned int cursor = 0;
+    long freed = 0;
+
+    while ( (op = operation_table_next( table, &cursor )) ) {
+        cb( op );
+        freed++;
+    }
+    assert( freed == table->ot_count );
+
+    ch_free( table->ot_slots );
+    table->ot_slots = NULL;
+    table->ot_bits = 0;
+    table->ot_count = 0;
+    return freed;
 }
 
 /*
@@ -162,7 +384,7 @@ operation_init( LloadConnection *c, BerElement *ber )
     }
 
     CONNECTION_ASSERT_LOCKED(c);
-    rc = ldap_tavl_insert( &c->c_ops, op, operation_client_cmp, ldap_avl_dup_error );
+    rc = operation_table_insert( &c->c_ops, op );
     if ( rc ) {
         Debug( LDAP_DEBUG_PACKETS, "operation_init: "
                 "several operations with same msgid=%d in-flight "
@@ -178,7 +400,7 @@ operation_init( LloadConnection *c, BerElement *ber )
             break;
     }
     if ( rc ) {
-        ldap_tavl_delete( &c->c_ops, op, operation_client_cmp );
+        operation_table_delete( &c->c_ops, op );
         goto fail;
     }
 
@@ -222,6 +444,9 @@ operation_destroy( LloadOperation *op )
     assert( op->o_client == NULL );
     assert( op->o_upstream == NULL );
 
+    if ( op->o_cache ) {
+        lload_cache_entry_free( op->o_cache );
+    }
     ber_free( op->o_ber, 1 );
     ldap_pvt_thread_mutex_destroy( &op->o_link_mutex );
     ch_free( op );
@@ -261,6 +486,8 @@ operation_unlink( LloadOperation *op )
         result |= operation_unlink_upstream( op, upstream );
     }
 
+    lload_coalesce_detach( op );
+
     return result;
 }
 
@@ -275,8 +502,7 @@ operation_unlink_client( LloadOperation *op, LloadConnection *client )
             op, op->o_client_msgid, op->o_client_connid );
 
     CONNECTION_LOCK(client);
-    if ( (removed = ldap_tavl_delete(
-                   &client->c_ops, op, operation_client_cmp )) ) {
+    if ( (removed = operation_table_delete( &client->c_ops, op )) ) {
         result = LLOAD_OP_DETACHING_CLIENT;
 
         assert( op == removed );
@@ -313,7 +539,7 @@ operation_unlink_client( LloadOperation *op, LloadConnection *client )
             }
         }
     }
-    if ( client->c_state == LLOAD_C_CLOSING && !client->c_ops ) {
+    if ( client->c_state == LLOAD_C_CLOSING && !client->c_ops.ot_count ) {
         CONNECTION_DESTROY(client);
     } else {
         CONNECTION_UNLOCK(client);
@@ -334,15 +560,14 @@ operation_unlink_upstream( LloadOperation *op, LloadConnection *upstream )
             op, op->o_upstream_msgid, op->o_upstream_connid );
 
     CONNECTION_LOCK(upstream);
-    if ( (removed = ldap_tavl_delete(
-                   &upstream->c_ops, op, operation_upstream_cmp )) ) {
+    if ( (removed = operation_table_delete( &upstream->c_ops, op )) ) {
         result |= LLOAD_OP_DETACHING_UPSTREAM;
 
         assert( op == removed );
         upstream->c_n_ops_executing--;
 
         if ( upstream->c_state == LLOAD_C_BINDING ) {
-            assert( op->o_tag == LDAP_REQ_BIND && upstream->c_ops == NULL );
+            assert( op->o_tag == LDAP_REQ_BIND && !upstream->c_ops.ot_count );
             upstream->c_state = LLOAD_C_READY;
             if ( !BER_BVISNULL( &upstream->c_sasl_bind_mech ) ) {
                 ber_memfree( upstream->c_sasl_bind_mech.bv_val );
@@ -352,7 +577,7 @@ operation_unlink_upstream( LloadOperation *op, LloadConnection *upstream )
         operation_update_conn_counters( op, upstream );
         b = upstream->c_backend;
     }
-    if ( upstream->c_state == LLOAD_C_CLOSING && !upstream->c_ops ) {
+    if ( upstream->c_state == LLOAD_C_CLOSING && !upstream->c_ops.ot_count ) {
         CONNECTION_DESTROY(upstream);
     } else {
         CONNECTION_UNLOCK(upstream);
@@ -540,21 +765,19 @@ operation_lost_upstream( LloadOperation *op )
 int
 connection_timeout( LloadConnection *upstream, void *arg )
 {
-    LloadOperation *op;
-    TAvlnode *ops = NULL, *node, *next;
+    LloadOperation *op, *next;
+    lload_o_head ops = LDAP_TAILQ_HEAD_INITIALIZER(ops);
     LloadBackend *b = upstream->c_backend;
     struct timeval *threshold = arg;
-    int rc, nops = 0;
+    int rc = LDAP_SUCCESS, nops = 0;
 
     CONNECTION_LOCK(upstream);
-    for ( node = ldap_tavl_end( upstream->c_ops, TAVL_DIR_LEFT );
-            node && timercmp( &((LloadOperation *)node->avl_data)->o_start,
-                    threshold, < ); /* shortcut */
-            node = next ) {
+    for ( op = LDAP_TAILQ_FIRST( &upstream->c_ops.ot_sent );
+            op && timercmp( &op->o_start, threshold, < ); /* shortcut */
+            op = next ) {
         LloadOperation *found_op;
 
-        next = ldap_tavl_next( node, TAVL_DIR_RIGHT );
-        op = node->avl_data;
+        next = LDAP_TAILQ_NEXT( op, o_sent_next );
 
         /* Have we received another response since? */
         if ( timerisset( &op->o_last_response ) &&
@@ -563,11 +786,11 @@ connection_timeout( LloadConnection *upstream, void *arg )
         }
 
         op->o_res = LLOAD_OP_FAILED;
-        found_op = ldap_tavl_delete( &upstream->c_ops, op, operation_upstream_cmp );
+        found_op = operation_table_delete( &upstream->c_ops, op );
         assert( op == found_op );
 
         if ( upstream->c_state == LLOAD_C_BINDING ) {
-            assert( op->o_tag == LDAP_REQ_BIND && upstream->c_ops == NULL );
+            assert( op->o_tag == LDAP_REQ_BIND && !upstream->c_ops.ot_count );
             upstream->c_state = LLOAD_C_READY;
             if ( !BER_BVISNULL( &upstream->c_sasl_bind_mech ) ) {
                 ber_memfree( upstream->c_sasl_bind_mech.bv_val );
@@ -575,8 +798,8 @@ connection_timeout( LloadConnection *upstream, void *arg )
             }
         }
 
-        rc = ldap_tavl_insert( &ops, op, operation_upstream_cmp, ldap_avl_dup_error );
-        assert( rc == LDAP_SUCCESS );
+        /* Out of ot_sent now, we can reuse the link */
+        LDAP_TAILQ_INSERT_TAIL( &ops, op, o_sent_next );
 
         Debug( LDAP_DEBUG_STATS2, "connection_timeout: "
                 "timing out %s from connid=%lu msgid=%d sent to connid=%lu as "
@@ -602,9 +825,8 @@ connection_timeout( LloadConnection *upstream, void *arg )
     b->b_n_ops_executing -= nops;
     checked_unlock( &b->b_mutex );
 
-    for ( node = ldap_tavl_end( ops, TAVL_DIR_LEFT ); node;
-            node = ldap_tavl_next( node, TAVL_DIR_RIGHT ) ) {
-        op = node->avl_data;
+    for ( op = LDAP_TAILQ_FIRST( &ops ); op; op = next ) {
+        next = LDAP_TAILQ_NEXT( op, o_sent_next );
 
         operation_send_reject( op,
                 op->o_tag == LDAP_REQ_SEARCH ? LDAP_TIMELIMIT_EXCEEDED :
@@ -624,14 +846,13 @@ connection_timeout( LloadConnection *upstream, void *arg )
     CONNECTION_LOCK(upstream);
     /* ITS#9799: If a Bind timed out, connection is in an unknown state */
     if ( upstream->c_type == LLOAD_C_BIND || rc != LDAP_SUCCESS ||
-            ( upstream->c_state == LLOAD_C_CLOSING && !upstream->c_ops ) ) {
+            ( upstream->c_state == LLOAD_C_CLOSING &&
+                    !upstream->c_ops.ot_count ) ) {
         CONNECTION_DESTROY(upstream);
     } else {
         CONNECTION_UNLOCK(upstream);
     }
 
-    /* just dispose of the AVL, most operations should already be gone */
-    ldap_tavl_free( ops, NULL );
     return LDAP_SUCCESS;
 }
 
@@ -710,6 +931,99 @@ operation_update_conn_counters( LloadOperation *op, LloadConnection *upstream )
     }
 }
 
+void
+lload_histogram_add(
+        lload_histogram_t *h,
+        struct timeval *start,
+        struct timeval *end )
+{
+    struct timeval diff;
+    uint64_t value;
+    unsigned int bucket;
+
+    timersub( end, start, &diff );
+    if ( diff.tv_sec < 0 ) {
+        value = 0;
+    } else {
+        value = (uint64_t)diff.tv_sec * 1000000 + diff.tv_usec;
+    }
+
+    if ( value >= (uint64_t)1 << 32 ) {
+        bucket = LLOAD_HISTOGRAM_BUCKETS - 1;
+    } else if ( value < 2 << LLOAD_HISTOGRAM_SUB_BITS ) {
+        bucket = value;
+    } else {
+        int shift = -LLOAD_HISTOGRAM_SUB_BITS;
+        uint64_t v;
+
+        for ( v = value; v > 1; v >>= 1 ) {
+            shift++;
+        }
+        bucket = ( ( shift + 1 ) << LLOAD_HISTOGRAM_SUB_BITS ) +
+                ( ( value >> shift ) &
+                        ( ( 1 << LLOAD_HISTOGRAM_SUB_BITS ) - 1 ) );
+    }
+    assert( bucket < LLOAD_HISTOGRAM_BUCKETS );
+
+    h->lh_count++;
+    h->lh_buckets[bucket]++;
+}
+
+/*
+ * Return the highest value (in microseconds) that falls in the same bucket as
+ * the sample at the given rank, 1000 being the maximum.
+ */
+uintptr_t
+lload_histogram_value( lload_histogram_t *h, int permille )
+{
+    uintptr_t rank, seen = 0;
+    unsigned int bucket;
+
+    if ( !h->lh_count ) {
+        return 0;
+    }
+
+    rank = ( (uint64_t)h->lh_count * permille + 999 ) / 1000;
+    if ( !rank ) {
+        rank = 1;
+    }
+
+    for ( bucket = 0; bucket < LLOAD_HISTOGRAM_BUCKETS; bucket++ ) {
+        seen += h->lh_buckets[bucket];
+        if ( seen >= rank ) {
+            break;
+        }
+    }
+
+    if ( bucket < 2 << LLOAD_HISTOGRAM_SUB_BITS ) {
+        return bucket;
+    } else {
+        int shift = ( bucket >> LLOAD_HISTOGRAM_SUB_BITS ) - 1;
+        uintptr_t low = ( ( bucket & ( ( 1 << LLOAD_HISTOGRAM_SUB_BITS ) - 1 ) ) |
+                                ( 1 << LLOAD_HISTOGRAM_SUB_BITS ) )
+                << shift;
+
+        return low + ( (uintptr_t)1 << shift ) - 1;
+    }
+}
+
+static int
+operation_latency_class( LloadOperation *op )
+{
+    switch ( op->o_tag ) {
+        case LDAP_REQ_BIND:
+            return LLOAD_LATENCY_BIND;
+        case LDAP_REQ_SEARCH:
+            return LLOAD_LATENCY_SEARCH;
+        case LDAP_REQ_COMPARE:
+            return LLOAD_LATENCY_COMPARE;
+        case LDAP_REQ_EXTENDED:
+            return LLOAD_LATENCY_EXTENDED;
+        default:
+            return LLOAD_LATENCY_WRITE;
+    }
+}
+
 void
 operation_update_backend_counters( LloadOperation *op, LloadBackend *b )
 {
@@ -717,8 +1031,21 @@ operation_update_backend_counters( LloadOperation *op, LloadBackend *b )
                                                  LLOAD_STATS_OPS_OTHER;
 
     assert( b != NULL );
+    assert_locked( &b->b_mutex );
     if ( op->o_res == LLOAD_OP_COMPLETED ) {
         b->b_counters[stat_type].lc_ops_completed++;
+
+        /* Abandoned operations count as completed, skip those that never
+         * got a response */
+        if ( timerisset( &op->o_forwarded ) &&
+                !timercmp( &op->o_last_response, &op->o_forwarded, < ) ) {
+            int class = operation_latency_class( op );
+
+            lload_histogram_add( &b->b_latency.ll_queue[class], &op->o_start,
+                    &op->o_forwarded );
+            lload_histogram_add( &b->b_latency.ll_upstream[class],
+                    &op->o_forwarded, &op->o_last_response );
+        }
     } else {
         b->b_counters[stat_type].lc_ops_failed++;
     }
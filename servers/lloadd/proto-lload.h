@@ -37,6 +37,7 @@ LDAP_BEGIN_DECL
  * backend.c
  */
 
+LDAP_SLAPD_V (unsigned int) lload_adaptive_tolerance;
 LDAP_SLAPD_F (void) backend_connect( evutil_socket_t s, short what, void *arg );
 LDAP_SLAPD_F (void *) backend_connect_task( void *ctx, void *arg );
 LDAP_SLAPD_F (void) backend_retry( LloadBackend *b );
@@ -44,6 +45,7 @@ LDAP_SLAPD_F (int) upstream_select( LloadOperation *op, LloadConnection **c, int
 LDAP_SLAPD_F (int) backend_select( LloadBackend *b, LloadOperation *op, LloadConnection **c, int *res, char **message );
 LDAP_SLAPD_F (int) try_upstream( LloadBackend *b, lload_c_head *head, LloadOperation *op, LloadConnection *c, int *res, char **message );
 LDAP_SLAPD_F (void) backend_reset( LloadBackend *b, int gentle );
+LDAP_SLAPD_F (void) backend_update_limit( LloadBackend *b );
 LDAP_SLAPD_F (LloadBackend *) lload_backend_new( void );
 LDAP_SLAPD_F (void) lload_backend_destroy( LloadBackend *b );
 
@@ -55,6 +57,27 @@ LDAP_SLAPD_F (int) handle_bind_response( LloadConnection *client, LloadOperation
 LDAP_SLAPD_F (int) handle_whoami_response( LloadConnection *client, LloadOperation *op, BerElement *ber );
 LDAP_SLAPD_F (int) handle_vc_bind_response( LloadConnection *client, LloadOperation *op, BerElement *ber );
 
+/*
+ * cache.c
+ */
+LDAP_SLAPD_V (int) lload_cache_ttl;
+LDAP_SLAPD_V (unsigned int) lload_cache_max_entries;
+LDAP_SLAPD_V (ber_len_t) lload_cache_max_size;
+LDAP_SLAPD_V (int) lload_bind_cache_ttl;
+LDAP_SLAPD_V (unsigned int) lload_bind_cache_max_entries;
+LDAP_SLAPD_V (unsigned int) lload_coalesce_max_waiters;
+LDAP_SLAPD_V (unsigned int) lload_coalesce_timeout;
+LDAP_SLAPD_F (int) lload_cache_lookup( LloadConnection *client, LloadOperation *op );
+LDAP_SLAPD_F (int) lload_bind_cache_lookup( LloadOperation *op, struct berval *binddn, struct berval *cred );
+LDAP_SLAPD_F (void) lload_cache_response( LloadOperation *op, ber_tag_t response_tag, struct berval *response, struct berval *controls );
+LDAP_SLAPD_F (void) lload_cache_invalidate( LloadOperation *op );
+LDAP_SLAPD_F (void) lload_coalesce_response( LloadOperation *op, ber_tag_t response_tag, struct berval *response, struct berval *controls );
+LDAP_SLAPD_F (void) lload_coalesce_detach( LloadOperation *op );
+LDAP_SLAPD_F (void) lload_cache_flush( void );
+LDAP_SLAPD_F (void) lload_cache_entry_free( LloadCacheEntry *entry );
+LDAP_SLAPD_F (void) lload_cache_init( void );
+LDAP_SLAPD_F (void) lload_cache_destroy( void );
+
 /*
  * client.c
  */
@@ -103,6 +126,7 @@ LDAP_SLAPD_F (LloadConnection *) lload_connection_init( ber_socket_t s,
         struct berval *peername,
         int use_tls );
 LDAP_SLAPD_F (void) connection_destroy( LloadConnection *c );
+LDAP_SLAPD_F (int) lload_ber_put_message( BerElement *output, ber_int_t msgid, ber_tag_t tag, struct berval *pdu, struct berval *controls );
 LDAP_SLAPD_F (void) connections_walk_last( ldap_pvt_thread_mutex_t *cq_mutex,
         lload_c_head *cq,
         LloadConnection *cq_last,
@@ -123,6 +147,7 @@ LDAP_SLAPD_F (void) listeners_reactivate( void );
 LDAP_SLAPD_F (struct event_base *) lload_get_base( ber_socket_t s );
 LDAP_SLAPD_V (int) lload_daemon_threads;
 LDAP_SLAPD_V (int) lload_daemon_mask;
+LDAP_SLAPD_V (int) lload_listener_reuseport;
 
 LDAP_SLAPD_F (void) lload_sig_shutdown( evutil_socket_t sig, short what, void *arg );
 
@@ -192,8 +217,14 @@ LDAP_SLAPD_V (TAvlnode *) lload_exop_actions;
 LDAP_SLAPD_V (enum op_restriction) lload_default_exop_action;
 LDAP_SLAPD_F (int) lload_restriction_cmp( const void *left, const void *right );
 LDAP_SLAPD_F (const char *) lload_msgtype2str( ber_tag_t tag );
-LDAP_SLAPD_F (int) operation_upstream_cmp( const void *l, const void *r );
-LDAP_SLAPD_F (int) operation_client_cmp( const void *l, const void *r );
+LDAP_SLAPD_F (void) operation_table_init( LloadOpTable *table, int upstream );
+LDAP_SLAPD_F (void) operation_table_destroy( LloadOpTable *table );
+LDAP_SLAPD_F (int) operation_table_insert( LloadOpTable *table, LloadOperation *op );
+LDAP_SLAPD_F (LloadOperation *) operation_table_find( LloadOpTable *table, LloadOperation *needle );
+LDAP_SLAPD_F (LloadOperation *) operation_table_delete( LloadOpTable *table, LloadOperation *needle );
+LDAP_SLAPD_F (LloadOperation *) operation_table_next( LloadOpTable *table, unsigned int *cursor );
+LDAP_SLAPD_F (void) operation_table_detach( LloadOpTable *table, LloadOpTable *into );
+LDAP_SLAPD_F (long) operation_table_free( LloadOpTable *table, void (*cb)( LloadOperation * ) );
 LDAP_SLAPD_F (LloadOperation *) operation_init( LloadConnection *c, BerElement *ber );
 LDAP_SLAPD_F (int) operation_send_abandon( LloadOperation *op, LloadConnection *c );
 LDAP_SLAPD_F (void) operation_abandon( LloadOperation *op );
@@ -207,6 +238,8 @@ LDAP_SLAPD_F (int) operation_unlink_upstream( LloadOperation *op, LloadConnectio
 LDAP_SLAPD_F (void) operations_timeout( evutil_socket_t s, short what, void *arg );
 LDAP_SLAPD_F (void) operation_update_conn_counters( LloadOperation *op, LloadConnection *upstream );
 LDAP_SLAPD_F (void) operation_update_backend_counters( LloadOperation *op, LloadBackend *b );
+LDAP_SLAPD_F (void) lload_histogram_add( lload_histogram_t *h, struct timeval *start, struct timeval *end );
+LDAP_SLAPD_F (uintptr_t) lload_histogram_value( lload_histogram_t *h, int permille );
 LDAP_SLAPD_F (void) operation_update_global_rejected( LloadOperation *op );
 
 /*
@@ -215,12 +248,19 @@ LDAP_SLAPD_F (void) operation_update_global_rejected( LloadOperation *op );
 LDAP_SLAPD_F (int) tier_startup( LloadTier *tier );
 LDAP_SLAPD_F (int) tier_reset( LloadTier *tier, int shutdown );
 LDAP_SLAPD_F (int) tier_destroy( LloadTier *tier );
+LDAP_SLAPD_F (void) tier_backends_publish( LloadTier *tier );
 LDAP_SLAPD_F (void) lload_tiers_shutdown( void );
 LDAP_SLAPD_F (void) lload_tiers_reset( int shutdown );
 LDAP_SLAPD_F (void) lload_tiers_update( evutil_socket_t s, short what, void *arg );
 LDAP_SLAPD_F (void) lload_tiers_destroy( void );
 LDAP_SLAPD_F (struct lload_tier_type *) lload_tier_find( char *type );
 
+/*
+ * tier_affinity.c
+ */
+LDAP_SLAPD_V (unsigned int) lload_affinity_depth;
+LDAP_SLAPD_V (unsigned int) lload_affinity_load_factor;
+
 /*
  * upstream.c
  */
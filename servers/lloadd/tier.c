@@ -62,6 +62,39 @@ tier_reset( LloadTier *tier, int shutdown )
     return LDAP_SUCCESS;
 }
 
+/*
+ * Rebuild the backend array from t_backends, to be called whenever a tier
+ * type has changed the list. Readers might still be walking the previous one
+ * so it can only be freed once they have left their epoch. Before the daemon
+ * is up there is nobody to race with and epochs might not be set up yet.
+ */
+void
+tier_backends_publish( LloadTier *tier )
+{
+    LloadBackendSet *set, *old;
+    LloadBackend *b;
+    int i = 0;
+
+    set = ch_malloc( sizeof(LloadBackendSet) +
+            tier->t_nbackends * sizeof(LloadBackend *) );
+    set->bs_backends = (LloadBackend **)( set + 1 );
+
+    LDAP_CIRCLEQ_FOREACH ( b, &tier->t_backends, b_next ) {
+        set->bs_backends[i++] = b;
+    }
+    assert( i == tier->t_nbackends );
+    set->bs_nbackends = i;
+
+    old = __atomic_exchange_n( &tier->t_backend_set, set, __ATOMIC_ACQ_REL );
+    if ( !old ) {
+        return;
+    } else if ( daemon_base ) {
+        epoch_append( old, ch_free );
+    } else {
+        ch_free( old );
+    }
+}
+
 int
 tier_destroy( LloadTier *tier )
 {
@@ -74,6 +107,14 @@ tier_destroy( LloadTier *tier )
         epoch_leave( epoch );
     }
 
+    if ( tier->t_backend_set ) {
+        if ( daemon_base ) {
+            epoch_append( tier->t_backend_set, ch_free );
+        } else {
+            ch_free( tier->t_backend_set );
+        }
+    }
+
 #ifdef BALANCER_MODULE
     if ( tier->t_monitor ) {
         /* FIXME: implement proper subsys shutdown in back-monitor or make
@@ -133,15 +174,22 @@ lload_tiers_update( evutil_socket_t s, short what, void *arg )
     LloadTier *tier;
 
     LDAP_STAILQ_FOREACH ( tier, &tiers, t_next ) {
+        LloadBackend *b;
+
         if ( tier->t_type.tier_update ) {
             tier->t_type.tier_update( tier );
         }
+
+        LDAP_CIRCLEQ_FOREACH ( b, &tier->t_backends, b_next ) {
+            backend_update_limit( b );
+        }
     }
 }
 
 extern struct lload_tier_type roundrobin_tier;
 extern struct lload_tier_type weighted_tier;
 extern struct lload_tier_type bestof_tier;
+extern struct lload_tier_type affinity_tier;
 
 struct {
     char *name;
@@ -150,6 +198,7 @@ struct {
         { "roundrobin", &roundrobin_tier },
         { "weighted", &weighted_tier },
         { "bestof", &bestof_tier },
+        { "affinity", &affinity_tier },
 
         { NULL }
 };
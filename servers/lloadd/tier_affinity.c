@@ -0,0 +1,416 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1998-2024 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <ac/ctype.h>
+
+#include "lload.h"
+
+/*
+ * Route operations by the DN they target: each backend owns a number of points
+ * on a hash ring and a request goes to the backend owning the first point
+ * after the hash of its (normalised) target DN. That way each backend only
+ * sees a part of the DIT and has a better chance of keeping it cached. When a
+ * backend is added or removed, only the DNs it owns move elsewhere.
+ *
+ * To keep popular subtrees from overwhelming their backend, load is bounded
+ * as in "Consistent Hashing with Bounded Loads" (Mirrokni et al.): a backend
+ * with more than (1 + load_factor) times the average number of pending
+ * operations is passed over until everyone else has been tried.
+ */
+
+static LloadTierInit affinity_init;
+static LloadTierBackendCb affinity_add_backend;
+static LloadTierBackendCb affinity_remove_backend;
+static LloadTierSelect affinity_select;
+
+struct lload_tier_type affinity_tier;
+
+unsigned int lload_affinity_depth = 0;
+unsigned int lload_affinity_load_factor = LLOAD_AFFINITY_LOAD_FACTOR_DEFAULT;
+
+/* Points each backend gets on the ring */
+#define AFFINITY_POINTS 64
+
+typedef struct AffinityPoint {
+    uint32_t ap_hash;
+    int ap_backend;
+} AffinityPoint;
+
+/* Immutable like LloadBackendSet, kept in t_private */
+typedef struct AffinityRing {
+    int ar_nbackends, ar_npoints;
+    LloadBackend **ar_backends;
+    AffinityPoint *ar_points;
+} AffinityRing;
+
+/* FNV-1a, with the murmur3 finaliser since we need all bits to be usable */
+#define AFFINITY_HASH_INIT 0x811c9dc5U
+
+static uint32_t
+affinity_hash( uint32_t h, const void *buf, ber_len_t len )
+{
+    const unsigned char *p = buf, *end = p + len;
+
+    while ( p < end ) {
+        h ^= *p++;
+        h *= 16777619;
+    }
+    return h;
+}
+
+static uint32_t
+affinity_mix( uint32_t h )
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6bU;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35U;
+    h ^= h >> 16;
+    return h;
+}
+
+static int
+affinity_point_cmp( const void *left, const void *right )
+{
+    const AffinityPoint *l = left, *r = right;
+
+    return ( l->ap_hash < r->ap_hash ) ? -1 : ( l->ap_hash > r->ap_hash );
+}
+
+/*
+ * Same rules as tier_backends_publish(), an empty tier has no ring.
+ */
+static void
+affinity_publish( LloadTier *tier )
+{
+    AffinityRing *ring = NULL, *old;
+    LloadBackend *b;
+    int i = 0, j, n = tier->t_nbackends;
+
+    tier_backends_publish( tier );
+
+    if ( n ) {
+        ring = ch_malloc( sizeof(AffinityRing) + n * sizeof(LloadBackend *) +
+                n * AFFINITY_POINTS * sizeof(AffinityPoint) );
+        ring->ar_backends = (LloadBackend **)( ring + 1 );
+        ring->ar_points = (AffinityPoint *)( ring->ar_backends + n );
+
+        LDAP_CIRCLEQ_FOREACH ( b, &tier->t_backends, b_next ) {
+            struct berval *id = BER_BVISNULL( &b->b_uri ) ? &b->b_name :
+                                                            &b->b_uri;
+
+            /* Points only depend on the URI so they survive a reshuffle */
+            for ( j = 0; j < AFFINITY_POINTS; j++ ) {
+                AffinityPoint *point = &ring->ar_points[i * AFFINITY_POINTS + j];
+                uint32_t h;
+
+                h = affinity_hash( AFFINITY_HASH_INIT, id->bv_val, id->bv_len );
+                h = affinity_hash( h, &j, sizeof(j) );
+
+                point->ap_hash = affinity_mix( h );
+                point->ap_backend = i;
+            }
+            ring->ar_backends[i++] = b;
+        }
+        assert( i == n );
+        ring->ar_nbackends = n;
+        ring->ar_npoints = n * AFFINITY_POINTS;
+
+        qsort( ring->ar_points, ring->ar_npoints, sizeof(AffinityPoint),
+                affinity_point_cmp );
+    }
+
+    old = __atomic_exchange_n(
+            (AffinityRing **)&tier->t_private, ring, __ATOMIC_ACQ_REL );
+    if ( !old ) {
+        return;
+    } else if ( daemon_base ) {
+        epoch_append( old, ch_free );
+    } else {
+        ch_free( old );
+    }
+}
+
+/*
+ * Locate the DN the request is about, only the ones that have one are
+ * routed by affinity.
+ */
+static int
+affinity_op_dn( LloadOperation *op, struct berval *dn )
+{
+    BerElementBuffer copy_berbuf;
+    BerElement *copy = (BerElement *)&copy_berbuf;
+    ber_int_t version;
+
+    switch ( op->o_tag ) {
+        case LDAP_REQ_DELETE:
+            *dn = op->o_request;
+            return LDAP_SUCCESS;
+        case LDAP_REQ_BIND:
+            ber_init2( copy, &op->o_request, 0 );
+            if ( ber_get_int( copy, &version ) == LBER_ERROR ) {
+                return -1;
+            }
+            break;
+        case LDAP_REQ_SEARCH:
+        case LDAP_REQ_COMPARE:
+        case LDAP_REQ_ADD:
+        case LDAP_REQ_MODIFY:
+        case LDAP_REQ_MODRDN:
+            ber_init2( copy, &op->o_request, 0 );
+            break;
+        default:
+            return -1;
+    }
+
+    if ( ber_get_stringbv( copy, dn, LBER_BV_NOTERM ) == LBER_ERROR ) {
+        return -1;
+    }
+    return LDAP_SUCCESS;
+}
+
+/*
+ * We have no schema so normalisation is approximate: attribute types and
+ * values are compared case-insensitively with insignificant spaces removed,
+ * which is what most naming attributes do anyway. Only the lload_affinity_depth
+ * RDNs closest to the root are considered if set.
+ */
+static int
+affinity_key( LloadOperation *op, uint32_t *key )
+{
+    struct berval dn;
+    LDAPDN parsed = NULL;
+    uint32_t h = AFFINITY_HASH_INIT;
+    int i, j, n;
+
+    if ( affinity_op_dn( op, &dn ) ||
+            ldap_bv2dn( &dn, &parsed, LDAP_DN_FORMAT_LDAP ) != LDAP_SUCCESS ) {
+        return -1;
+    }
+
+    for ( n = 0; parsed && parsed[n]; n++ )
+        /* count */;
+
+    i = ( lload_affinity_depth && lload_affinity_depth < (unsigned int)n ) ?
+            n - lload_affinity_depth :
+            0;
+    for ( ; i < n; i++ ) {
+        LDAPRDN rdn = parsed[i];
+
+        for ( j = 0; rdn[j]; j++ ) {
+            LDAPAVA *ava = rdn[j];
+            char *p = ava->la_value.bv_val,
+                 *end = p + ava->la_value.bv_len;
+            unsigned char c;
+            ber_len_t k;
+            int space = 0;
+
+            if ( j ) {
+                h = affinity_hash( h, "+", 1 );
+            }
+            for ( k = 0; k < ava->la_attr.bv_len; k++ ) {
+                c = TOLOWER( (unsigned char)ava->la_attr.bv_val[k] );
+                h = affinity_hash( h, &c, 1 );
+            }
+            h = affinity_hash( h, "=", 1 );
+
+            if ( ava->la_flags & LDAP_AVA_BINARY ) {
+                h = affinity_hash( h, p, ava->la_value.bv_len );
+                continue;
+            }
+
+            while ( p < end && *p == ' ' ) p++;
+            for ( ; p < end; p++ ) {
+                if ( *p == ' ' ) {
+                    space = 1;
+                    continue;
+                }
+                if ( space ) {
+                    h = affinity_hash( h, " ", 1 );
+                    space = 0;
+                }
+                c = TOLOWER( (unsigned char)*p );
+                h = affinity_hash( h, &c, 1 );
+            }
+        }
+        h = affinity_hash( h, ",", 1 );
+    }
+    ldap_dnfree( parsed );
+
+    *key = affinity_mix( h );
+    return LDAP_SUCCESS;
+}
+
+static LloadTier *
+affinity_init( void )
+{
+    LloadTier *tier;
+
+    tier = ch_calloc( 1, sizeof(LloadTier) );
+
+    tier->t_type = affinity_tier;
+    ldap_pvt_thread_mutex_init( &tier->t_mutex );
+    LDAP_CIRCLEQ_INIT( &tier->t_backends );
+
+    return tier;
+}
+
+static int
+affinity_add_backend( LloadTier *tier, LloadBackend *b )
+{
+    assert( b->b_tier == tier );
+
+    /* Already there, the URI might have changed so rebuild the ring anyway */
+    if ( LDAP_CIRCLEQ_NEXT( b, b_next ) ) {
+        affinity_publish( tier );
+        return LDAP_SUCCESS;
+    }
+
+    LDAP_CIRCLEQ_INSERT_TAIL( &tier->t_backends, b, b_next );
+    tier->t_nbackends++;
+    affinity_publish( tier );
+    return LDAP_SUCCESS;
+}
+
+static int
+affinity_remove_backend( LloadTier *tier, LloadBackend *b )
+{
+    assert_locked( &tier->t_mutex );
+    assert_locked( &b->b_mutex );
+
+    assert( b->b_tier == tier );
+    assert( tier->t_nbackends );
+
+    LDAP_CIRCLEQ_REMOVE( &tier->t_backends, b, b_next );
+    LDAP_CIRCLEQ_ENTRY_INIT( b, b_next );
+    tier->t_nbackends--;
+    affinity_publish( tier );
+
+    return LDAP_SUCCESS;
+}
+
+static int
+affinity_select(
+        LloadTier *tier,
+        LloadOperation *op,
+        LloadConnection **cp,
+        int *res,
+        char **message )
+{
+    AffinityRing *ring;
+    AffinityPoint *points;
+    int *order, *skipped;
+    uint32_t key;
+    long total = 0, capacity;
+    int i, n, found = 0, lo, hi, pass, rc = 0;
+
+    ring = __atomic_load_n( (AffinityRing **)&tier->t_private, __ATOMIC_ACQUIRE );
+    if ( !ring ) return rc;
+
+    n = ring->ar_nbackends;
+    points = ring->ar_points;
+
+    /* No DN to go by, just spread them around */
+    if ( affinity_key( op, &key ) ) {
+        key = affinity_mix(
+                __atomic_fetch_add( &tier->t_rotate, 1, __ATOMIC_RELAXED ) );
+    }
+
+    for ( i = 0; i < n; i++ ) {
+        total += __atomic_load_n(
+                &ring->ar_backends[i]->b_n_ops_executing, __ATOMIC_RELAXED );
+    }
+    /* ceil( ( 1 + load_factor ) * ( total + 1 ) / n ), counting this one */
+    capacity = ( ( total + 1 ) * ( 100 + lload_affinity_load_factor ) +
+                       100 * n - 1 ) /
+            ( 100 * n );
+
+    /* First point at or after the key, wrapping around */
+    lo = 0;
+    hi = ring->ar_npoints;
+    while ( lo < hi ) {
+        int mid = lo + ( hi - lo ) / 2;
+
+        if ( points[mid].ap_hash < key ) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    order = ch_calloc( 2 * n, sizeof(int) );
+    skipped = order + n;
+
+    /* Backends in the order they appear on the ring from there */
+    for ( i = 0; found < n && i < ring->ar_npoints; i++ ) {
+        AffinityPoint *point = &points[( lo + i ) % ring->ar_npoints];
+
+        if ( skipped[point->ap_backend] ) continue;
+        skipped[point->ap_backend] = 1;
+        order[found++] = point->ap_backend;
+    }
+    assert( found == n );
+
+    /*
+     * Skip the ones over capacity first, they only get a go once everyone
+     * else has turned us down.
+     */
+    for ( pass = 0; pass < 2; pass++ ) {
+        for ( i = 0; i < n; i++ ) {
+            LloadBackend *b = ring->ar_backends[order[i]];
+            int result;
+
+            if ( !pass ) {
+                skipped[order[i]] = __atomic_load_n( &b->b_n_ops_executing,
+                                            __ATOMIC_RELAXED ) >= capacity;
+                if ( skipped[order[i]] ) continue;
+            } else if ( !skipped[order[i]] ) {
+                continue;
+            }
+
+            checked_lock( &b->b_mutex );
+            result = backend_select( b, op, cp, res, message );
+            checked_unlock( &b->b_mutex );
+
+            rc |= result;
+            if ( result && *cp ) {
+                goto done;
+            }
+        }
+    }
+
+done:
+    ch_free( order );
+    return rc;
+}
+
+struct lload_tier_type affinity_tier = {
+        .tier_name = "affinity",
+
+        .tier_init = affinity_init,
+        .tier_startup = tier_startup,
+        .tier_reset = tier_reset,
+        .tier_destroy = tier_destroy,
+
+        .tier_oc = BER_BVC("olcBkLloadTierConfig"),
+        .tier_backend_oc = BER_BVC("olcBkLloadBackendConfig"),
+
+        .tier_add_backend = affinity_add_backend,
+        .tier_remove_backend = affinity_remove_backend,
+
+        .tier_select = affinity_select,
+};
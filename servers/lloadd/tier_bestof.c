@@ -62,7 +62,8 @@ bestof_cmp( const void *left, const void *right )
     const LloadBackend *r = right;
     struct timeval now;
     uintptr_t count, diff;
-    float a = l->b_fitness, b = r->b_fitness, factor = 1;
+    float a = __atomic_load_n( &l->b_fitness, __ATOMIC_RELAXED ),
+          b = __atomic_load_n( &r->b_fitness, __ATOMIC_RELAXED ), factor = 1;
 
     gettimeofday( &now, NULL );
     /* We assume this is less than a second after the last update */
@@ -110,33 +111,24 @@ bestof_add_backend( LloadTier *tier, LloadBackend *b )
     assert( b->b_tier == tier );
 
     LDAP_CIRCLEQ_INSERT_TAIL( &tier->t_backends, b, b_next );
-    if ( !tier->t_private ) {
-        tier->t_private = b;
-    }
     tier->t_nbackends++;
+    tier_backends_publish( tier );
     return LDAP_SUCCESS;
 }
 
 static int
 bestof_remove_backend( LloadTier *tier, LloadBackend *b )
 {
-    LloadBackend *next = LDAP_CIRCLEQ_LOOP_NEXT( &tier->t_backends, b, b_next );
-
     assert_locked( &tier->t_mutex );
     assert_locked( &b->b_mutex );
 
     assert( b->b_tier == tier );
-    assert( tier->t_private );
+    assert( tier->t_nbackends );
 
     LDAP_CIRCLEQ_REMOVE( &tier->t_backends, b, b_next );
     LDAP_CIRCLEQ_ENTRY_INIT( b, b_next );
-
-    if ( b == next ) {
-        tier->t_private = NULL;
-    } else {
-        tier->t_private = next;
-    }
     tier->t_nbackends--;
+    tier_backends_publish( tier );
 
     return LDAP_SUCCESS;
 }
@@ -164,19 +156,22 @@ bestof_backend_options( LloadTier *tier, LloadBackend *b, char *arg )
 static int
 bestof_update( LloadTier *tier )
 {
-    LloadBackend *b, *first, *next;
+    LloadBackendSet *set;
     time_t now = slap_get_time();
+    epoch_t epoch;
+    int i;
 
-    checked_lock( &tier->t_mutex );
-    first = b = tier->t_private;
-    checked_unlock( &tier->t_mutex );
+    epoch = epoch_join();
+    set = __atomic_load_n( &tier->t_backend_set, __ATOMIC_ACQUIRE );
 
-    if ( !first ) return LDAP_SUCCESS;
-
-    do {
+    for ( i = 0; set && i < set->bs_nbackends; i++ ) {
+        LloadBackend *b = set->bs_backends[i];
         int steps;
-        checked_lock( &b->b_mutex );
 
+        /*
+         * Only we ever write b_last_update and b_fitness and bestof_select
+         * reads the latter atomically, no need to take b_mutex.
+         */
         steps = now - b->b_last_update;
         if ( b->b_weight && steps > 0 ) {
             uintptr_t count, diff;
@@ -198,17 +193,18 @@ bestof_update( LloadTier *tier )
                     factor = 1 / ( pow( ( 1 / factor ) + 1, steps ) - 1 );
                 }
 
-                b->b_fitness = ( factor * b->b_fitness + fitness / count ) /
+                fitness = ( factor * __atomic_load_n( &b->b_fitness,
+                                             __ATOMIC_RELAXED ) +
+                                  fitness / count ) /
                         ( factor + 1 );
+                __atomic_store_n(
+                        &b->b_fitness, (uintptr_t)fitness, __ATOMIC_RELAXED );
                 b->b_last_update = now;
             }
         }
+    }
 
-        next = LDAP_CIRCLEQ_LOOP_NEXT( &tier->t_backends, b, b_next );
-        checked_unlock( &b->b_mutex );
-        b = next;
-    } while ( b != first );
-
+    epoch_leave( epoch );
     return LDAP_SUCCESS;
 }
 
@@ -220,17 +216,18 @@ bestof_select(
         int *res,
         char **message )
 {
-    LloadBackend *first, *next, *b, *b0, *b1;
-    int result = 0, rc = 0, n = tier->t_nbackends;
-    int i0, i1, i = 0;
-
-    checked_lock( &tier->t_mutex );
-    first = b0 = b = tier->t_private;
-    checked_unlock( &tier->t_mutex );
-
-    if ( !first ) return rc;
-
-    if ( tier->t_nbackends == 1 ) {
+    LloadBackendSet *set;
+    LloadBackend *b;
+    uintptr_t first;
+    int result, rc = 0, n;
+    int i0, i1, i;
+
+    set = __atomic_load_n( &tier->t_backend_set, __ATOMIC_ACQUIRE );
+    if ( !set || !set->bs_nbackends ) return rc;
+
+    n = set->bs_nbackends;
+    if ( n == 1 ) {
+        first = 0;
         goto fallback;
     }
 
@@ -239,72 +236,45 @@ bestof_select(
     i1 = bestof_rand() % ( n - 1 );
     if ( i1 >= i0 ) {
         i1 += 1;
-    } else {
-        int tmp = i0;
-        i0 = i1;
-        i1 = tmp;
     }
-    assert( i0 < i1 );
-
-    /*
-     * FIXME: use a static array in t_private so we don't have to do any of
-     * this
-     */
-    for ( i = 0; i < i1; i++ ) {
-        if ( i == i0 ) {
-            b0 = b;
-        }
-        checked_lock( &b->b_mutex );
-        next = LDAP_CIRCLEQ_LOOP_NEXT( &tier->t_backends, b, b_next );
-        checked_unlock( &b->b_mutex );
-        b = next;
-    }
-    b1 = b;
-    assert( b0 != b1 );
-
-    if ( bestof_cmp( b0, b1 ) < 0 ) {
-        checked_lock( &b0->b_mutex );
-        result = backend_select( b0, op, cp, res, message );
-        checked_unlock( &b0->b_mutex );
-    } else {
-        checked_lock( &b1->b_mutex );
-        result = backend_select( b1, op, cp, res, message );
-        checked_unlock( &b1->b_mutex );
+    assert( i0 != i1 );
+
+    if ( bestof_cmp( set->bs_backends[i0], set->bs_backends[i1] ) >= 0 ) {
+        i0 = i1;
     }
+    b = set->bs_backends[i0];
+
+    checked_lock( &b->b_mutex );
+    result = backend_select( b, op, cp, res, message );
+    checked_unlock( &b->b_mutex );
 
     rc |= result;
     if ( result && *cp ) {
-        checked_lock( &tier->t_mutex );
-        tier->t_private = LDAP_CIRCLEQ_LOOP_NEXT(
-                &tier->t_backends, (*cp)->c_backend, b_next );
-        checked_unlock( &tier->t_mutex );
+        __atomic_store_n( &tier->t_rotate, i0 + 1, __ATOMIC_RELAXED );
         return rc;
     }
 
     /* Preferred backends deemed unusable, do a round robin from scratch */
-    b = first;
+    first = __atomic_load_n( &tier->t_rotate, __ATOMIC_RELAXED ) % n;
 fallback:
-    do {
-        checked_lock( &b->b_mutex );
-        next = LDAP_CIRCLEQ_LOOP_NEXT( &tier->t_backends, b, b_next );
+    for ( i = 0; i < n; i++ ) {
+        b = set->bs_backends[( first + i ) % n];
 
+        checked_lock( &b->b_mutex );
         rc = backend_select( b, op, cp, res, message );
         checked_unlock( &b->b_mutex );
 
         if ( rc && *cp ) {
             /*
              * Round-robin step:
-             * Rotate the queue to put this backend at the end. The race here
-             * is acceptable.
+             * Start with the next backend next time. The race here is
+             * acceptable.
              */
-            checked_lock( &tier->t_mutex );
-            tier->t_private = next;
-            checked_unlock( &tier->t_mutex );
+            __atomic_store_n(
+                    &tier->t_rotate, first + i + 1, __ATOMIC_RELAXED );
             return rc;
         }
-
-        b = next;
-    } while ( b != first );
+    }
 
     return rc;
 }
@@ -43,33 +43,22 @@ roundrobin_add_backend( LloadTier *tier, LloadBackend *b )
 {
     assert( b->b_tier == tier );
     LDAP_CIRCLEQ_INSERT_TAIL( &tier->t_backends, b, b_next );
-    if ( !tier->t_private ) {
-        tier->t_private = b;
-    }
     tier->t_nbackends++;
+    tier_backends_publish( tier );
     return LDAP_SUCCESS;
 }
 
 static int
 roundrobin_remove_backend( LloadTier *tier, LloadBackend *b )
 {
-    LloadBackend *next = LDAP_CIRCLEQ_LOOP_NEXT( &tier->t_backends, b, b_next );
-
     assert_locked( &tier->t_mutex );
     assert_locked( &b->b_mutex );
 
     assert( b->b_tier == tier );
 
     LDAP_CIRCLEQ_REMOVE( &tier->t_backends, b, b_next );
-    if ( b == tier->t_private ) {
-        if ( tier->t_nbackends ) {
-            tier->t_private = next;
-        } else {
-            assert( b == next );
-            tier->t_private = NULL;
-        }
-    }
     tier->t_nbackends--;
+    tier_backends_publish( tier );
     return LDAP_SUCCESS;
 }
 
@@ -81,21 +70,21 @@ roundrobin_select(
         int *res,
         char **message )
 {
-    LloadBackend *b, *first, *next;
-    int rc = 0;
+    LloadBackendSet *set;
+    uintptr_t first;
+    int i, n, rc = 0;
 
-    checked_lock( &tier->t_mutex );
-    first = b = tier->t_private;
-    checked_unlock( &tier->t_mutex );
+    set = __atomic_load_n( &tier->t_backend_set, __ATOMIC_ACQUIRE );
+    if ( !set || !set->bs_nbackends ) return rc;
 
-    if ( !first ) return rc;
+    n = set->bs_nbackends;
+    first = __atomic_load_n( &tier->t_rotate, __ATOMIC_RELAXED ) % n;
 
-    do {
+    for ( i = 0; i < n; i++ ) {
+        LloadBackend *b = set->bs_backends[( first + i ) % n];
         int result;
 
         checked_lock( &b->b_mutex );
-        next = LDAP_CIRCLEQ_LOOP_NEXT( &tier->t_backends, b, b_next );
-
         result = backend_select( b, op, cp, res, message );
         checked_unlock( &b->b_mutex );
 
@@ -103,17 +92,14 @@ roundrobin_select(
         if ( result && *cp ) {
             /*
              * Round-robin step:
-             * Rotate the queue to put this backend at the end. The race here
-             * is acceptable.
+             * Start with the next backend next time. The race here is
+             * acceptable.
              */
-            checked_lock( &tier->t_mutex );
-            tier->t_private = next;
-            checked_unlock( &tier->t_mutex );
+            __atomic_store_n(
+                    &tier->t_rotate, first + i + 1, __ATOMIC_RELAXED );
             return rc;
         }
-
-        b = next;
-    } while ( b != first );
+    }
 
     return rc;
 }
@@ -147,6 +147,7 @@ weighted_add_backend( LloadTier *tier, LloadBackend *to_add )
 
 done:
     tier->t_nbackends += added;
+    tier_backends_publish( tier );
     return LDAP_SUCCESS;
 }
 
@@ -162,6 +163,7 @@ weighted_remove_backend( LloadTier *tier, LloadBackend *b )
     LDAP_CIRCLEQ_REMOVE( &tier->t_backends, b, b_next );
     LDAP_CIRCLEQ_ENTRY_INIT( b, b_next );
     tier->t_nbackends--;
+    tier_backends_publish( tier );
 
     return LDAP_SUCCESS;
 }
@@ -174,22 +176,20 @@ weighted_select(
         int *res,
         char **message )
 {
-    LloadBackend *b, **sorted;
-    int rc = 0, i = 0;
+    LloadBackendSet *set;
+    LloadBackend **sorted;
+    int rc = 0, i, n;
 
-    if ( !tier->t_nbackends ) return rc;
+    set = __atomic_load_n( &tier->t_backend_set, __ATOMIC_ACQUIRE );
+    if ( !set || !set->bs_nbackends ) return rc;
 
-    sorted = ch_malloc( tier->t_nbackends * sizeof(LloadBackend *) );
+    n = set->bs_nbackends;
+    sorted = ch_malloc( n * sizeof(LloadBackend *) );
+    AC_MEMCPY( sorted, set->bs_backends, n * sizeof(LloadBackend *) );
 
-    LDAP_CIRCLEQ_FOREACH ( b, &tier->t_backends, b_next ) {
-        sorted[i++] = b;
-    }
-
-    assert( i == tier->t_nbackends );
-
-    weighted_shuffle( sorted, tier->t_nbackends );
+    weighted_shuffle( sorted, n );
 
-    for ( i = 0; i < tier->t_nbackends; i++ ) {
+    for ( i = 0; i < n; i++ ) {
         int result;
 
         checked_lock( &sorted[i]->b_mutex );
@@ -88,6 +88,13 @@ forward_response( LloadConnection *client, LloadOperation *op, BerElement *ber )
             "%s to client connid=%lu request msgid=%d\n",
             lload_msgtype2str( response_tag ), op->o_client_connid, msgid );
 
+    if ( op->o_cache ) {
+        lload_cache_response( op, response_tag, &response, &controls );
+    }
+    if ( __atomic_load_n( &op->o_flight, __ATOMIC_ACQUIRE ) ) {
+        lload_coalesce_response( op, response_tag, &response, &controls );
+    }
+
     checked_lock( &client->c_io_mutex );
     output = client->c_pendingber;
     if ( output == NULL && (output = ber_alloc()) == NULL ) {
@@ -97,10 +104,12 @@ forward_response( LloadConnection *client, LloadOperation *op, BerElement *ber )
     }
     client->c_pendingber = output;
 
-    ber_printf( output, "t{titOtO}", LDAP_TAG_MESSAGE,
-            LDAP_TAG_MSGID, msgid,
-            response_tag, &response,
-            LDAP_TAG_CONTROLS, BER_BV_OPTIONAL( &controls ) );
+    if ( lload_ber_put_message(
+                 output, msgid, response_tag, &response, &controls ) ) {
+        ber_free( ber, 1 );
+        checked_unlock( &client->c_io_mutex );
+        return -1;
+    }
 
     checked_unlock( &client->c_io_mutex );
 
@@ -123,6 +132,7 @@ forward_final_response(
             op->o_upstream_connid, op->o_upstream_msgid, op->o_client_connid );
 
     rc = forward_response( client, op, ber );
+    lload_cache_invalidate( op );
 
     op->o_res = LLOAD_OP_COMPLETED;
     if ( !op->o_pin_id ) {
@@ -150,16 +160,19 @@ handle_unsolicited( LloadConnection *c, BerElement *ber )
             "teardown for upstream connection connid=%lu\n",
             c->c_connid );
 
-    while ( c->c_ops ) {
-        TAvlnode *node = ldap_tavl_end( c->c_ops, TAVL_DIR_LEFT );
-        LloadOperation *op = node->avl_data;
+    while ( c->c_ops.ot_count ) {
+        LloadOperation *op;
+        unsigned int cursor = 0;
 
         /* Close operations that the upstream is not tracking, we don't get a
          * response for those. */
-        if ( op->o_client_msgid || op->o_upstream_msgid ) {
-            assert( op->o_upstream_msgid != 0 );
+        while ( (op = operation_table_next( &c->c_ops, &cursor )) &&
+                op->o_upstream_msgid )
+            /* skip */;
+        if ( !op ) {
             break;
         }
+        assert( op->o_client_msgid == 0 );
 
         CONNECTION_UNLOCK(c);
         OPERATION_UNLINK(op);
@@ -201,7 +214,7 @@ handle_unsolicited( LloadConnection *c, BerElement *ber )
         RELEASE_REF( client, c_refcnt, client->c_destroy );
     }
 
-    if ( c->c_state == LLOAD_C_CLOSING && c->c_ops ) {
+    if ( c->c_state == LLOAD_C_CLOSING && c->c_ops.ot_count ) {
         CONNECTION_UNLOCK(c);
     } else {
         CONNECTION_DESTROY(c);
@@ -209,7 +222,7 @@ handle_unsolicited( LloadConnection *c, BerElement *ber )
 
 out:
     ber_free( ber, 1 );
-    if ( c->c_state == LLOAD_C_CLOSING && c->c_ops ) {
+    if ( c->c_state == LLOAD_C_CLOSING && c->c_ops.ot_count ) {
         CONNECTION_UNLOCK(c);
         return 0;
     }
@@ -269,8 +282,7 @@ handle_one_response( LloadConnection *c )
     CONNECTION_LOCK(c);
     if ( needle.o_upstream_msgid == 0 ) {
         return handle_unsolicited( c, ber );
-    } else if ( !( op = ldap_tavl_find(
-                           c->c_ops, &needle, operation_upstream_cmp ) ) ) {
+    } else if ( !( op = operation_table_find( &c->c_ops, &needle ) ) ) {
         /* Already abandoned, do nothing */
         CONNECTION_UNLOCK(c);
         ber_free( ber, 1 );
@@ -326,6 +338,8 @@ handle_one_response( LloadConnection *c )
 
             __atomic_add_fetch( &b->b_operation_count, 1, __ATOMIC_RELAXED );
             __atomic_add_fetch( &b->b_operation_time, diff, __ATOMIC_RELAXED );
+            __atomic_add_fetch( &b->b_rtt_count, 1, __ATOMIC_RELAXED );
+            __atomic_add_fetch( &b->b_rtt_time, diff, __ATOMIC_RELAXED );
         }
         op->o_last_response = tv;
 
@@ -860,7 +874,7 @@ fail:
             "connid=%lu failed rc=%d\n",
             c->c_connid, rc );
 
-    assert( c->c_ops == NULL );
+    assert( !c->c_ops.ot_count );
     epoch = epoch_join();
     CONNECTION_DESTROY(c);
     epoch_leave( epoch );
@@ -1001,6 +1015,7 @@ upstream_init(
     }
 
     CONNECTION_LOCK(c);
+    operation_table_init( &c->c_ops, 1 );
     c->c_backend = b;
 #ifdef HAVE_TLS
     c->c_is_tls = b->b_tls;
@@ -1125,7 +1140,8 @@ upstream_unlink( LloadConnection *c )
 {
     LloadBackend *b = c->c_backend;
     struct event *read_event, *write_event;
-    TAvlnode *root, *linked_root;
+    LloadOpTable ops;
+    TAvlnode *linked_root;
     long freed, executing;
 
     Debug( LDAP_DEBUG_CONNS, "upstream_unlink: "
@@ -1141,8 +1157,7 @@ upstream_unlink( LloadConnection *c )
     read_event = c->c_read_event;
     write_event = c->c_write_event;
 
-    root = c->c_ops;
-    c->c_ops = NULL;
+    operation_table_detach( &c->c_ops, &ops );
     executing = c->c_n_ops_executing;
     c->c_n_ops_executing = 0;
 
@@ -1151,7 +1166,7 @@ upstream_unlink( LloadConnection *c )
 
     CONNECTION_UNLOCK(c);
 
-    freed = ldap_tavl_free( root, (AVL_FREE)operation_lost_upstream );
+    freed = operation_table_free( &ops, operation_lost_upstream );
     assert( freed == executing );
 
     ldap_tavl_free( linked_root, (AVL_FREE)linked_upstream_lost );
@@ -1229,7 +1244,7 @@ upstream_destroy( LloadConnection *c )
 
     c->c_state = LLOAD_C_INVALID;
 
-    assert( c->c_ops == NULL );
+    assert( !c->c_ops.ot_count );
 
     if ( c->c_read_event ) {
         event_free( c->c_read_event );
@@ -1560,7 +1560,7 @@ ldif_back_delete( Operation *op, SlapReply *rs )
 
 	ctrls[num_ctrls] = NULL;
 
-	if ( BER_BVISEMPTY( &op->o_csn )) {
+	if ( BER_BVISNULL( &op->o_csn )) {
 		struct berval csn;
 		char csnbuf[LDAP_PVT_CSNSTR_BUFSIZE];
 
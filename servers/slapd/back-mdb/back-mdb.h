@@ -89,6 +89,7 @@ struct mdb_info {
 	void		*mi_search_stack;
 	int			mi_search_stack_depth;
 	int			mi_readers;
+	unsigned	mi_pagecheck;
 
 	unsigned	mi_rtxn_size;
 	int			mi_txn_cp;
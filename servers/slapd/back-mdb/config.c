@@ -41,6 +41,7 @@ enum {
 	MDB_MAXREADERS,
 	MDB_MAXSIZE,
 	MDB_MODE,
+	MDB_PAGECHECK,
 	MDB_SSTACK,
 	MDB_MULTIVAL,
 	MDB_IDLEXP,
@@ -102,6 +103,11 @@ static ConfigTable mdbcfg[] = {
 		"DESC 'Unix permissions of database files' "
 		"EQUALITY caseIgnoreMatch "
 		"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
+	{ "pagecheck", "sample", 2, 2, 0, ARG_UINT|ARG_MAGIC|MDB_PAGECHECK,
+		mdb_cf_gen, "( OLcfgDbAt:12.9 NAME 'olcDbPageCheck' "
+		"DESC 'Verify the checksum of 1 in this many pages read' "
+		"EQUALITY integerMatch "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "multival", "attr> <hi,lo", 3, 3, 0, ARG_MAGIC|MDB_MULTIVAL,
 		mdb_cf_gen,
 		"( OLcfgDbAt:12.6 NAME 'olcDbMultival' "
@@ -153,7 +159,7 @@ static ConfigOCs mdbocs[] = {
 		"MAY ( olcDbCheckpoint $ olcDbEnvFlags "
 		"$ olcDbNoSync $ olcDbIndex $ olcDbMaxReaders $ olcDbMaxSize "
 		"$ olcDbMode $ olcDbSearchStack $ olcDbMaxEntrySize $ olcDbRtxnSize "
-		"$ olcDbMultival "
+		"$ olcDbMultival $ olcDbPageCheck "
 #ifdef MDB_ENCRYPT
 		"$ olcDbCryptoModule $ olcDbPassphrase "
 #endif
@@ -622,6 +628,10 @@ mdb_cf_gen( ConfigArgs *c )
 			c->value_int = mdb->mi_readers;
 			break;
 
+		case MDB_PAGECHECK:
+			c->value_uint = mdb->mi_pagecheck;
+			break;
+
 		case MDB_MAXSIZE:
 			c->value_ulong = mdb->mi_mapsize;
 			break;
@@ -649,6 +659,14 @@ mdb_cf_gen( ConfigArgs *c )
 		case MDB_MAXSIZE:
 			break;
 
+		case MDB_PAGECHECK:
+			mdb->mi_pagecheck = 0;
+			if ( mdb->mi_flags & MDB_IS_OPEN ) {
+				mdb->mi_flags |= MDB_RE_OPEN;
+				config_push_cleanup( c, mdb_cf_cleanup );
+			}
+			break;
+
 		case MDB_CHKPT:
 			if ( mdb->mi_txn_cp_task ) {
 				struct re_s *re = mdb->mi_txn_cp_task;
@@ -1070,6 +1088,14 @@ mdb_cf_gen( ConfigArgs *c )
 		}
 		break;
 
+	case MDB_PAGECHECK:
+		mdb->mi_pagecheck = c->value_uint;
+		if ( mdb->mi_flags & MDB_IS_OPEN ) {
+			mdb->mi_flags |= MDB_RE_OPEN;
+			config_push_cleanup( c, mdb_cf_cleanup );
+		}
+		break;
+
 	case MDB_MULTIVAL:
 		rc = mdb_attr_multi_config( mdb, c->fname, c->lineno,
 			c->argc - 1, &c->argv[1], &c->reply);
@@ -202,6 +202,7 @@ enum {
 	CFG_TLS_CACERT,
 	CFG_TLS_CERT,
 	CFG_TLS_KEY,
+	CFG_CONN_MAX_BATCH,
 
 	CFG_LAST
 };
@@ -358,6 +359,12 @@ static ConfigTable config_back_cf_table[] = {
 		&config_generic, "( OLcfgGlAt:10 NAME 'olcConcurrency' "
 			"EQUALITY integerMatch "
 			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "conn_max_batch", "max", 2, 2, 0, ARG_INT|ARG_MAGIC|CFG_CONN_MAX_BATCH,
+		&config_generic, "( OLcfgGlAt:105 NAME 'olcConnMaxBatch' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL,
+			{ .v_int = SLAP_CONN_MAX_BATCH_DEFAULT }
+	},
 	{ "conn_max_pending", "max", 2, 2, 0, ARG_INT,
 		&slap_conn_max_pending, "( OLcfgGlAt:11 NAME 'olcConnMaxPending' "
 			"EQUALITY integerMatch "
@@ -992,7 +999,7 @@ static ConfigOCs cf_ocs[] = {
 		"MAY ( cn $ olcConfigFile $ olcConfigDir $ olcAllows $ olcArgsFile $ "
 		 "olcAttributeOptions $ olcAuthIDRewrite $ "
 		 "olcAuthzPolicy $ olcAuthzRegexp $ olcConcurrency $ "
-		 "olcConnMaxPending $ olcConnMaxPendingAuth $ "
+		 "olcConnMaxBatch $ olcConnMaxPending $ olcConnMaxPendingAuth $ "
 		 "olcDisallows $ olcGentleHUP $ olcIdleTimeout $ "
 		 "olcIndexSubstrIfMaxLen $ olcIndexSubstrIfMinLen $ "
 		 "olcIndexSubstrAnyLen $ olcIndexSubstrAnyStep $ olcIndexHash64 $ "
@@ -1163,6 +1170,9 @@ config_generic(ConfigArgs *c) {
 		case CFG_TTHREADS:
 			c->value_int = slap_tool_thread_max;
 			break;
+		case CFG_CONN_MAX_BATCH:
+			c->value_int = slap_conn_max_batch;
+			break;
 		case CFG_LTHREADS:
 			c->value_uint = slapd_daemon_threads;
 			break;
@@ -1525,6 +1535,10 @@ config_generic(ConfigArgs *c) {
 			slap_tool_thread_max = 1;
 			break;
 
+		case CFG_CONN_MAX_BATCH:
+			slap_conn_max_batch = SLAP_CONN_MAX_BATCH_DEFAULT;
+			break;
+
 		case CFG_LTHREADS:
 			new_daemon_threads = 1;
 			config_push_cleanup( c, config_resize_lthreads );
@@ -1991,6 +2005,18 @@ config_generic(ConfigArgs *c) {
 			slap_tool_thread_max = c->value_int;	/* save for reference */
 			break;
 
+		case CFG_CONN_MAX_BATCH:
+			if ( c->value_int < 1 || c->value_int > SLAP_CONN_MAX_BATCH_LIMIT ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"conn_max_batch=%d must be between 1 and %d",
+					c->value_int, SLAP_CONN_MAX_BATCH_LIMIT );
+				Debug(LDAP_DEBUG_ANY, "%s: %s.\n",
+					c->log, c->cr_msg );
+				return 1;
+			}
+			slap_conn_max_batch = c->value_int;
+			break;
+
 		case CFG_LTHREADS:
 			if ( c->value_uint < 1 ) {
 				snprintf( c->cr_msg, sizeof( c->cr_msg ),
@@ -0,0 +1,94 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1998-2024 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/socket.h>
+#include <ac/string.h>
+
+#include "slap.h"
+#include "lber_pvt.h"
+
+const struct berval slap_EXOP_START_COMPRESS = BER_BVC(LDAP_EXOP_X_START_COMPRESS);
+
+#ifdef HAVE_ZLIB
+int
+compress_extop( Operation *op, SlapReply *rs )
+{
+	ber_int_t level = -1;
+	int rc;
+
+	if ( op->ore_reqdata != NULL ) {
+		BerElementBuffer berbuf;
+		BerElement *ber = (BerElement *)&berbuf;
+
+		ber_init2( ber, op->ore_reqdata, 0 );
+		if ( ber_scanf( ber, "i", &level ) == LBER_ERROR ) {
+			rs->sr_text = "compression level decoding error";
+			return LDAP_PROTOCOL_ERROR;
+		}
+		if ( level < -1 || level > 9 ) {
+			rs->sr_text = "invalid compression level";
+			return LDAP_PROTOCOL_ERROR;
+		}
+	}
+
+	Debug( LDAP_DEBUG_STATS, "%s STARTCOMPRESS level=%d\n",
+	    op->o_log_prefix, (int)level );
+
+	/* inflating costs the server memory and CPU, don't offer it to anyone */
+	if ( BER_BVISEMPTY( &op->o_ndn ) ) {
+		rs->sr_text = "compression requires an authenticated session";
+		return LDAP_STRONG_AUTH_REQUIRED;
+	}
+
+	/* acquire connection lock */
+	ldap_pvt_thread_mutex_lock( &op->o_conn->c_mutex );
+
+	if ( op->o_conn->c_needs_compress || op->o_conn->c_sasl_layers ||
+		ber_sockbuf_ctrl( op->o_conn->c_sb, LBER_SB_OPT_HAS_IO,
+			&ldap_pvt_sockbuf_io_sasl_generic ) )
+	{
+		rs->sr_text = "compression or security layer already in place";
+		rc = LDAP_OPERATIONS_ERROR;
+		goto done;
+	}
+
+	/* the layer must not start in the middle of another response */
+	if (( !LDAP_STAILQ_EMPTY(&op->o_conn->c_ops) &&
+			(LDAP_STAILQ_FIRST(&op->o_conn->c_ops) != op ||
+			LDAP_STAILQ_NEXT(op, o_next) != NULL)) ||
+		( !LDAP_STAILQ_EMPTY(&op->o_conn->c_pending_ops) ))
+	{
+		rs->sr_text = "cannot start compression when operations are outstanding";
+		rc = LDAP_OPERATIONS_ERROR;
+		goto done;
+	}
+
+	/* installed by connection_read() once our response is out */
+	op->o_conn->c_needs_compress = 1;
+	op->o_conn->c_compress_level = level;
+
+	rc = LDAP_SUCCESS;
+
+done:
+	/* give up connection lock */
+	ldap_pvt_thread_mutex_unlock( &op->o_conn->c_mutex );
+
+	return rc;
+}
+
+#endif	/* HAVE_ZLIB */
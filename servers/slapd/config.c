@@ -83,6 +83,7 @@ ber_len_t sockbuf_max_incoming_auth= SLAP_SB_MAX_INCOMING_AUTH;
 
 int	slap_conn_max_pending = SLAP_CONN_MAX_PENDING_DEFAULT;
 int	slap_conn_max_pending_auth = SLAP_CONN_MAX_PENDING_AUTH;
+int	slap_conn_max_batch = SLAP_CONN_MAX_BATCH_DEFAULT;
 
 int	slap_max_filter_depth = SLAP_MAX_FILTER_DEPTH_DEFAULT;
 
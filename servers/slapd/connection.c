@@ -76,7 +76,9 @@ typedef struct conn_readinfo {
 	ldap_pvt_thread_start_t *func;
 	void *arg;
 	void *ctx;
-	int nullop;
+	int nbatch;
+	int more;
+	Operation *batch[SLAP_CONN_MAX_BATCH_LIMIT];
 } conn_readinfo;
 
 static int connection_input( Connection *c, conn_readinfo *cri );
@@ -527,6 +529,7 @@ Connection * connection_init(
 
 	c->c_ssf = c->c_transport_ssf = ssf;
 	c->c_tls_ssf = c->c_sasl_ssf = 0;
+	c->c_needs_compress = 0;
 
 #ifdef HAVE_TLS
 	if ( flags & CONN_IS_TLS ) {
@@ -1259,22 +1262,55 @@ static int connection_read( ber_socket_t s, conn_readinfo *cri );
 
 static void* connection_read_thread( void* ctx, void* argv )
 {
-	int rc ;
-	conn_readinfo cri = { NULL, NULL, NULL, NULL, 0 };
+	int i, rc ;
+	conn_readinfo cri;
 	ber_socket_t s = (long)argv;
 
 	/*
 	 * read incoming LDAP requests. If there is more than one,
-	 * the first one is returned with new_op
+	 * the first one is returned with new_op and the rest are
+	 * collected in the batch.
 	 */
+	cri.op = NULL;
+	cri.func = NULL;
+	cri.arg = NULL;
 	cri.ctx = ctx;
+	cri.nbatch = 0;
+	cri.more = 0;
 	if( ( rc = connection_read( s, &cri ) ) < 0 ) {
 		Debug( LDAP_DEBUG_CONNS, "connection_read(%d) error\n", s );
 		return (void*)(long)rc;
 	}
 
-	/* execute a single queued request in the same thread */
-	if( cri.op && !cri.nullop ) {
+	/* hand the rest of the batch to the pool, now that the
+	 * connection is no longer locked
+	 */
+	for ( i = 0; i < cri.nbatch; i++ ) {
+		rc = ldap_pvt_thread_pool_submit( &connection_pool,
+			connection_operation, (void *) cri.batch[i] );
+		if ( rc != 0 ) {
+			Debug( LDAP_DEBUG_ANY,
+				"connection_read_thread: submit failed (%d) for conn=%lu\n",
+				rc, cri.batch[i]->o_connid );
+		}
+	}
+
+	/* the fairness cap was hit with input still buffered, come back
+	 * for it after whatever else is queued in the pool
+	 */
+	if ( cri.more ) {
+		rc = ldap_pvt_thread_pool_submit( &connection_pool,
+			connection_read_thread, (void *)(long)s );
+		if ( rc != 0 ) {
+			Debug( LDAP_DEBUG_ANY,
+				"connection_read_thread(%d): resubmit failed (%d)\n",
+				s, rc );
+			slapd_set_read( s, 1 );
+		}
+	}
+
+	/* execute the first queued request in the same thread */
+	if( cri.op ) {
 		rc = (long)connection_operation( ctx, cri.op );
 	} else if ( cri.func ) {
 		rc = (long)cri.func( ctx, cri.arg );
@@ -1311,7 +1347,7 @@ int connection_read_activate( ber_socket_t s )
 static int
 connection_read( ber_socket_t s, conn_readinfo *cri )
 {
-	int rc = 0;
+	int rc = 0, npdu;
 	Connection *c;
 
 	assert( connections != NULL );
@@ -1440,12 +1476,46 @@ connection_read( ber_socket_t s, conn_readinfo *cri )
 	}
 #endif
 
+#ifdef HAVE_ZLIB
+	if ( c->c_needs_compress ) {
+		c->c_needs_compress = 0;
+
+		rc = ldap_pvt_compress_install( c->c_sb, c->c_compress_level );
+		if( rc != LDAP_SUCCESS ) {
+			Debug( LDAP_DEBUG_TRACE,
+				"connection_read(%d): compression install error "
+				"error=%d id=%lu, closing\n",
+				s, rc, c->c_connid );
+
+			/* c_mutex is locked */
+			connection_closing( c, "compression layer install failure" );
+			connection_close( c );
+			connection_return( c );
+			return 0;
+		}
+	}
+#endif
+
 #define CONNECTION_INPUT_LOOP 1
 /* #define	DATA_READY_LOOP 1 */
 
+	/* Drain every complete PDU already available, but no more than
+	 * conn_max_batch of them, so a pipelining client cannot keep
+	 * this thread to itself.
+	 */
+	npdu = 0;
 	do {
 		/* How do we do this without getting into a busy loop ? */
 		rc = connection_input( c, cri );
+		if ( !rc && ++npdu >= slap_conn_max_batch ) {
+			/* DATA_READY only sees what a sockbuf layer has
+			 * buffered, a plain socket may have more queued in
+			 * the kernel. If there is nothing, the next pass
+			 * just gets EWOULDBLOCK and rearms the descriptor.
+			 */
+			cri->more = 1;
+			break;
+		}
 	}
 #ifdef DATA_READY_LOOP
 	while( !rc && ber_sockbuf_ctrl( c->c_sb, LBER_SB_OPT_DATA_READY, NULL ));
@@ -1471,7 +1541,9 @@ connection_read( ber_socket_t s, conn_readinfo *cri )
 		slapd_set_write( s, 0 );
 	}
 
-	slapd_set_read( s, 1 );
+	/* when more input is already buffered, the caller resubmits us */
+	if ( !cri->more )
+		slapd_set_read( s, 1 );
 	connection_return( c );
 
 	return 0;
@@ -1713,22 +1785,17 @@ connection_input( Connection *conn , conn_readinfo *cri )
 		conn->c_n_ops_executing++;
 
 		/*
-		 * The first op will be processed in the same thread context,
-		 * as long as there is only one op total.
-		 * Subsequent ops will be submitted to the pool by
-		 * calling connection_op_activate()
+		 * The first op will be processed in the same thread context.
+		 * Subsequent ops are collected in the batch and submitted
+		 * to the pool by connection_read_thread() once the
+		 * connection has been released.
 		 */
+		connection_op_queue( op );
 		if ( cri->op == NULL ) {
 			/* the first incoming request */
-			connection_op_queue( op );
 			cri->op = op;
 		} else {
-			if ( !cri->nullop ) {
-				cri->nullop = 1;
-				rc = ldap_pvt_thread_pool_submit( &connection_pool,
-					connection_operation, (void *) cri->op );
-			}
-			connection_op_activate( op );
+			cri->batch[cri->nbatch++] = op;
 		}
 	}
 
@@ -63,6 +63,9 @@ static struct {
 	{ &slap_EXOP_CANCEL, 0, cancel_extop },
 	{ &slap_EXOP_WHOAMI, 0, whoami_extop },
 	{ &slap_EXOP_MODIFY_PASSWD, SLAP_EXOP_WRITES, passwd_extop },
+#ifdef HAVE_ZLIB
+	{ &slap_EXOP_START_COMPRESS, 0, compress_extop },
+#endif
 	{ NULL, 0, NULL }
 };
 
@@ -34,6 +34,7 @@
 #include "slap-config.h"
 #include "lutil.h"
 #include "ldap_rq.h"
+#include "../back-monitor/back-monitor.h"
 
 #define LOG_OP_ADD	0x001
 #define LOG_OP_DELETE	0x002
@@ -65,6 +66,24 @@ typedef struct log_base {
 	struct berval lb_line;
 } log_base;
 
+/* A client waiting for its queued log writes with logqueue sync */
+typedef struct log_wait {
+	unsigned long lw_seq;	/* last record it queued */
+	int lw_err;		/* first failure among its records */
+} log_wait;
+
+/* A log write waiting for the queue writer */
+typedef struct log_rec {
+	struct log_rec *lr_next;
+	Entry *lr_e;		/* log entry to add, or */
+	Modifications *lr_mod;	/* change to the log's root entry */
+	struct berval lr_csn;
+	time_t lr_time;
+	int lr_tincr;
+	int lr_err;
+	log_wait *lr_wait;	/* NULL if nobody waits for the result */
+} log_rec;
+
 typedef struct log_info {
 	BackendDB *li_db;
 	struct berval li_db_suffix;
@@ -73,6 +92,7 @@ typedef struct log_info {
 	slap_mask_t li_ops;
 	int li_age;
 	int li_cycle;
+	int li_purgechunk;
 	struct re_s *li_task;
 	Filter *li_oldf;
 	Entry *li_old;
@@ -83,6 +103,30 @@ typedef struct log_info {
 	BerVarray li_mincsn;
 	int *li_sids, li_numcsns;
 
+	/* purge progress, for cn=monitor */
+	unsigned long li_purged;	/* entries deleted since startup */
+	unsigned long li_purgerun;	/* entries deleted by the current/last run */
+	time_t li_purgelast;	/* end of the last complete run */
+	void *li_monitor_cb;
+	struct berval li_monitor_ndn;
+
+	/*
+	 * With logqueue, log writes are appended to this queue and written
+	 * out in batches by whichever thread holds li_qbusy: the writer task,
+	 * or a client waiting for its record or for room in the queue.
+	 */
+	int li_qmax;		/* 0 if writes are done inline */
+	int li_qasync;		/* don't wait for the commit */
+	int li_qlen;
+	int li_qbusy;
+	int li_qtask;
+	void *li_qcookie;
+	unsigned long li_qseq;	/* records queued since startup */
+	unsigned long li_qdone;	/* records written out since startup */
+	log_rec *li_qhead, **li_qtail;
+	ldap_pvt_thread_mutex_t li_qmutex;
+	ldap_pvt_thread_cond_t li_qcond;
+
 	/*
 	 * Allow partial concurrency, main operation processing serialised with
 	 * li_op_rmutex (there might be multiple such in progress by the same
@@ -106,7 +150,9 @@ enum {
 	LOG_SUCCESS,
 	LOG_OLD,
 	LOG_OLDATTR,
-	LOG_BASE
+	LOG_BASE,
+	LOG_PURGECHUNK,
+	LOG_QUEUE
 };
 
 static ConfigTable log_cfats[] = {
@@ -147,6 +193,16 @@ static ConfigTable log_cfats[] = {
 			"DESC 'Operation types to log under a specific branch' "
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "logpurgechunk", "entries", 2, 2, 0, ARG_MAGIC|ARG_INT|LOG_PURGECHUNK,
+		log_cf_gen, "( OLcfgOvAt:4.8 NAME 'olcAccessLogPurgeChunk' "
+			"DESC 'Number of log entries deleted per purge transaction' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "logqueue", "entries> <sync|async", 2, 3, 0, ARG_MAGIC|LOG_QUEUE,
+		log_cf_gen, "( OLcfgOvAt:4.9 NAME 'olcAccessLogQueue' "
+			"DESC 'Queue log writes and commit them in batches' "
+			"EQUALITY caseIgnoreMatch "
+			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
 	{ NULL }
 };
 
@@ -157,7 +213,8 @@ static ConfigOCs log_cfocs[] = {
 		"SUP olcOverlayConfig "
 		"MUST olcAccessLogDB "
 		"MAY ( olcAccessLogOps $ olcAccessLogPurge $ olcAccessLogSuccess $ "
-			"olcAccessLogOld $ olcAccessLogOldAttr $ olcAccessLogBase ) )",
+			"olcAccessLogOld $ olcAccessLogOldAttr $ olcAccessLogBase $ "
+			"olcAccessLogPurgeChunk $ olcAccessLogQueue ) )",
 			Cft_Overlay, log_cfats },
 	{ NULL }
 };
@@ -216,7 +273,10 @@ static AttributeDescription *ad_reqDN, *ad_reqStart, *ad_reqEnd, *ad_reqType,
 	*ad_reqSizeLimit, *ad_reqTimeLimit, *ad_reqAttrsOnly, *ad_reqData,
 	*ad_reqId, *ad_reqMessage, *ad_reqVersion, *ad_reqDerefAliases,
 	*ad_reqReferral, *ad_reqOld, *ad_auditContext, *ad_reqEntryUUID,
-	*ad_minCSN, *ad_reqNewDN;
+	*ad_minCSN, *ad_reqNewDN, *ad_purgedEntries, *ad_purgeRunEntries,
+	*ad_lastPurge;
+
+static ObjectClass *oc_olmAccessLog;
 
 static int
 logSchemaControlValidate(
@@ -449,6 +509,30 @@ static struct {
 		"EQUALITY distinguishedNameMatch "
 		"SYNTAX OMsDN "
 		"SINGLE-VALUE )", &ad_reqNewDN },
+
+	/* purge progress in cn=monitor */
+	{ "( " LOG_SCHEMA_AT ".34 NAME 'olmAccessLogPurgedEntries' "
+		"DESC 'Number of log entries purged since startup' "
+		"EQUALITY integerMatch "
+		"SYNTAX 1.3.6.1.4.1.1466.115.121.1.27 "
+		"SINGLE-VALUE "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )", &ad_purgedEntries },
+	{ "( " LOG_SCHEMA_AT ".35 NAME 'olmAccessLogPurgeRunEntries' "
+		"DESC 'Number of log entries purged by the current or last purge' "
+		"EQUALITY integerMatch "
+		"SYNTAX 1.3.6.1.4.1.1466.115.121.1.27 "
+		"SINGLE-VALUE "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )", &ad_purgeRunEntries },
+	{ "( " LOG_SCHEMA_AT ".36 NAME 'olmAccessLogLastPurge' "
+		"DESC 'Time the last complete purge finished' "
+		"EQUALITY generalizedTimeMatch "
+		"ORDERING generalizedTimeOrderingMatch "
+		"SYNTAX 1.3.6.1.4.1.1466.115.121.1.24 "
+		"SINGLE-VALUE "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )", &ad_lastPurge },
 	{ NULL, NULL }
 };
 
@@ -513,6 +597,12 @@ static struct {
 		"DESC 'Extended operation' "
 		"SUP auditObject STRUCTURAL "
 		"MAY reqData )", &log_ocs[LOG_EN_EXTENDED] },
+	/* augments the monitor entry of the database */
+	{ "( " LOG_SCHEMA_OC ".13 NAME 'olmAccessLog' "
+		"DESC 'Accesslog purge progress' "
+		"SUP top AUXILIARY "
+		"MAY ( olmAccessLogPurgedEntries $ olmAccessLogPurgeRunEntries $ "
+			"olmAccessLogLastPurge ) )", &oc_olmAccessLog },
 	{ NULL, NULL }
 };
 
@@ -624,9 +714,11 @@ log_age_unparse( int age, struct berval *agebv, size_t size )
 static slap_callback nullsc;
 
 #define PURGE_INCREMENT	100
+#define PURGE_CHUNK	1000
 
 typedef struct purge_data {
 	struct log_info *li;
+	int limit;
 	int slots;
 	int used;
 	int mincsn_updated;
@@ -645,6 +737,9 @@ log_old_lookup( Operation *op, SlapReply *rs )
 
 	if ( slapd_shutdown ) return 0;
 
+	/* this chunk is full, stop the search */
+	if ( pd->used >= pd->limit ) return LDAP_SIZELIMIT_EXCEEDED;
+
 	/* Update minCSN */
 	a = attr_find( rs->sr_entry->e_attrs,
 		slap_schema.si_ad_entryCSN );
@@ -686,7 +781,12 @@ log_old_lookup( Operation *op, SlapReply *rs )
 	return 0;
 }
 
-/* Periodically search for old entries in the log database and delete them */
+/* Periodically search for old entries in the log database and delete them.
+ * They are handled in chunks of logpurgechunk entries, oldest first, and
+ * each chunk is deleted in a single transaction if the log database
+ * supports it. Memory use stays bounded and writers to the log only
+ * wait for one chunk at a time.
+ */
 static void *
 accesslog_purge( void *ctx, void *arg )
 {
@@ -700,10 +800,12 @@ accesslog_purge( void *ctx, void *arg )
 	slap_callback cb = { NULL, log_old_lookup, NULL, NULL, NULL };
 	Filter f;
 	AttributeAssertion ava = ATTRIBUTEASSERTION_INIT;
+	struct berval filterstr;
 	purge_data pd = { .li = li };
 	char timebuf[LDAP_LUTIL_GENTIME_BUFSIZE];
-	char csnbuf[LDAP_PVT_CSNSTR_BUFSIZE];
 	time_t old = slap_get_time();
+	int chunk = li->li_purgechunk ? li->li_purgechunk : PURGE_CHUNK;
+	int rc = LDAP_SUCCESS;
 
 	connection_fake_init( &conn, &opbuf, ctx );
 	op = &opbuf.ob_op;
@@ -719,38 +821,63 @@ accesslog_purge( void *ctx, void *arg )
 	old -= li->li_age;
 	slap_timestamp( &old, &ava.aa_value );
 
-	op->o_tag = LDAP_REQ_SEARCH;
 	op->o_bd = li->li_db;
 	op->o_dn = li->li_db->be_rootdn;
 	op->o_ndn = li->li_db->be_rootndn;
-	op->o_req_dn = li->li_db->be_suffix[0];
-	op->o_req_ndn = li->li_db->be_nsuffix[0];
-	op->o_callback = &cb;
-	op->ors_scope = LDAP_SCOPE_ONELEVEL;
-	op->ors_deref = LDAP_DEREF_NEVER;
-	op->ors_tlimit = SLAP_NO_LIMIT;
-	op->ors_slimit = SLAP_NO_LIMIT;
-	op->ors_filter = &f;
-	filter2bv_x( op, &f, &op->ors_filterstr );
-	op->ors_attrs = slap_anlist_no_attrs;
-	op->ors_attrsonly = 1;
-	
+	filter2bv_x( op, &f, &filterstr );
+
 	cb.sc_private = &pd;
+	pd.limit = chunk;
 
-	op->o_bd->be_search( op, &rs );
-	op->o_tmpfree( op->ors_filterstr.bv_val, op->o_tmpmemctx );
+	ldap_pvt_thread_mutex_lock( &li->li_log_mutex );
+	li->li_purgerun = 0;
+	ldap_pvt_thread_mutex_unlock( &li->li_log_mutex );
 
-	if ( pd.used ) {
-		int i;
+	while ( !slapd_shutdown ) {
+		OpExtra *txn = NULL;
+		unsigned long deleted = 0;
+		int i, err = LDAP_SUCCESS;
+
+		/* the minCSN update of the last chunk overwrote these */
+		op->o_tag = LDAP_REQ_SEARCH;
+		op->o_req_dn = li->li_db->be_suffix[0];
+		op->o_req_ndn = li->li_db->be_nsuffix[0];
+		op->ors_scope = LDAP_SCOPE_ONELEVEL;
+		op->ors_deref = LDAP_DEREF_NEVER;
+		op->ors_tlimit = SLAP_NO_LIMIT;
+		op->ors_slimit = SLAP_NO_LIMIT;
+		op->ors_filter = &f;
+		op->ors_filterstr = filterstr;
+		op->ors_attrs = slap_anlist_no_attrs;
+		op->ors_attrsonly = 1;
+		op->o_callback = &cb;
+		op->o_dont_replicate = 0;
+		BER_BVZERO( &op->o_csn );
+		pd.used = 0;
+		pd.mincsn_updated = 0;
+
+		rs_reinit( &rs, REP_RESULT );
+		op->o_bd->be_search( op, &rs );
+		if ( !pd.used )
+			break;
 
 		op->o_callback = &nullsc;
 		op->o_dont_replicate = 1;
 		op->o_csn = slap_empty_bv;
 
+		/* Writers to the log take li_log_mutex before the log database,
+		 * start the transaction in the same order */
+		ldap_pvt_thread_mutex_lock( &li->li_log_mutex );
+		if ( SLAP_TXNS( op->o_bd ) &&
+			op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_BEGIN, &txn ) ) {
+			Debug( LDAP_DEBUG_ANY, "accesslog_purge: "
+				"couldn't start DB transaction\n" );
+			txn = NULL;
+		}
+
 		if ( pd.mincsn_updated ) {
 			Modifications mod;
 			/* update context's minCSN to reflect oldest CSN */
-			ldap_pvt_thread_mutex_lock( &li->li_log_mutex );
 			mod.sml_numvals = li->li_numcsns;
 			mod.sml_values = li->li_mincsn;
 			mod.sml_nvalues = li->li_mincsn;
@@ -770,26 +897,79 @@ accesslog_purge( void *ctx, void *arg )
 				Debug( LDAP_DEBUG_SYNC, "accesslog_purge: "
 						"updating minCSN with %d values\n",
 						li->li_numcsns );
+				rs_reinit( &rs, REP_RESULT );
 				op->o_bd->be_modify( op, &rs );
 			}
-			ldap_pvt_thread_mutex_unlock( &li->li_log_mutex );
 		}
+		ldap_pvt_thread_mutex_unlock( &li->li_log_mutex );
 
 		/* delete the expired entries */
 		op->o_tag = LDAP_REQ_DELETE;
 		for (i=0; i<pd.used; i++) {
 			op->o_req_dn = pd.dn[i];
 			op->o_req_ndn = pd.ndn[i];
-			if ( !slapd_shutdown ) {
+			if ( rc == LDAP_SUCCESS && !slapd_shutdown ) {
 				rs_reinit( &rs, REP_RESULT );
 				op->o_bd->be_delete( op, &rs );
+				if ( rs.sr_err == LDAP_SUCCESS )
+					deleted++;
+				else if ( rs.sr_err != LDAP_NO_SUCH_OBJECT ) {
+					if ( txn )
+						rc = rs.sr_err;
+					else
+						err = rs.sr_err;
+				}
 			}
 			ch_free( pd.ndn[i].bv_val );
 			ch_free( pd.dn[i].bv_val );
+			if ( !txn )
+				ldap_pvt_thread_pool_pausewait( &connection_pool );
+		}
+
+		if ( txn ) {
+			LDAP_SLIST_REMOVE( &op->o_extra, txn, OpExtra, oe_next );
+			if ( rc == LDAP_SUCCESS && !slapd_shutdown ) {
+				rc = op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_COMMIT, &txn );
+			} else {
+				op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_ABORT, &txn );
+				if ( rc == LDAP_SUCCESS )
+					rc = LDAP_UNAVAILABLE;
+			}
+			if ( rc != LDAP_SUCCESS )
+				deleted = 0;
 			ldap_pvt_thread_pool_pausewait( &connection_pool );
+		} else if ( !deleted && err != LDAP_SUCCESS ) {
+			/* the next search would find the same entries again */
+			rc = err;
+		}
+
+		ldap_pvt_thread_mutex_lock( &li->li_log_mutex );
+		li->li_purged += deleted;
+		li->li_purgerun += deleted;
+		ldap_pvt_thread_mutex_unlock( &li->li_log_mutex );
+
+		if ( rc != LDAP_SUCCESS ) {
+			if ( !slapd_shutdown )
+				Debug( LDAP_DEBUG_ANY, "accesslog_purge: "
+					"purge of %d entries failed (%d), "
+					"retrying on the next run\n", pd.used, rc );
+			break;
 		}
-		ch_free( pd.ndn );
-		ch_free( pd.dn );
+		Debug( LDAP_DEBUG_SYNC, "accesslog_purge: "
+			"deleted %lu entries\n", deleted );
+
+		/* this was the last chunk */
+		if ( pd.used < chunk )
+			break;
+	}
+	op->o_tmpfree( filterstr.bv_val, op->o_tmpmemctx );
+	ch_free( pd.ndn );
+	ch_free( pd.dn );
+
+	if ( rc == LDAP_SUCCESS && !slapd_shutdown ) {
+		ldap_pvt_thread_mutex_lock( &li->li_log_mutex );
+		li->li_purgelast = slap_get_time();
+		ldap_pvt_thread_mutex_unlock( &li->li_log_mutex );
 	}
 
 	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
@@ -799,6 +979,328 @@ accesslog_purge( void *ctx, void *arg )
 	return NULL;
 }
 
+/* Write one queued record, returns the result */
+static int
+accesslog_log_rec( Operation *op, log_rec *lr )
+{
+	SlapReply rs = {REP_RESULT};
+	char csnbuf[LDAP_PVT_CSNSTR_BUFSIZE];
+
+	op->o_time = lr->lr_time;
+	op->o_tincr = lr->lr_tincr;
+
+	if ( lr->lr_e ) {
+		op->o_tag = LDAP_REQ_ADD;
+		op->o_req_dn = lr->lr_e->e_name;
+		op->o_req_ndn = lr->lr_e->e_nname;
+		op->ora_e = lr->lr_e;
+		op->ora_modlist = NULL;
+		op->o_csn.bv_val = csnbuf;
+		op->o_csn.bv_len = sizeof(csnbuf);
+		if ( BER_BVISNULL( &lr->lr_csn ))
+			BER_BVZERO( &op->o_csn );
+		else
+			slap_queue_csn( op, &lr->lr_csn );
+		op->o_bd->be_add( op, &rs );
+		if ( op->ora_e != lr->lr_e ) {
+			/* someone else owns it now */
+			lr->lr_e = NULL;
+		}
+	} else {
+		op->o_tag = LDAP_REQ_MODIFY;
+		op->o_req_dn = op->o_bd->be_suffix[0];
+		op->o_req_ndn = op->o_bd->be_nsuffix[0];
+		op->orm_modlist = lr->lr_mod;
+		op->orm_no_opattrs = 1;
+		op->o_csn = lr->lr_csn;
+		op->o_bd->be_modify( op, &rs );
+		op->orm_modlist = NULL;
+	}
+	BER_BVZERO( &op->o_csn );
+
+	if ( rs.sr_err != LDAP_SUCCESS ) {
+		Debug( LDAP_DEBUG_SYNC, "accesslog_log_write: "
+			"got result 0x%x writing log entry %s\n",
+			rs.sr_err, op->o_req_dn.bv_val );
+	}
+	return rs.sr_err;
+}
+
+/* Write a batch of queued records, in one transaction if possible.
+ * If the transaction can't be committed, every record is written again
+ * on its own so that one bad record doesn't cost the others. A syncprov
+ * on the log DB would send out records the transaction may still drop,
+ * they are never batched then.
+ */
+static void
+accesslog_log_write( log_info *li, void *ctx, log_rec *lr, int n )
+{
+	Connection conn = {0};
+	OperationBuffer opbuf;
+	Operation *op;
+	OpExtra *txn = NULL;
+	log_rec *head = lr, *next;
+	int rc = LDAP_SUCCESS, done = 0;
+
+	/* we may be running in a client's thread, keep its memory context */
+	connection_fake_init2( &conn, &opbuf, ctx, 0 );
+	op = &opbuf.ob_op;
+	op->o_bd = li->li_db;
+	op->o_dn = li->li_db->be_rootdn;
+	op->o_ndn = li->li_db->be_rootndn;
+	op->o_callback = &nullsc;
+
+	if ( n > 1 && SLAP_TXNS( op->o_bd ) &&
+		!overlay_is_inst( op->o_bd, "syncprov" ) &&
+		op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_BEGIN, &txn ) ) {
+		Debug( LDAP_DEBUG_ANY, "accesslog_log_write: "
+			"couldn't start DB transaction\n" );
+		txn = NULL;
+	}
+
+	if ( txn ) {
+		for ( lr = head; lr; lr = lr->lr_next ) {
+			lr->lr_err = accesslog_log_rec( op, lr );
+			/* an internal error may have left a partial write behind,
+			 * don't commit the transaction */
+			if ( lr->lr_err == LDAP_OTHER ) {
+				rc = LDAP_OTHER;
+				break;
+			}
+		}
+
+		LDAP_SLIST_REMOVE( &op->o_extra, txn, OpExtra, oe_next );
+		if ( rc == LDAP_SUCCESS ) {
+			rc = op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_COMMIT, &txn );
+		} else {
+			op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_ABORT, &txn );
+		}
+		if ( rc != LDAP_SUCCESS ) {
+			Debug( LDAP_DEBUG_ANY, "accesslog_log_write: "
+				"transaction for %d queued log entries failed (%d), "
+				"writing them one at a time\n", n, rc );
+		} else {
+			Debug( LDAP_DEBUG_SYNC, "accesslog_log_write: "
+				"committed %d log entries\n", n );
+			done = 1;
+		}
+	}
+
+	if ( !done ) {
+		for ( lr = head; lr; lr = lr->lr_next ) {
+			if ( lr->lr_e || lr->lr_mod ) {
+				lr->lr_err = accesslog_log_rec( op, lr );
+			} else {
+				/* the backend kept the entry of the aborted write,
+				 * there's nothing left to write again */
+				Debug( LDAP_DEBUG_ANY, "accesslog_log_write: "
+					"queued log entry lost in failed transaction\n" );
+				lr->lr_err = LDAP_OTHER;
+			}
+		}
+	}
+
+	for ( lr = head; lr; lr = next ) {
+		next = lr->lr_next;
+		if ( lr->lr_wait && lr->lr_err != LDAP_SUCCESS &&
+				lr->lr_wait->lw_err == LDAP_SUCCESS )
+			lr->lr_wait->lw_err = lr->lr_err;
+		if ( lr->lr_e )
+			entry_free( lr->lr_e );
+		else
+			slap_mods_free( lr->lr_mod, 1 );
+		ch_free( lr->lr_csn.bv_val );
+		ch_free( lr );
+	}
+}
+
+/* Write out the queue until it is empty or record seq has been written.
+ * Called with li_qmutex held and nobody else writing, the mutex is
+ * released while the records are being written.
+ */
+static void
+accesslog_log_flush( log_info *li, void *ctx, unsigned long seq )
+{
+	log_rec *lr;
+	int n;
+
+	li->li_qbusy = 1;
+	while ( li->li_qhead && ( !seq || li->li_qdone < seq )) {
+		lr = li->li_qhead;
+		n = li->li_qlen;
+		li->li_qhead = NULL;
+		li->li_qtail = &li->li_qhead;
+		li->li_qlen = 0;
+		/* there's room in the queue again */
+		ldap_pvt_thread_cond_broadcast( &li->li_qcond );
+		ldap_pvt_thread_mutex_unlock( &li->li_qmutex );
+
+		accesslog_log_write( li, ctx, lr, n );
+
+		ldap_pvt_thread_mutex_lock( &li->li_qmutex );
+		li->li_qdone += n;
+		ldap_pvt_thread_cond_broadcast( &li->li_qcond );
+	}
+	li->li_qbusy = 0;
+	ldap_pvt_thread_cond_broadcast( &li->li_qcond );
+}
+
+static void *
+accesslog_log_task( void *ctx, void *arg )
+{
+	log_info *li = arg;
+
+	ldap_pvt_thread_mutex_lock( &li->li_qmutex );
+	li->li_qtask = 0;
+	if ( !li->li_qbusy )
+		accesslog_log_flush( li, ctx, 0 );
+	ldap_pvt_thread_mutex_unlock( &li->li_qmutex );
+
+	return NULL;
+}
+
+/* Make sure the queue gets written out, li_qmutex must be held */
+static void
+accesslog_log_kick( log_info *li, void *ctx )
+{
+	if ( li->li_qbusy || li->li_qtask )
+		return;
+
+	li->li_qtask = 1;
+	if ( ldap_pvt_thread_pool_submit2( &connection_pool,
+			accesslog_log_task, li, &li->li_qcookie ) ) {
+		/* pool is full or shutting down, do it ourselves */
+		li->li_qtask = 0;
+		accesslog_log_flush( li, ctx, 0 );
+	}
+}
+
+/*
+ * Write a log entry (o_tag is LDAP_REQ_ADD) or a change to the log's
+ * root entry (LDAP_REQ_MODIFY). With logqueue the write is queued
+ * instead, and lw is set up if the caller has to wait for it with
+ * accesslog_log_wait() once it has released li_log_mutex; the result
+ * of the write is only known then.
+ *
+ * Must be called with li_log_mutex held so that records are queued in
+ * CSN order.
+ */
+static void
+accesslog_log_op( log_info *li, Operation *op2, SlapReply *rs2,
+	log_wait *lw )
+{
+	log_rec *lr;
+
+	if ( !li->li_qmax ) {
+		if ( op2->o_tag == LDAP_REQ_ADD )
+			op2->o_bd->be_add( op2, rs2 );
+		else
+			op2->o_bd->be_modify( op2, rs2 );
+		return;
+	}
+
+	lr = ch_calloc( 1, sizeof( log_rec ));
+	if ( op2->o_tag == LDAP_REQ_ADD ) {
+		/* the queue owns the entry now */
+		lr->lr_e = op2->ora_e;
+		op2->ora_e = NULL;
+	} else {
+		Modifications *ml = op2->orm_modlist;
+
+		lr->lr_mod = ch_malloc( sizeof( Modifications ));
+		*lr->lr_mod = *ml;
+		lr->lr_mod->sml_next = NULL;
+		ber_bvarray_dup_x( &lr->lr_mod->sml_values, ml->sml_values, NULL );
+		if ( ml->sml_nvalues )
+			ber_bvarray_dup_x( &lr->lr_mod->sml_nvalues, ml->sml_nvalues, NULL );
+	}
+	if ( SLAP_LASTMOD( li->li_db ) && !BER_BVISEMPTY( &op2->o_csn ))
+		ber_dupbv( &lr->lr_csn, &op2->o_csn );
+	lr->lr_time = op2->o_time;
+	lr->lr_tincr = op2->o_tincr;
+
+	ldap_pvt_thread_mutex_lock( &li->li_qmutex );
+	while ( li->li_qlen >= li->li_qmax ) {
+		if ( li->li_qbusy )
+			ldap_pvt_thread_cond_wait( &li->li_qcond, &li->li_qmutex );
+		else
+			accesslog_log_flush( li, op2->o_threadctx, 0 );
+	}
+	*li->li_qtail = lr;
+	li->li_qtail = &lr->lr_next;
+	li->li_qlen++;
+	li->li_qseq++;
+
+	if ( li->li_qasync ) {
+		accesslog_log_kick( li, op2->o_threadctx );
+	} else {
+		lr->lr_wait = lw;
+		lw->lw_seq = li->li_qseq;
+	}
+	ldap_pvt_thread_mutex_unlock( &li->li_qmutex );
+
+	/* queued, accesslog_log_wait() has the outcome */
+	rs2->sr_err = LDAP_SUCCESS;
+}
+
+/* Wait until the queue has been written up to lw's last record,
+ * helping out if nobody else is writing: waiting clients commit as a
+ * group. Returns the first failure among the caller's records.
+ */
+static int
+accesslog_log_wait( log_info *li, log_wait *lw, void *ctx )
+{
+	if ( !lw->lw_seq )
+		return LDAP_SUCCESS;
+
+	ldap_pvt_thread_mutex_lock( &li->li_qmutex );
+	while ( li->li_qdone < lw->lw_seq ) {
+		if ( li->li_qbusy )
+			ldap_pvt_thread_cond_wait( &li->li_qcond, &li->li_qmutex );
+		else
+			accesslog_log_flush( li, ctx, lw->lw_seq );
+	}
+	ldap_pvt_thread_mutex_unlock( &li->li_qmutex );
+
+	return lw->lw_err;
+}
+
+/* Write out everything that's queued, e.g. before reconfiguring */
+static void
+accesslog_log_drain( log_info *li )
+{
+	ldap_pvt_thread_mutex_lock( &li->li_qmutex );
+	while ( li->li_qbusy )
+		ldap_pvt_thread_cond_wait( &li->li_qcond, &li->li_qmutex );
+	if ( li->li_qhead ) {
+		if ( li->li_db && SLAP_DBOPEN( li->li_db )) {
+			accesslog_log_flush( li, ldap_pvt_thread_pool_context(), 0 );
+		} else {
+			log_rec *lr;
+
+			Debug( LDAP_DEBUG_ANY, "accesslog_log_drain: "
+				"log database is closed, dropping %d queued log entries\n",
+				li->li_qlen );
+			while (( lr = li->li_qhead )) {
+				li->li_qhead = lr->lr_next;
+				if ( lr->lr_wait && lr->lr_wait->lw_err == LDAP_SUCCESS )
+					lr->lr_wait->lw_err = LDAP_UNAVAILABLE;
+				if ( lr->lr_e )
+					entry_free( lr->lr_e );
+				else
+					slap_mods_free( lr->lr_mod, 1 );
+				ch_free( lr->lr_csn.bv_val );
+				ch_free( lr );
+			}
+			li->li_qtail = &li->li_qhead;
+			li->li_qdone += li->li_qlen;
+			li->li_qlen = 0;
+			ldap_pvt_thread_cond_broadcast( &li->li_qcond );
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &li->li_qmutex );
+}
+
 static int
 log_cf_gen(ConfigArgs *c)
 {
@@ -845,6 +1347,25 @@ log_cf_gen(ConfigArgs *c)
 			agebv.bv_len += cyclebv.bv_len;
 			value_add_one( &c->rvalue_vals, &agebv );
 			break;
+		case LOG_PURGECHUNK:
+			if ( li->li_purgechunk )
+				c->value_int = li->li_purgechunk;
+			else
+				rc = 1;
+			break;
+		case LOG_QUEUE:
+			if ( li->li_qmax ) {
+				char buf[ STRLENOF("2147483647 async") + 1 ];
+				struct berval bv;
+
+				bv.bv_len = snprintf( buf, sizeof( buf ), "%d %s",
+					li->li_qmax, li->li_qasync ? "async" : "sync" );
+				bv.bv_val = buf;
+				value_add_one( &c->rvalue_vals, &bv );
+			} else {
+				rc = 1;
+			}
+			break;
 		case LOG_SUCCESS:
 			if ( li->li_success )
 				c->value_int = li->li_success;
@@ -908,6 +1429,14 @@ log_cf_gen(ConfigArgs *c)
 			li->li_age = 0;
 			li->li_cycle = 0;
 			break;
+		case LOG_PURGECHUNK:
+			li->li_purgechunk = 0;
+			break;
+		case LOG_QUEUE:
+			accesslog_log_drain( li );
+			li->li_qmax = 0;
+			li->li_qasync = 0;
+			break;
 		case LOG_SUCCESS:
 			li->li_success = 0;
 			break;
@@ -1027,6 +1556,45 @@ log_cf_gen(ConfigArgs *c)
 				}
 			}
 			break;
+		case LOG_PURGECHUNK:
+			if ( c->value_int < 1 ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"<%s> must be a positive number", c->argv[0] );
+				Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg );
+				rc = 1;
+				break;
+			}
+			li->li_purgechunk = c->value_int;
+			break;
+		case LOG_QUEUE: {
+			int max, async = 0;
+
+			if ( lutil_atoi( &max, c->argv[1] ) || max < 1 ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"<%s> invalid queue size \"%s\"",
+					c->argv[0], c->argv[1] );
+				Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg );
+				rc = 1;
+				break;
+			}
+			if ( c->argc > 2 ) {
+				if ( !strcasecmp( c->argv[2], "async" )) {
+					async = 1;
+				} else if ( strcasecmp( c->argv[2], "sync" )) {
+					snprintf( c->cr_msg, sizeof( c->cr_msg ),
+						"<%s> unknown durability \"%s\", "
+						"must be sync or async",
+						c->argv[0], c->argv[2] );
+					Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg );
+					rc = 1;
+					break;
+				}
+			}
+			/* don't let new writes overtake the ones already queued */
+			accesslog_log_drain( li );
+			li->li_qmax = max;
+			li->li_qasync = async;
+			} break;
 		case LOG_SUCCESS:
 			li->li_success = c->value_int;
 			break;
@@ -1576,6 +2144,7 @@ accesslog_response(Operation *op, SlapReply *rs)
 	Operation op2 = {0};
 	SlapReply rs2 = {REP_RESULT};
 	char csnbuf[LDAP_PVT_CSNSTR_BUFSIZE];
+	log_wait lw = { 0, LDAP_SUCCESS };
 
 	/* ITS#9051 Make sure we only remove the callback on a final response */
 	if ( rs->sr_type != REP_RESULT && rs->sr_type != REP_EXTENDED &&
@@ -1635,7 +2204,8 @@ accesslog_response(Operation *op, SlapReply *rs)
 		 * ordering
 		 */
 		if ( !success || BER_BVISEMPTY( &op->o_csn ) ) {
-			slap_get_csn( &op2, &op2.o_csn, 1 );
+			/* a queued write has its CSN queued by the writer */
+			slap_get_csn( &op2, &op2.o_csn, !li->li_qmax );
 		} else {
 			if ( !( lo->mask & LOG_OP_WRITES ) ) {
 				Debug( LDAP_DEBUG_ANY, "%s accesslog_response: "
@@ -1644,7 +2214,10 @@ accesslog_response(Operation *op, SlapReply *rs)
 						op->o_log_prefix, li->li_db_suffix.bv_val );
 				assert(0);
 			}
-			slap_queue_csn( &op2, &op->o_csn );
+			if ( li->li_qmax )
+				op2.o_csn = op->o_csn;
+			else
+				slap_queue_csn( &op2, &op->o_csn );
 		}
 	}
 
@@ -1985,7 +2558,7 @@ accesslog_response(Operation *op, SlapReply *rs)
 	/* contextCSN updates may still reach here */
 	op2.o_dont_replicate = op->o_dont_replicate;
 
-	op2.o_bd->be_add( &op2, &rs2 );
+	accesslog_log_op( li, &op2, &rs2, &lw );
 	if ( rs2.sr_err != LDAP_SUCCESS ) {
 		Debug( LDAP_DEBUG_SYNC, "%s accesslog_response: "
 			"got result 0x%x adding log entry %s\n",
@@ -2031,7 +2604,7 @@ accesslog_response(Operation *op, SlapReply *rs)
 			op2.o_dont_replicate = 0;
 
 			rs_reinit( &rs2, REP_RESULT );
-			op2.o_bd->be_modify( &op2, &rs2 );
+			accesslog_log_op( li, &op2, &rs2, &lw );
 
 			if ( rs2.sr_err != LDAP_SUCCESS ) {
 				Debug( LDAP_DEBUG_SYNC, "%s accesslog_response: "
@@ -2087,7 +2660,7 @@ accesslog_response(Operation *op, SlapReply *rs)
 						"adding a new csn=%s into minCSN\n",
 						bv[0].bv_val );
 				rs_reinit( &rs2, REP_RESULT );
-				op2.o_bd->be_modify( &op2, &rs2 );
+				accesslog_log_op( li, &op2, &rs2, &lw );
 				if ( rs2.sr_err != LDAP_SUCCESS ) {
 					Debug( LDAP_DEBUG_SYNC, "accesslog_response: "
 							"got result 0x%x adding minCSN %s\n",
@@ -2104,6 +2677,11 @@ accesslog_response(Operation *op, SlapReply *rs)
 done:
 	ldap_pvt_thread_mutex_unlock( &li->li_log_mutex );
 	if ( old ) entry_free( old );
+	if ( accesslog_log_wait( li, &lw, op->o_threadctx ) != LDAP_SUCCESS ) {
+		Debug( LDAP_DEBUG_SYNC, "%s accesslog_response: "
+			"got result 0x%x writing queued log entries\n",
+			op->o_log_prefix, lw.lw_err );
+	}
 	return SLAP_CB_CONTINUE;
 
 skip:
@@ -2231,6 +2809,7 @@ accesslog_unbind( Operation *op, SlapReply *rs )
 	void *cids[SLAP_MAX_CIDS];
 	SlapReply rs2 = {REP_RESULT};
 	Entry *e;
+	log_wait lw = { 0, LDAP_SUCCESS };
 
 	if ( op->o_conn->c_authz_backend != on->on_info->oi_origdb )
 		return SLAP_CB_CONTINUE;
@@ -2262,7 +2841,7 @@ accesslog_unbind( Operation *op, SlapReply *rs )
 		 * ordering
 		 */
 		if ( BER_BVISEMPTY( &op->o_csn ) ) {
-			slap_get_csn( &op2, &op2.o_csn, 1 );
+			slap_get_csn( &op2, &op2.o_csn, !li->li_qmax );
 		} else {
 			Debug( LDAP_DEBUG_ANY, "%s accesslog_unbind: "
 					"the op had a CSN assigned, if you're replicating the "
@@ -2285,7 +2864,7 @@ accesslog_unbind( Operation *op, SlapReply *rs )
 	op2.o_controls = cids;
 	memset(cids, 0, sizeof( cids ));
 
-	op2.o_bd->be_add( &op2, &rs2 );
+	accesslog_log_op( li, &op2, &rs2, &lw );
 	if ( rs2.sr_err != LDAP_SUCCESS ) {
 		Debug( LDAP_DEBUG_SYNC, "%s accesslog_unbind: "
 			"got result 0x%x adding log entry %s\n",
@@ -2295,6 +2874,11 @@ accesslog_unbind( Operation *op, SlapReply *rs )
 
 	if ( e == op2.ora_e )
 		entry_free( e );
+	if ( accesslog_log_wait( li, &lw, op->o_threadctx ) != LDAP_SUCCESS ) {
+		Debug( LDAP_DEBUG_SYNC, "%s accesslog_unbind: "
+			"got result 0x%x writing queued log entries\n",
+			op->o_log_prefix, lw.lw_err );
+	}
 
 	return SLAP_CB_CONTINUE;
 }
@@ -2311,6 +2895,7 @@ accesslog_abandon( Operation *op, SlapReply *rs )
 	char csnbuf[LDAP_PVT_CSNSTR_BUFSIZE];
 	char buf[64];
 	struct berval bv;
+	log_wait lw = { 0, LDAP_SUCCESS };
 
 	if ( !op->o_time )
 		return SLAP_CB_CONTINUE;
@@ -2341,7 +2926,7 @@ accesslog_abandon( Operation *op, SlapReply *rs )
 		 * ordering
 		 */
 		if ( BER_BVISEMPTY( &op->o_csn ) ) {
-			slap_get_csn( &op2, &op2.o_csn, 1 );
+			slap_get_csn( &op2, &op2.o_csn, !li->li_qmax );
 		} else {
 			Debug( LDAP_DEBUG_ANY, "%s accesslog_abandon: "
 					"the op had a CSN assigned, if you're replicating the "
@@ -2370,7 +2955,7 @@ accesslog_abandon( Operation *op, SlapReply *rs )
 	op2.o_controls = cids;
 	memset(cids, 0, sizeof( cids ));
 
-	op2.o_bd->be_add( &op2, &rs2 );
+	accesslog_log_op( li, &op2, &rs2, &lw );
 	if ( rs2.sr_err != LDAP_SUCCESS ) {
 		Debug( LDAP_DEBUG_SYNC, "%s accesslog_abandon: "
 			"got result 0x%x adding log entry %s\n",
@@ -2379,6 +2964,11 @@ accesslog_abandon( Operation *op, SlapReply *rs )
 	ldap_pvt_thread_mutex_unlock( &li->li_log_mutex );
 	if ( e == op2.ora_e )
 		entry_free( e );
+	if ( accesslog_log_wait( li, &lw, op->o_threadctx ) != LDAP_SUCCESS ) {
+		Debug( LDAP_DEBUG_SYNC, "%s accesslog_abandon: "
+			"got result 0x%x writing queued log entries\n",
+			op->o_log_prefix, lw.lw_err );
+	}
 
 	return SLAP_CB_CONTINUE;
 }
@@ -2427,6 +3017,11 @@ accesslog_db_init(
 	on->on_bi.bi_private = li;
 	ldap_pvt_thread_mutex_recursive_init( &li->li_op_rmutex );
 	ldap_pvt_thread_mutex_init( &li->li_log_mutex );
+	ldap_pvt_thread_mutex_init( &li->li_qmutex );
+	ldap_pvt_thread_cond_init( &li->li_qcond );
+	li->li_qtail = &li->li_qhead;
+	if ( backend_info( "monitor" ) != NULL )
+		SLAP_DBFLAGS( be ) |= SLAP_DBFLAG_MONITORING;
 	return 0;
 }
 
@@ -2452,6 +3047,8 @@ accesslog_db_destroy(
 		ber_bvarray_free( li->li_mincsn );
 	if ( li->li_db_suffix.bv_val )
 		ch_free( li->li_db_suffix.bv_val );
+	ldap_pvt_thread_cond_destroy( &li->li_qcond );
+	ldap_pvt_thread_mutex_destroy( &li->li_qmutex );
 	ldap_pvt_thread_mutex_destroy( &li->li_log_mutex );
 	ldap_pvt_thread_mutex_destroy( &li->li_op_rmutex );
 	free( li );
@@ -2620,6 +3217,187 @@ accesslog_db_root(
 	return NULL;
 }
 
+static const struct berval zerotime = BER_BVC("00000101000000Z");
+
+static int
+accesslog_monitor_update(
+	Operation	*op,
+	SlapReply	*rs,
+	Entry		*e,
+	void		*priv )
+{
+	log_info	*li = (log_info *) priv;
+	Attribute	*a;
+	char		buf[ LDAP_LUTIL_GENTIME_BUFSIZE ];
+	struct berval	bv;
+	unsigned long	purged, purgerun;
+	time_t		purgelast;
+
+	ldap_pvt_thread_mutex_lock( &li->li_log_mutex );
+	purged = li->li_purged;
+	purgerun = li->li_purgerun;
+	purgelast = li->li_purgelast;
+	ldap_pvt_thread_mutex_unlock( &li->li_log_mutex );
+
+	a = attr_find( e->e_attrs, ad_purgedEntries );
+	assert( a != NULL );
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", purged );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	a = attr_find( e->e_attrs, ad_purgeRunEntries );
+	assert( a != NULL );
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", purgerun );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	a = attr_find( e->e_attrs, ad_lastPurge );
+	assert( a != NULL );
+	if ( purgelast ) {
+		bv.bv_len = sizeof( buf );
+		slap_timestamp( &purgelast, &bv );
+	} else {
+		bv = zerotime;
+	}
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	return SLAP_CB_CONTINUE;
+}
+
+static int
+accesslog_monitor_free(
+	Entry		*e,
+	void		**priv )
+{
+	struct berval	values[ 2 ];
+	Modification	mod = { 0 };
+	AttributeDescription	**ad, *ads[] = {
+		ad_purgedEntries, ad_purgeRunEntries, ad_lastPurge, NULL };
+
+	const char	*text;
+	char		textbuf[ SLAP_TEXT_BUFLEN ];
+
+	/* NOTE: if slap_shutdown != 0, priv might have already been freed */
+	*priv = NULL;
+
+	/* Remove objectClass */
+	mod.sm_op = LDAP_MOD_DELETE;
+	mod.sm_desc = slap_schema.si_ad_objectClass;
+	mod.sm_values = values;
+	mod.sm_numvals = 1;
+	values[ 0 ] = oc_olmAccessLog->soc_cname;
+	BER_BVZERO( &values[ 1 ] );
+
+	modify_delete_values( e, &mod, 1, &text,
+		textbuf, sizeof( textbuf ) );
+	/* don't care too much about return code... */
+
+	/* remove attrs */
+	mod.sm_values = NULL;
+	mod.sm_numvals = 0;
+	for ( ad = ads; *ad; ad++ ) {
+		mod.sm_desc = *ad;
+		modify_delete_values( e, &mod, 1, &text,
+			textbuf, sizeof( textbuf ) );
+	}
+
+	return SLAP_CB_CONTINUE;
+}
+
+/* Publish the purge progress in the monitor entry of our database */
+static int
+accesslog_monitor_db_open( BackendDB *be )
+{
+	slap_overinst		*on = (slap_overinst *)be->bd_info;
+	log_info		*li = on->on_bi.bi_private;
+	Attribute		*a, *next;
+	monitor_callback_t	*cb = NULL;
+	int			rc = 0;
+	BackendInfo		*mi;
+	monitor_extra_t		*mbe;
+	struct berval		zero = BER_BVC( "0" );
+
+	if ( !SLAP_DBMONITORING( be ) ) {
+		return 0;
+	}
+
+	mi = backend_info( "monitor" );
+	if ( !mi || !mi->bi_extra ) {
+		SLAP_DBFLAGS( be ) ^= SLAP_DBFLAG_MONITORING;
+		return 0;
+	}
+	mbe = mi->bi_extra;
+
+	/* don't bother if monitor is not configured */
+	if ( !mbe->is_configured() ) {
+		return 0;
+	}
+
+	a = attrs_alloc( 1 + 3 );
+	a->a_desc = slap_schema.si_ad_objectClass;
+	attr_valadd( a, &oc_olmAccessLog->soc_cname, NULL, 1 );
+	next = a->a_next;
+
+	next->a_desc = ad_purgedEntries;
+	attr_valadd( next, &zero, NULL, 1 );
+	next = next->a_next;
+
+	next->a_desc = ad_purgeRunEntries;
+	attr_valadd( next, &zero, NULL, 1 );
+	next = next->a_next;
+
+	next->a_desc = ad_lastPurge;
+	attr_valadd( next, (struct berval *)&zerotime, NULL, 1 );
+
+	cb = ch_calloc( sizeof( monitor_callback_t ), 1 );
+	cb->mc_update = accesslog_monitor_update;
+	cb->mc_free = accesslog_monitor_free;
+	cb->mc_private = (void *)li;
+
+	/* make sure the database is registered; then add monitor attributes */
+	BER_BVZERO( &li->li_monitor_ndn );
+	rc = mbe->register_overlay( be, on, &li->li_monitor_ndn );
+	if ( rc == 0 ) {
+		rc = mbe->register_entry_attrs( &li->li_monitor_ndn, a, cb,
+			NULL, -1, NULL );
+	}
+
+	if ( rc != 0 ) {
+		ch_free( cb );
+		cb = NULL;
+	}
+
+	/* store for cleanup */
+	li->li_monitor_cb = (void *)cb;
+
+	/* the monitor entry keeps its own copy */
+	attrs_free( a );
+
+	return rc;
+}
+
+static int
+accesslog_monitor_db_close( BackendDB *be )
+{
+	slap_overinst *on = (slap_overinst *)be->bd_info;
+	log_info *li = on->on_bi.bi_private;
+
+	if ( !BER_BVISNULL( &li->li_monitor_ndn )) {
+		BackendInfo		*mi = backend_info( "monitor" );
+		monitor_extra_t		*mbe;
+
+		if ( mi && mi->bi_extra ) {
+			struct berval dummy = BER_BVNULL;
+			mbe = mi->bi_extra;
+			mbe->unregister_entry_callback( &li->li_monitor_ndn,
+				(monitor_callback_t *)li->li_monitor_cb,
+				&dummy, 0, &dummy );
+		}
+		BER_BVZERO( &li->li_monitor_ndn );
+	}
+
+	return 0;
+}
+
 static int
 accesslog_db_open(
 	BackendDB *be,
@@ -2659,7 +3437,7 @@ accesslog_db_open(
 		"accesslog_db_root", li->li_db->be_suffix[0].bv_val );
 	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
 
-	return 0;
+	return accesslog_monitor_db_open( be );
 }
 
 static int
@@ -2683,7 +3461,14 @@ accesslog_db_close(
 		ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
 	}
 
-	return 0;
+	/* the writer task must not run after we're gone */
+	ldap_pvt_thread_mutex_lock( &li->li_qmutex );
+	if ( li->li_qtask && ldap_pvt_thread_pool_retract( li->li_qcookie ) > 0 )
+		li->li_qtask = 0;
+	ldap_pvt_thread_mutex_unlock( &li->li_qmutex );
+	accesslog_log_drain( li );
+
+	return accesslog_monitor_db_close( be );
 }
 
 enum { start = 0 };
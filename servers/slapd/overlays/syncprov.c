@@ -56,6 +56,7 @@ typedef struct resinfo {
 	struct berval ri_uuid;
 	struct berval ri_csn;
 	struct berval ri_cookie;
+	Modifications *ri_mods;	/* changes made by a modify */
 	char ri_isref;
 	ldap_pvt_thread_mutex_t ri_mutex;
 } resinfo;
@@ -66,6 +67,7 @@ typedef struct syncres {
 	struct syncres *s_rilist;	/* list of psearches using this result */
 	resinfo *s_info;
 	char s_mode;
+	char s_sendmods;	/* send ri_mods instead of the entry */
 } syncres;
 
 /* Record of a persistent search */
@@ -85,6 +87,7 @@ typedef struct syncops {
 #define	PS_FIND_BASE		0x08
 #define	PS_FIX_FILTER		0x10
 #define	PS_TASK_QUEUED		0x20
+#define	PS_SEND_MODS		0x40
 
 	int		s_inuse;	/* reference count */
 	struct syncres *s_res;
@@ -105,6 +108,10 @@ typedef struct sync_control {
 /* o_sync_mode uses data bits of o_sync */
 #define	o_sync_mode	o_ctrlflag[slap_cids.sc_LDAPsync]
 
+/* A received sync modifications control */
+static int syncmods_cid;
+#define	o_syncmods	o_ctrlflag[syncmods_cid]
+
 #define SLAP_SYNC_NONE					(LDAP_SYNC_NONE<<SLAP_CONTROL_SHIFT)
 #define SLAP_SYNC_REFRESH				(LDAP_SYNC_REFRESH_ONLY<<SLAP_CONTROL_SHIFT)
 #define SLAP_SYNC_PERSIST				(LDAP_SYNC_RESERVED<<SLAP_CONTROL_SHIFT)
@@ -165,6 +172,8 @@ typedef struct syncprov_info_t {
 	int		si_dirty;	/* True if the context is dirty, i.e changes
 						 * have been made without updating the csn. */
 	time_t	si_chklast;	/* time of last checkpoint */
+	int		si_chkpending;	/* checkpoint requested, protected by slapd_rq */
+	struct re_s	*si_chktask;	/* background checkpoint task */
 	Avlnode	*si_mods;	/* entries being modified */
 	sessionlog	*si_logs;
 	ldap_pvt_thread_rdwr_t	si_csn_rwlock;
@@ -182,12 +191,24 @@ typedef struct opcookie {
 	struct berval sndn;
 	struct berval suuid;	/* UUID of entry */
 	struct berval sctxcsn;
+	Modifications *smods;	/* changes of a modify */
 	short osid;	/* sid of op csn */
 	short rsid;	/* sid of relay */
 	short sreference;	/* Is the entry a reference? */
 	syncres ssres;
 } opcookie;
 
+/* A term that every entry matching a psearch filter must satisfy,
+ * shared by all psearches using it while matching one entry.
+ */
+typedef struct syncanchor {
+	AttributeDescription *sa_desc;
+	struct berval sa_value;	/* NULL for a presence test */
+	int sa_match;	/* TRUE if the entry satisfies the term */
+} syncanchor;
+
+#define SYNCPROV_MAX_ANCHORS	16
+
 typedef struct fbase_cookie {
 	struct berval *fdn;	/* DN of a modified entry, for scope testing */
 	syncops *fss;	/* persistent search we're testing against */
@@ -211,7 +232,8 @@ syncprov_state_ctrl(
 	LDAPControl	**ctrls,
 	int		num_ctrls,
 	int		send_cookie,
-	struct berval	*cookie )
+	struct berval	*cookie,
+	Modifications	*mods )
 {
 	Attribute* a;
 	int ret;
@@ -236,12 +258,23 @@ syncprov_state_ctrl(
 	/* FIXME: what if entryuuid is NULL or empty ? */
 
 	if ( send_cookie && cookie ) {
-		ber_printf( ber, "{eOON}",
+		ber_printf( ber, "{eOO",
 			entry_sync_state, &entryuuid_bv, cookie );
 	} else {
-		ber_printf( ber, "{eON}",
+		ber_printf( ber, "{eO",
 			entry_sync_state, &entryuuid_bv );
 	}
+	if ( mods ) {
+		Modifications *ml;
+
+		ber_printf( ber, "t{", LDAP_TAG_SYNC_MODS );
+		for ( ml = mods; ml; ml = ml->sml_next ) {
+			ber_printf( ber, "{e{O[W]N}N}", ml->sml_op,
+				&ml->sml_desc->ad_cname, ml->sml_values );
+		}
+		ber_printf( ber, "N}" );
+	}
+	ber_printf( ber, "N}" );
 
 	ret = ber_flatten2( ber, &bv, 0 );
 	if ( ret == 0 ) {
@@ -863,6 +896,8 @@ static void free_resinfo( syncres *sr )
 		ldap_pvt_thread_mutex_destroy( &ri->ri_mutex );
 		if ( ri->ri_e )
 			entry_free( ri->ri_e );
+		if ( ri->ri_mods )
+			slap_mods_free( ri->ri_mods, 1 );
 		if ( !BER_BVISNULL( &ri->ri_cookie ))
 			ch_free( ri->ri_cookie.bv_val );
 		ch_free( ri );
@@ -929,9 +964,44 @@ syncprov_free_syncop( syncops *so, int flags )
 	return FSR_DIDFREE;
 }
 
+/* Check that the changes of a modify can be sent as they were made */
+static int
+syncprov_mods_allowed( Operation *op, resinfo *ri )
+{
+	Modifications *ml;
+	int i;
+
+	if ( ri->ri_isref || !access_allowed( op, ri->ri_e,
+			slap_schema.si_ad_entry, NULL, ACL_READ, NULL ))
+		return 0;
+
+	for ( ml = ri->ri_mods; ml; ml = ml->sml_next ) {
+		/* internal variants depend on the state they were applied to */
+		switch ( ml->sml_op ) {
+		case LDAP_MOD_ADD:
+		case LDAP_MOD_DELETE:
+		case LDAP_MOD_REPLACE:
+		case LDAP_MOD_INCREMENT:
+			break;
+		default:
+			return 0;
+		}
+		if ( !access_allowed( op, ri->ri_e, ml->sml_desc, NULL,
+				ACL_READ, NULL ))
+			return 0;
+		for ( i = 0; i < ml->sml_numvals; i++ ) {
+			if ( !access_allowed( op, ri->ri_e, ml->sml_desc,
+					&ml->sml_values[i], ACL_READ, NULL ))
+				return 0;
+		}
+	}
+	return 1;
+}
+
 /* Send a persistent search response */
 static int
-syncprov_sendresp( Operation *op, resinfo *ri, syncops *so, int mode )
+syncprov_sendresp( Operation *op, resinfo *ri, syncops *so, int mode,
+	int sendmods )
 {
 	SlapReply rs = { REP_SEARCH };
 	struct berval cookie, csns[2];
@@ -941,6 +1011,9 @@ syncprov_sendresp( Operation *op, resinfo *ri, syncops *so, int mode )
 	if ( so->s_op->o_abandon )
 		return SLAPD_ABANDON;
 
+	if ( sendmods && !syncprov_mods_allowed( op, ri ))
+		sendmods = 0;
+
 	rs.sr_ctrls = op->o_tmpalloc( sizeof(LDAPControl *)*2, op->o_tmpmemctx );
 	rs.sr_ctrls[1] = NULL;
 	rs.sr_flags = REP_CTRLS_MUSTBEFREED;
@@ -963,13 +1036,20 @@ syncprov_sendresp( Operation *op, resinfo *ri, syncops *so, int mode )
 	a_uuid.a_desc = slap_schema.si_ad_entryUUID;
 	a_uuid.a_nvals = &ri->ri_uuid;
 	rs.sr_err = syncprov_state_ctrl( op, &rs, &e_uuid,
-		mode, rs.sr_ctrls, 0, 1, &cookie );
+		mode, rs.sr_ctrls, 0, 1, &cookie, sendmods ? ri->ri_mods : NULL );
 	op->o_tmpfree( cookie.bv_val, op->o_tmpmemctx );
 
 	rs.sr_entry = &e_uuid;
-	if ( mode == LDAP_SYNC_ADD || mode == LDAP_SYNC_MODIFY ) {
+	if ( sendmods ) {
+		/* the changes are in the control, only send the DN */
+		e_uuid.e_attrs = NULL;
+		e_uuid.e_name = ri->ri_e->e_name;
+		e_uuid.e_nname = ri->ri_e->e_nname;
+		rs.sr_attrs = slap_anlist_no_attrs;
+	} else if ( mode == LDAP_SYNC_ADD || mode == LDAP_SYNC_MODIFY ) {
 		e_uuid = *ri->ri_e;
 		e_uuid.e_private = NULL;
+		rs.sr_attrs = op->ors_attrs;
 	}
 
 	switch( mode ) {
@@ -982,11 +1062,11 @@ syncprov_sendresp( Operation *op, resinfo *ri, syncops *so, int mode )
 		}
 		/* fallthru */
 	case LDAP_SYNC_MODIFY:
-		Debug( LDAP_DEBUG_SYNC, "%s syncprov_sendresp: sending %s, dn=%s\n",
+		Debug( LDAP_DEBUG_SYNC, "%s syncprov_sendresp: sending %s%s, dn=%s\n",
 			op->o_log_prefix,
 			mode == LDAP_SYNC_ADD ? "LDAP_SYNC_ADD" : "LDAP_SYNC_MODIFY",
+			sendmods ? " with modifications" : "",
 			e_uuid.e_nname.bv_val );
-		rs.sr_attrs = op->ors_attrs;
 		rs.sr_err = send_search_entry( op, &rs );
 		break;
 	case LDAP_SYNC_DELETE:
@@ -1039,7 +1119,8 @@ syncprov_qplay( Operation *op, syncops *so )
 				rc = syncprov_sendinfo( op, &rs, LDAP_TAG_SYNC_NEW_COOKIE,
 					&sr->s_info->ri_cookie, 0, NULL, 0 );
 			} else {
-				rc = syncprov_sendresp( op, sr->s_info, so, sr->s_mode );
+				rc = syncprov_sendresp( op, sr->s_info, so, sr->s_mode,
+					sr->s_sendmods );
 			}
 		} else {
 			/* set rc so we don't do a new qstart */
@@ -1141,6 +1222,26 @@ syncprov_qstart( syncops *so )
 		syncprov_qtask, so, &so->s_pool_cookie );
 }
 
+static Modifications *
+syncprov_mods_dup( Modifications *ml )
+{
+	Modifications *mods = NULL, **modtail = &mods, *mod;
+
+	for ( ; ml; ml = ml->sml_next ) {
+		mod = ch_malloc( sizeof( Modifications ));
+		*mod = *ml;
+		mod->sml_type = ml->sml_desc->ad_cname;
+		mod->sml_values = NULL;
+		mod->sml_nvalues = NULL;
+		if ( ml->sml_values )
+			ber_bvarray_dup_x( &mod->sml_values, ml->sml_values, NULL );
+		mod->sml_next = NULL;
+		*modtail = mod;
+		modtail = &mod->sml_next;
+	}
+	return mods;
+}
+
 /* Queue a persistent search response */
 static int
 syncprov_qresp( opcookie *opc, syncops *so, int mode )
@@ -1153,6 +1254,7 @@ syncprov_qresp( opcookie *opc, syncops *so, int mode )
 	sr = ch_malloc( sizeof( syncres ));
 	sr->s_next = NULL;
 	sr->s_mode = mode;
+	sr->s_sendmods = 0;
 	if ( !opc->ssres.s_info ) {
 
 		srsize = sizeof( resinfo );
@@ -1202,6 +1304,7 @@ syncprov_qresp( opcookie *opc, syncops *so, int mode )
 		ri->ri_e = opc->se;
 		ri->ri_csn.bv_len = csn.bv_len;
 		ri->ri_isref = opc->sreference;
+		ri->ri_mods = NULL;
 		BER_BVZERO( &ri->ri_cookie );
 		ldap_pvt_thread_mutex_init( &ri->ri_mutex );
 		opc->se = NULL;
@@ -1212,6 +1315,9 @@ syncprov_qresp( opcookie *opc, syncops *so, int mode )
 	ldap_pvt_thread_mutex_lock( &ri->ri_mutex );
 	sr->s_rilist = ri->ri_list;
 	ri->ri_list = sr;
+	if ( mode == LDAP_SYNC_MODIFY && opc->smods && !ri->ri_mods &&
+		( so->s_flags & PS_SEND_MODS ))
+		ri->ri_mods = syncprov_mods_dup( opc->smods );
 	if ( mode == LDAP_SYNC_NEW_COOKIE && BER_BVISNULL( &ri->ri_cookie )) {
 		syncprov_info_t	*si = opc->son->on_bi.bi_private;
 
@@ -1224,6 +1330,14 @@ syncprov_qresp( opcookie *opc, syncops *so, int mode )
 	ldap_pvt_thread_mutex_unlock( &ri->ri_mutex );
 
 	ldap_pvt_thread_mutex_lock( &so->s_mutex );
+	/* The modifications are shared by every psearch seeing this change,
+	 * only send them to those that asked. Changes made while the psearch
+	 * was refreshing may apply to an older entry than the consumer has,
+	 * send those in full.
+	 */
+	if ( mode == LDAP_SYNC_MODIFY && ri->ri_mods &&
+		( so->s_flags & ( PS_SEND_MODS|PS_IS_REFRESHING )) == PS_SEND_MODS )
+		sr->s_sendmods = 1;
 	if ( !so->s_res ) {
 		so->s_res = sr;
 	} else {
@@ -1309,6 +1423,156 @@ syncprov_op_abandon( Operation *op, SlapReply *rs )
 	return SLAP_CB_CONTINUE;
 }
 
+/* Find a presence or equality term that is required for f to match.
+ * Equality terms are preferred since they are more selective.
+ */
+static int
+syncprov_filter_anchor( Filter *f, AttributeDescription **ad, struct berval **val )
+{
+	AttributeDescription *desc;
+	struct berval *value = NULL;
+
+	switch ( f->f_choice ) {
+	case LDAP_FILTER_AND: {
+		int rc = 0;
+
+		for ( f = f->f_and; f; f = f->f_next ) {
+			AttributeDescription *fad;
+			struct berval *fval;
+
+			if ( syncprov_filter_anchor( f, &fad, &fval ) &&
+				( !rc || ( fval && !*val ))) {
+				*ad = fad;
+				*val = fval;
+				rc = 1;
+				if ( fval )
+					break;
+			}
+		}
+		return rc;
+		}
+	case LDAP_FILTER_EQUALITY:
+		value = &f->f_av_value;
+		/* FALLTHRU */
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+	case LDAP_FILTER_APPROX:
+#ifdef LDAP_COMP_MATCH
+		if ( f->f_ava->aa_cf )
+			return 0;
+#endif
+		desc = f->f_av_desc;
+		break;
+	case LDAP_FILTER_SUBSTRINGS:
+		desc = f->f_sub_desc;
+		break;
+	case LDAP_FILTER_PRESENT:
+		desc = f->f_desc;
+		break;
+	default:
+		return 0;
+	}
+
+	/* test_filter() computes these rather than looking in the entry */
+	if ( desc == slap_schema.si_ad_hasSubordinates ||
+		desc == slap_schema.si_ad_entryDN ||
+		desc == slap_schema.si_ad_subschemaSubentry )
+		return 0;
+
+	*ad = desc;
+	*val = value;
+	return 1;
+}
+
+/* Check an anchor against an entry, the way test_filter() would
+ * but without access control. FALSE means no filter requiring the
+ * anchor can match the entry.
+ */
+static int
+syncprov_anchor_test( Entry *e, syncanchor *sa )
+{
+	Attribute *a;
+
+	for ( a = attrs_find( e->e_attrs, sa->sa_desc ); a;
+		a = attrs_find( a->a_next, sa->sa_desc )) {
+		MatchingRule *mr;
+		struct berval *bv;
+
+		if ( BER_BVISNULL( &sa->sa_value ))
+			return 1;
+
+		mr = a->a_desc->ad_type->sat_equality;
+		if ( !mr )
+			continue;
+
+		if ( a->a_flags & SLAP_ATTR_SORTED_VALS ) {
+			unsigned slot;
+
+			if ( attr_valfind( a, SLAP_MR_EQUALITY |
+				SLAP_MR_ASSERTED_VALUE_NORMALIZED_MATCH |
+				SLAP_MR_ATTRIBUTE_VALUE_NORMALIZED_MATCH,
+				&sa->sa_value, &slot, NULL ) != LDAP_NO_SUCH_ATTRIBUTE )
+				return 1;
+			continue;
+		}
+
+		for ( bv = a->a_nvals; !BER_BVISNULL( bv ); bv++ ) {
+			const char *text;
+			int match;
+
+			if ( ordered_value_match( &match, a->a_desc, mr,
+				SLAP_MR_EQUALITY, bv, &sa->sa_value, &text ) != LDAP_SUCCESS ||
+				match == 0 )
+				return 1;
+		}
+	}
+	return 0;
+}
+
+/* Quick check whether a psearch filter could match the entry at all.
+ * Most psearches share a handful of anchors (objectClass values, the
+ * presence of some attribute), so each distinct anchor is only tested
+ * once per entry and the verdict is reused for the other psearches.
+ */
+static int
+syncprov_filter_candidate( Operation *op, Entry *e, Filter *f,
+	syncanchor *anchors, int *nanchors )
+{
+	AttributeDescription *ad;
+	struct berval *val;
+	syncanchor sa;
+	int i;
+
+	if ( !syncprov_filter_anchor( f, &ad, &val ))
+		return 1;
+
+	for ( i = 0; i < *nanchors; i++ ) {
+		if ( anchors[i].sa_desc != ad )
+			continue;
+		if ( val ? !BER_BVISNULL( &anchors[i].sa_value ) &&
+				bvmatch( &anchors[i].sa_value, val ) :
+			BER_BVISNULL( &anchors[i].sa_value ))
+			return anchors[i].sa_match;
+	}
+
+	sa.sa_desc = ad;
+	if ( val )
+		sa.sa_value = *val;
+	else
+		BER_BVZERO( &sa.sa_value );
+	sa.sa_match = syncprov_anchor_test( e, &sa );
+
+	/* The filter belongs to the psearch, which may go away before
+	 * we're done with the cache.
+	 */
+	if ( *nanchors < SYNCPROV_MAX_ANCHORS ) {
+		if ( val )
+			ber_dupbv_x( &sa.sa_value, val, op->o_tmpmemctx );
+		anchors[(*nanchors)++] = sa;
+	}
+	return sa.sa_match;
+}
+
 /* Find which persistent searches are affected by this operation */
 static void
 syncprov_matchops( Operation *op, opcookie *opc, int saveit )
@@ -1322,6 +1586,8 @@ syncprov_matchops( Operation *op, opcookie *opc, int saveit )
 	Attribute *a;
 	int rc, gonext;
 	BackendDB *b0 = op->o_bd, db;
+	syncanchor anchors[SYNCPROV_MAX_ANCHORS];
+	int i, nanchors = 0;
 
 	fc.fdn = saveit ? &op->o_req_ndn : &opc->sndn;
 	if ( !saveit && op->o_tag == LDAP_REQ_DELETE ) {
@@ -1443,22 +1709,28 @@ syncprov_matchops( Operation *op, opcookie *opc, int saveit )
 
 		rc = LDAP_COMPARE_FALSE;
 		if ( e && !is_entry_glue( e ) && fc.fscope ) {
+			Filter *f;
+
 			ldap_pvt_thread_mutex_lock( &ss->s_mutex );
-			op2 = *ss->s_op;
-			oh = *op->o_hdr;
-			oh.oh_conn = ss->s_op->o_conn;
-			oh.oh_connid = ss->s_op->o_connid;
-			op2.o_bd = op->o_bd->bd_self;
-			op2.o_hdr = &oh;
-			op2.o_extra = op->o_extra;
-			op2.o_callback = NULL;
+			f = ss->s_op->ors_filter;
 			if (ss->s_flags & PS_FIX_FILTER) {
 				/* Skip the AND/GE clause that we stuck on in front. We
 				   would lose deletes/mods that happen during the refresh
 				   phase otherwise (ITS#6555) */
-				op2.ors_filter = ss->s_op->ors_filter->f_and->f_next;
+				f = f->f_and->f_next;
+			}
+			if ( syncprov_filter_candidate( op, e, f, anchors, &nanchors )) {
+				op2 = *ss->s_op;
+				oh = *op->o_hdr;
+				oh.oh_conn = ss->s_op->o_conn;
+				oh.oh_connid = ss->s_op->o_connid;
+				op2.o_bd = op->o_bd->bd_self;
+				op2.o_hdr = &oh;
+				op2.o_extra = op->o_extra;
+				op2.o_callback = NULL;
+				op2.ors_filter = f;
+				rc = test_filter( &op2, e, f );
 			}
-			rc = test_filter( &op2, e, op2.ors_filter );
 			ldap_pvt_thread_mutex_unlock( &ss->s_mutex );
 		}
 
@@ -1500,6 +1772,11 @@ syncprov_matchops( Operation *op, opcookie *opc, int saveit )
 	}
 	ldap_pvt_thread_mutex_unlock( &si->si_ops_mutex );
 
+	for ( i = 0; i < nanchors; i++ ) {
+		if ( !BER_BVISNULL( &anchors[i].sa_value ))
+			op->o_tmpfree( anchors[i].sa_value.bv_val, op->o_tmpmemctx );
+	}
+
 	if ( op->o_tag != LDAP_REQ_ADD && e ) {
 		if ( !SLAP_ISOVERLAY( op->o_bd )) {
 			op->o_bd = &db;
@@ -1590,21 +1867,31 @@ syncprov_checkpoint( Operation *op, slap_overinst *on )
 	slap_callback cb = {0};
 	BackendDB be;
 	BackendInfo *bi;
+	BerVarray ctxcsn = NULL;
+	int numcsns;
 
 #ifdef CHECK_CSN
 	Syntax *syn = slap_schema.si_ad_contextCSN->ad_type->sat_syntax;
-
 	int i;
-	for ( i=0; i<si->si_numcsns; i++ ) {
-		assert( !syn->ssyn_validate( syn, si->si_ctxcsn+i ));
+#endif
+
+	/* Write a copy, writers must not wait for the modify to finish */
+	ldap_pvt_thread_rdwr_rlock( &si->si_csn_rwlock );
+	numcsns = si->si_numcsns;
+	ber_bvarray_dup_x( &ctxcsn, si->si_ctxcsn, NULL );
+	ldap_pvt_thread_rdwr_runlock( &si->si_csn_rwlock );
+
+#ifdef CHECK_CSN
+	for ( i=0; i<numcsns; i++ ) {
+		assert( !syn->ssyn_validate( syn, ctxcsn+i ));
 	}
 #endif
 
 	Debug( LDAP_DEBUG_SYNC, "%s syncprov_checkpoint: running checkpoint\n",
 		op->o_log_prefix );
 
-	mod.sml_numvals = si->si_numcsns;
-	mod.sml_values = si->si_ctxcsn;
+	mod.sml_numvals = numcsns;
+	mod.sml_values = ctxcsn;
 	mod.sml_nvalues = NULL;
 	mod.sml_desc = slap_schema.si_ad_contextCSN;
 	mod.sml_op = LDAP_MOD_REPLACE;
@@ -1650,10 +1937,64 @@ syncprov_checkpoint( Operation *op, slap_overinst *on )
 		slap_mods_free( mod.sml_next, 1 );
 	}
 #ifdef CHECK_CSN
-	for ( i=0; i<si->si_numcsns; i++ ) {
-		assert( !syn->ssyn_validate( syn, si->si_ctxcsn+i ));
+	for ( i=0; i<numcsns; i++ ) {
+		assert( !syn->ssyn_validate( syn, ctxcsn+i ));
 	}
 #endif
+	ber_bvarray_free( ctxcsn );
+}
+
+/* Write the contextCSN in the background, once for all the
+ * checkpoints requested while the previous one was running.
+ */
+static void *
+syncprov_checkpoint_task( void *ctx, void *arg )
+{
+	struct re_s *rtask = arg;
+	slap_overinst *on = rtask->arg;
+	syncprov_info_t *si = on->on_bi.bi_private;
+	Connection conn = {0};
+	OperationBuffer opbuf;
+	Operation *op;
+	BackendDB be;
+
+	connection_fake_init( &conn, &opbuf, ctx );
+	op = &opbuf.ob_op;
+	be = *on->on_info->oi_origdb;
+	op->o_bd = &be;
+	op->o_dn = be.be_rootdn;
+	op->o_ndn = be.be_rootndn;
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	/* on shutdown, db_close writes whatever is left */
+	while ( si->si_chkpending && !slapd_shutdown ) {
+		si->si_chkpending = 0;
+		ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+		syncprov_checkpoint( op, on );
+		ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	}
+	ldap_pvt_runqueue_stoptask( &slapd_rq, rtask );
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+
+	return NULL;
+}
+
+static void
+syncprov_checkpoint_sched( slap_overinst *on )
+{
+	syncprov_info_t *si = on->on_bi.bi_private;
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	si->si_chkpending = 1;
+	if ( !si->si_chktask ) {
+		si->si_chktask = ldap_pvt_runqueue_insert( &slapd_rq, 0,
+			syncprov_checkpoint_task, on, "syncprov_checkpoint",
+			on->on_info->oi_origdb->be_suffix[0].bv_val );
+	} else if ( !ldap_pvt_runqueue_isrunning( &slapd_rq, si->si_chktask )) {
+		/* a running task picks up the request itself */
+		ldap_pvt_runqueue_resched( &slapd_rq, si->si_chktask, 0 );
+	}
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
 }
 
 static void
@@ -2589,9 +2930,7 @@ syncprov_op_response( Operation *op, SlapReply *rs )
 
 added:
 		if ( do_check ) {
-			ldap_pvt_thread_rdwr_rlock( &si->si_csn_rwlock );
-			syncprov_checkpoint( op, on );
-			ldap_pvt_thread_rdwr_runlock( &si->si_csn_rwlock );
+			syncprov_checkpoint_sched( on );
 		}
 
 		/* only update consumer ctx if this is a newer csn */
@@ -2604,6 +2943,13 @@ added:
 		have_psearches = ( si->si_ops != NULL );
 		ldap_pvt_thread_mutex_unlock( &si->si_ops_mutex );
 		if ( have_psearches ) {
+			/* Changes relayed in delta-MPR may have been rewritten
+			 * on the way, only trust our own in that case.
+			 */
+			if ( op->o_tag == LDAP_REQ_MODIFY &&
+				( !SLAP_MULTIPROVIDER( op->o_bd ) ||
+					opc->osid == slap_serverID ))
+				opc->smods = op->orm_modlist;
 			syncprov_matchops( op, opc, 0 );
 		}
 
@@ -3022,11 +3368,11 @@ syncprov_search_response( Operation *op, SlapReply *rs )
 			slap_compose_sync_cookie( op, &cookie, a->a_nvals, srs->sr_state.rid,
 					slap_serverID ? slap_serverID : -1, NULL );
 			rs->sr_err = syncprov_state_ctrl( op, rs, rs->sr_entry,
-				LDAP_SYNC_ADD, rs->sr_ctrls, 0, 1, &cookie );
+				LDAP_SYNC_ADD, rs->sr_ctrls, 0, 1, &cookie, NULL );
 			op->o_tmpfree( cookie.bv_val, op->o_tmpmemctx );
 		} else {
 			rs->sr_err = syncprov_state_ctrl( op, rs, rs->sr_entry,
-				LDAP_SYNC_ADD, rs->sr_ctrls, 0, 0, NULL );
+				LDAP_SYNC_ADD, rs->sr_ctrls, 0, 0, NULL, NULL );
 		}
 	} else if ( rs->sr_type == REP_RESULT && rs->sr_err == LDAP_SUCCESS ) {
 		struct berval cookie = BER_BVNULL;
@@ -3172,6 +3518,11 @@ syncprov_op_search( Operation *op, SlapReply *rs )
 		so.s_eid = NOID;
 		so.s_op = op;
 		so.s_flags = PS_IS_REFRESHING | PS_FIND_BASE;
+		/* The changes are only enough if the consumer sees everything */
+		if ( op->o_syncmods != SLAP_CONTROL_NONE && !op->ors_attrsonly &&
+			an_find( op->ors_attrs, slap_bv_all_user_attrs ) &&
+			an_find( op->ors_attrs, slap_bv_all_operational_attrs ))
+			so.s_flags |= PS_SEND_MODS;
 		/* syncprov_findbase expects to be called as a callback... */
 		sc.sc_private = &opc;
 		opc.son = on;
@@ -3390,17 +3741,20 @@ no_change:	if ( !(op->o_sync_mode & SLAP_SYNC_PERSIST) ) {
 			goto shortcut;
 		}
 
-		if ( !BER_BVISNULL( &si->si_logbase ) ) {
-			do_present = 0;
-			if ( syncprov_play_accesslog( op, rs, srs, ctxcsn,
-					numcsns, sids, &mincsn, minsid ) ) {
-				do_present = SS_PRESENT;
-			}
-		} else if ( si->si_logs ) {
-			do_present = 0;
-			if ( syncprov_play_sessionlog( op, rs, srs, ctxcsn,
+		if ( si->si_logs || !BER_BVISNULL( &si->si_logbase ) ) {
+			/* The in-memory log is cheapest to replay, but only covers
+			 * the last sl_size changes since startup. The accesslog
+			 * survives restarts and reaches further back, so use it
+			 * for consumers the in-memory log can't serve.
+			 */
+			do_present = SS_PRESENT;
+			if ( si->si_logs && !syncprov_play_sessionlog( op, rs, srs,
+					ctxcsn, numcsns, sids, &mincsn, minsid ) ) {
+				do_present = 0;
+			} else if ( !BER_BVISNULL( &si->si_logbase ) &&
+					!syncprov_play_accesslog( op, rs, srs, ctxcsn,
 					numcsns, sids, &mincsn, minsid ) ) {
-				do_present = SS_PRESENT;
+				do_present = 0;
 			}
 		} else if ( ad_minCSN != NULL && si->si_nopres && si->si_usehint ) {
 			/* We are instructed to trust minCSN if it exists. */
@@ -3867,11 +4221,6 @@ sp_cf_gen(ConfigArgs *c)
 				"%s: %s\n", c->log, c->cr_msg );
 			return ARG_BAD_CONF;
 		}
-		if ( size && !BER_BVISNULL( &si->si_logbase ) ) {
-			Debug( LDAP_DEBUG_ANY, "syncprov_config: while configuring "
-					"internal sessionlog, accesslog source has already been "
-					"configured, this results in wasteful operation\n" );
-		}
 		sl = si->si_logs;
 		if ( !sl ) {
 			if ( !size ) break;
@@ -3893,11 +4242,6 @@ sp_cf_gen(ConfigArgs *c)
 		si->si_usehint = c->value_int;
 		break;
 	case SP_LOGDB:
-		if ( si->si_logs ) {
-			Debug( LDAP_DEBUG_ANY, "syncprov_config: while configuring "
-					"accesslog source, internal sessionlog has already been "
-					"configured, this results in wasteful operation\n" );
-		}
 		if ( CONFIG_ONLINE_ADD( c ) ) {
 			if ( !select_backend( &c->value_ndn, 0 ) ) {
 				snprintf( c->cr_msg, sizeof( c->cr_msg ),
@@ -4010,6 +4354,11 @@ syncprov_db_open(
 		return rc;
 	}
 
+	rc = overlay_register_control( be, LDAP_CONTROL_X_SYNC_MODS );
+	if ( rc ) {
+		return rc;
+	}
+
 	Debug( LDAP_DEBUG_SYNC, "syncprov_db_open: "
 		"starting syncprov for suffix %s\n",
 		be->be_suffix[0].bv_val );
@@ -4137,7 +4486,15 @@ syncprov_db_close(
 	if ( slapMode & SLAP_TOOL_MODE ) {
 		return 0;
 	}
-	if ( si->si_numops ) {
+	if ( si->si_chktask ) {
+		ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+		if ( ldap_pvt_runqueue_isrunning( &slapd_rq, si->si_chktask ))
+			ldap_pvt_runqueue_stoptask( &slapd_rq, si->si_chktask );
+		ldap_pvt_runqueue_remove( &slapd_rq, si->si_chktask );
+		si->si_chktask = NULL;
+		ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+	}
+	if ( si->si_numops || si->si_chkpending ) {
 		Connection conn = {0};
 		OperationBuffer opbuf;
 		Operation *op;
@@ -4150,6 +4507,7 @@ syncprov_db_close(
 		op->o_dn = be->be_rootdn;
 		op->o_ndn = be->be_rootndn;
 		syncprov_checkpoint( op, on );
+		si->si_chkpending = 0;
 	}
 
 #ifdef SLAP_CONFIG_DELETE
@@ -4171,6 +4529,7 @@ syncprov_db_close(
 		ldap_pvt_thread_mutex_unlock( &si->si_ops_mutex );
 	}
 	overlay_unregister_control( be, LDAP_CONTROL_SYNC );
+	overlay_unregister_control( be, LDAP_CONTROL_X_SYNC_MODS );
 #endif /* SLAP_CONFIG_DELETE */
 
 	return 0;
@@ -4357,6 +4716,28 @@ static int syncprov_parseCtrl (
 	return LDAP_SUCCESS;
 }
 
+static int syncprov_parseModsCtrl (
+	Operation *op,
+	SlapReply *rs,
+	LDAPControl *ctrl )
+{
+	if ( op->o_syncmods != SLAP_CONTROL_NONE ) {
+		rs->sr_text = "Sync modifications control specified multiple times";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	if ( !BER_BVISNULL( &ctrl->ldctl_value ) ) {
+		rs->sr_text = "Sync modifications control value not absent";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	op->o_syncmods = ctrl->ldctl_iscritical
+		? SLAP_CONTROL_CRITICAL
+		: SLAP_CONTROL_NONCRITICAL;
+
+	return LDAP_SUCCESS;
+}
+
 /* This overlay is set up for dynamic loading via moduleload. For static
  * configuration, you'll need to arrange for the slap_overinst to be
  * initialized and registered by some other function inside slapd.
@@ -4378,6 +4759,15 @@ syncprov_initialize()
 		return rc;
 	}
 
+	rc = register_supported_control( LDAP_CONTROL_X_SYNC_MODS,
+		SLAP_CTRL_SEARCH, NULL,
+		syncprov_parseModsCtrl, &syncmods_cid );
+	if ( rc != LDAP_SUCCESS ) {
+		Debug( LDAP_DEBUG_ANY,
+			"syncprov_init: Failed to register control %d\n", rc );
+		return rc;
+	}
+
 	syncprov.on_bi.bi_type = "syncprov";
 	syncprov.on_bi.bi_flags = SLAPO_BFLAG_SINGLE;
 	syncprov.on_bi.bi_db_init = syncprov_db_init;
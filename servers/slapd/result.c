@@ -1025,23 +1025,57 @@ slap_send_ldap_intermediate( Operation *op, SlapReply *rs )
  * LDAP_SIZELIMIT_EXCEEDED	entry not sent (caller must send sizelimitExceeded)
  */
 
+/* What slap_send_search_entry() decided to send of an attribute */
+typedef struct SendAttr {
+	char		*sa_vals;	/* per value, nonzero if returned */
+	ber_len_t	sa_len;		/* length of the attribute's contents */
+	ber_len_t	sa_setlen;	/* length of the values' contents */
+	int		sa_send;
+} SendAttr;
+
+static int
+send_search_entry_attr( BerElement *ber, Attribute *a, SendAttr *s )
+{
+	int i;
+
+	if ( ber_put_header( ber, LBER_SEQUENCE, s->sa_len ) == -1 ||
+		ber_put_berval( ber, &a->a_desc->ad_cname, LBER_OCTETSTRING ) == -1 ||
+		ber_put_header( ber, LBER_SET, s->sa_setlen ) == -1 )
+		return -1;
+
+	for ( i = 0; s->sa_vals && a->a_vals[i].bv_val != NULL; i++ ) {
+		if ( s->sa_vals[i] &&
+			ber_put_berval( ber, &a->a_vals[i], LBER_OCTETSTRING ) == -1 )
+			return -1;
+	}
+
+	return 0;
+}
+
 int
 slap_send_search_entry( Operation *op, SlapReply *rs )
 {
-	BerElementBuffer berbuf;
+	BerElementBuffer berbuf, cberbuf;
 	BerElement	*ber = (BerElement *) &berbuf;
+	BerElement	*cber = (BerElement *) &cberbuf;
 	Attribute	*a;
-	int		i, j, rc = LDAP_UNAVAILABLE, bytes;
+	int		i, j, k, rc = LDAP_UNAVAILABLE, bytes;
 	int		userattrs;
 	AccessControlState acl_state = ACL_STATE_INIT;
 	int			 attrsonly;
 	AttributeDescription *ad_entry = slap_schema.si_ad_entry;
+	SendAttr	*sa = NULL;
+	char		*v_flags = NULL;
+	int		nattrs, nvals, msg;
+	ber_len_t	attrs_len, entry_len, msg_len;
+	struct berval	ctrls = BER_BVNULL;
 
 	/* a_flags: array of flags telling if the i-th element will be
 	 *          returned or filtered out
-	 * e_flags: array of a_flags
+	 * e_flags: array of a_flags, o_flags the same for operational
+	 *          attributes
 	 */
-	char **e_flags = NULL;
+	char **e_flags = NULL, **o_flags = NULL;
 
 	rs->sr_type = REP_SEARCH;
 
@@ -1096,51 +1130,6 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 		goto error_return;
 	}
 
-	if ( op->o_res_ber ) {
-		/* read back control or LDAP_CONNECTIONLESS */
-	    ber = op->o_res_ber;
-	} else {
-		struct berval	bv;
-
-		bv.bv_len = entry_flatsize( rs->sr_entry, 0 );
-		bv.bv_val = op->o_tmpalloc( bv.bv_len, op->o_tmpmemctx );
-
-		ber_init2( ber, &bv, LBER_USE_DER );
-		ber_set_option( ber, LBER_OPT_BER_MEMCTX, &op->o_tmpmemctx );
-	}
-
-#ifdef LDAP_CONNECTIONLESS
-	if ( op->o_conn && op->o_conn->c_is_udp ) {
-		/* CONNECTIONLESS */
-		if ( op->o_protocol == LDAP_VERSION2 ) {
-	    	rc = ber_printf(ber, "t{O{" /*}}*/,
-				LDAP_RES_SEARCH_ENTRY, &rs->sr_entry->e_name );
-		} else {
-	    	rc = ber_printf( ber, "{it{O{" /*}}}*/, op->o_msgid,
-				LDAP_RES_SEARCH_ENTRY, &rs->sr_entry->e_name );
-		}
-	} else
-#endif
-	if ( op->o_res_ber ) {
-		/* read back control */
-	    rc = ber_printf( ber, "t{O{" /*}}*/,
-			LDAP_RES_SEARCH_ENTRY, &rs->sr_entry->e_name );
-	} else {
-	    rc = ber_printf( ber, "{it{O{" /*}}}*/, op->o_msgid,
-			LDAP_RES_SEARCH_ENTRY, &rs->sr_entry->e_name );
-	}
-
-	if ( rc == -1 ) {
-		Debug( LDAP_DEBUG_ANY, 
-			"send_search_entry: conn %lu  ber_printf failed\n", 
-			op->o_connid );
-
-		if ( op->o_res_ber == NULL ) ber_free_buf( ber );
-		set_ldap_error( rs, LDAP_OTHER, "encoding DN error" );
-		rc = rs->sr_err;
-		goto error_return;
-	}
-
 	/* check for special all user attributes ("*") type */
 	userattrs = SLAP_USERATTRS( rs->sr_attr_flags );
 
@@ -1164,7 +1153,6 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 		    	Debug( LDAP_DEBUG_ANY, 
 					"send_search_entry: conn %lu slap_sl_calloc failed\n",
 					op->o_connid );
-				ber_free( ber, 1 );
 	
 				set_ldap_error( rs, LDAP_OTHER, "out of memory" );
 				goto error_return;
@@ -1182,7 +1170,6 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 			    	Debug( LDAP_DEBUG_ANY, "send_search_entry: "
 					"conn %lu matched values filtering failed\n",
 					op->o_connid );
-				if ( op->o_res_ber == NULL ) ber_free_buf( ber );
 				set_ldap_error( rs, LDAP_OTHER,
 					"matched values filtering error" );
 				rc = rs->sr_err;
@@ -1191,9 +1178,86 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 		}
 	}
 
+	/* NOTE: moved before overlays callback circling because
+	 * they may modify entry and other stuff in rs */
+	if ( rs->sr_operational_attrs != NULL && op->o_vrFilter != NULL ) {
+		int	k = 0;
+		size_t	size;
+
+		for ( a = rs->sr_operational_attrs, i=0; a != NULL; a = a->a_next, i++ ) {
+			for ( j = 0; a->a_vals[j].bv_val != NULL; j++ ) k++;
+		}
+
+		size = i * sizeof(char *) + k;
+		if ( size > 0 ) {
+			char	*a_flags;
+
+			o_flags = slap_sl_calloc( 1, size, op->o_tmpmemctx );
+			if ( o_flags == NULL ) {
+			    	Debug( LDAP_DEBUG_ANY,
+					"send_search_entry: conn %lu "
+					"not enough memory "
+					"for matched values filtering\n",
+					op->o_connid );
+				set_ldap_error( rs, LDAP_OTHER,
+					"not enough memory for matched values filtering" );
+				goto error_return;
+			}
+			a_flags = (char *)(o_flags + i);
+			for ( a = rs->sr_operational_attrs, i=0; a != NULL; a = a->a_next, i++ ) {
+				for ( j = 0; a->a_vals[j].bv_val != NULL; j++ );
+				o_flags[i] = a_flags;
+				a_flags += j;
+			}
+			rc = filter_matched_values(op, rs->sr_operational_attrs, &o_flags) ; 
+		    
+			if ( rc == -1 ) {
+			    	Debug( LDAP_DEBUG_ANY,
+					"send_search_entry: conn %lu "
+					"matched values filtering failed\n", 
+					op->o_connid );
+				set_ldap_error( rs, LDAP_OTHER,
+					"matched values filtering error" );
+				rc = rs->sr_err;
+				goto error_return;
+			}
+		}
+	}
+
+	/*
+	 * First pass: decide which attributes and values are returned
+	 * and work out the exact size of their encoding, so that the
+	 * response can be written in one go into a buffer of that size.
+	 */
+	nattrs = nvals = 0;
+	for ( a = rs->sr_entry->e_attrs; a != NULL; a = a->a_next ) {
+		nattrs++;
+		for ( i = 0; !attrsonly && a->a_vals[i].bv_val != NULL; i++ ) nvals++;
+	}
+	for ( a = rs->sr_operational_attrs; a != NULL; a = a->a_next ) {
+		nattrs++;
+		for ( i = 0; !attrsonly && a->a_vals[i].bv_val != NULL; i++ ) nvals++;
+	}
+
+	/* Entries without any attributes (e.g. deletes sent by syncprov)
+	 * need no bookkeeping, a zero-sized request would look like ENOMEM */
+	if ( nattrs ) {
+		sa = slap_sl_calloc( 1, nattrs * sizeof(SendAttr) + nvals,
+			op->o_tmpmemctx );
+		if ( sa == NULL ) {
+			Debug( LDAP_DEBUG_ANY,
+				"send_search_entry: conn %lu slap_sl_calloc failed\n",
+				op->o_connid );
+			set_ldap_error( rs, LDAP_OTHER, "out of memory" );
+			goto error_return;
+		}
+		v_flags = (char *)( sa + nattrs );
+	}
+
+	attrs_len = 0;
 	for ( a = rs->sr_entry->e_attrs, j = 0; a != NULL; a = a->a_next, j++ ) {
 		AttributeDescription *desc = a->a_desc;
-		int finish = 0;
+		SendAttr *s = &sa[j];
 
 		if ( rs->sr_attrs == NULL ) {
 			/* all user attrs request, skip operational attributes */
@@ -1230,23 +1294,12 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 				        op->o_connid, desc->ad_cname.bv_val );
 				continue;
 			}
-
-			if (( rc = ber_printf( ber, "{O[" /*]}*/ , &desc->ad_cname )) == -1 ) {
-				Debug( LDAP_DEBUG_ANY, 
-					"send_search_entry: conn %lu  ber_printf failed\n", 
-					op->o_connid );
-
-				if ( op->o_res_ber == NULL ) ber_free_buf( ber );
-				set_ldap_error( rs, LDAP_OTHER,
-					"encoding description error");
-				rc = rs->sr_err;
-				goto error_return;
-			}
-			finish = 1;
+			s->sa_send = 1;
 
 		} else {
-			int first = 1;
+			s->sa_vals = v_flags;
 			for ( i = 0; a->a_nvals[i].bv_val != NULL; i++ ) {
+				v_flags++;
 				if ( ! access_allowed( op, rs->sr_entry,
 					desc, &a->a_nvals[i], ACL_READ, &acl_state ) )
 				{
@@ -1262,104 +1315,25 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 					continue;
 				}
 
-				if ( first ) {
-					first = 0;
-					finish = 1;
-					if (( rc = ber_printf( ber, "{O[" /*]}*/ , &desc->ad_cname )) == -1 ) {
-						Debug( LDAP_DEBUG_ANY,
-							"send_search_entry: conn %lu  ber_printf failed\n", 
-							op->o_connid );
-
-						if ( op->o_res_ber == NULL ) ber_free_buf( ber );
-						set_ldap_error( rs, LDAP_OTHER,
-							"encoding description error");
-						rc = rs->sr_err;
-						goto error_return;
-					}
-				}
-				if (( rc = ber_printf( ber, "O", &a->a_vals[i] )) == -1 ) {
-					Debug( LDAP_DEBUG_ANY,
-						"send_search_entry: conn %lu  "
-						"ber_printf failed.\n", op->o_connid );
-
-					if ( op->o_res_ber == NULL ) ber_free_buf( ber );
-					set_ldap_error( rs, LDAP_OTHER,
-						"encoding values error" );
-					rc = rs->sr_err;
-					goto error_return;
-				}
+				s->sa_vals[i] = 1;
+				s->sa_send = 1;
+				s->sa_setlen += ber_calc_len( LBER_OCTETSTRING,
+					a->a_vals[i].bv_len );
 			}
 		}
 
-		if ( finish && ( rc = ber_printf( ber, /*{[*/ "]N}" )) == -1 ) {
-			Debug( LDAP_DEBUG_ANY,
-				"send_search_entry: conn %lu ber_printf failed\n", 
-				op->o_connid );
-
-			if ( op->o_res_ber == NULL ) ber_free_buf( ber );
-			set_ldap_error( rs, LDAP_OTHER, "encode end error" );
-			rc = rs->sr_err;
-			goto error_return;
+		if ( s->sa_send ) {
+			s->sa_len = ber_calc_len( LBER_OCTETSTRING, desc->ad_cname.bv_len ) +
+				ber_calc_len( LBER_SET, s->sa_setlen );
+			attrs_len += ber_calc_len( LBER_SEQUENCE, s->sa_len );
 		}
 	}
 
-	/* NOTE: moved before overlays callback circling because
-	 * they may modify entry and other stuff in rs */
-	if ( rs->sr_operational_attrs != NULL && op->o_vrFilter != NULL ) {
-		int	k = 0;
-		size_t	size;
-
-		for ( a = rs->sr_operational_attrs, i=0; a != NULL; a = a->a_next, i++ ) {
-			for ( j = 0; a->a_vals[j].bv_val != NULL; j++ ) k++;
-		}
-
-		size = i * sizeof(char *) + k;
-		if ( size > 0 ) {
-			char	*a_flags, **tmp;
-		
-			/*
-			 * Reuse previous memory - we likely need less space
-			 * for operational attributes
-			 */
-			tmp = slap_sl_realloc( e_flags, i * sizeof(char *) + k,
-				op->o_tmpmemctx );
-			if ( tmp == NULL ) {
-			    	Debug( LDAP_DEBUG_ANY,
-					"send_search_entry: conn %lu "
-					"not enough memory "
-					"for matched values filtering\n",
-					op->o_connid );
-				if ( op->o_res_ber == NULL ) ber_free_buf( ber );
-				set_ldap_error( rs, LDAP_OTHER,
-					"not enough memory for matched values filtering" );
-				goto error_return;
-			}
-			e_flags = tmp;
-			a_flags = (char *)(e_flags + i);
-			memset( a_flags, 0, k );
-			for ( a = rs->sr_operational_attrs, i=0; a != NULL; a = a->a_next, i++ ) {
-				for ( j = 0; a->a_vals[j].bv_val != NULL; j++ );
-				e_flags[i] = a_flags;
-				a_flags += j;
-			}
-			rc = filter_matched_values(op, rs->sr_operational_attrs, &e_flags) ; 
-		    
-			if ( rc == -1 ) {
-			    	Debug( LDAP_DEBUG_ANY,
-					"send_search_entry: conn %lu "
-					"matched values filtering failed\n", 
-					op->o_connid );
-				if ( op->o_res_ber == NULL ) ber_free_buf( ber );
-				set_ldap_error( rs, LDAP_OTHER,
-					"matched values filtering error" );
-				rc = rs->sr_err;
-				goto error_return;
-			}
-		}
-	}
-
-	for (a = rs->sr_operational_attrs, j=0; a != NULL; a = a->a_next, j++ ) {
+	for ( a = rs->sr_operational_attrs, k = j, j = 0; a != NULL;
+		a = a->a_next, j++ )
+	{
 		AttributeDescription *desc = a->a_desc;
+		SendAttr *s = &sa[k + j];
 
 		if ( rs->sr_attrs == NULL ) {
 			/* all user attrs request, skip operational attributes */
@@ -1397,21 +1371,11 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 			continue;
 		}
 
-		rc = ber_printf( ber, "{O[" /*]}*/ , &desc->ad_cname );
-		if ( rc == -1 ) {
-			Debug( LDAP_DEBUG_ANY,
-				"send_search_entry: conn %lu  "
-				"ber_printf failed\n", op->o_connid );
-
-			if ( op->o_res_ber == NULL ) ber_free_buf( ber );
-			set_ldap_error( rs, LDAP_OTHER,
-				"encoding description error" );
-			rc = rs->sr_err;
-			goto error_return;
-		}
-
+		s->sa_send = 1;
 		if ( ! attrsonly ) {
+			s->sa_vals = v_flags;
 			for ( i = 0; a->a_vals[i].bv_val != NULL; i++ ) {
+				v_flags++;
 				if ( ! access_allowed( op, rs->sr_entry,
 					desc, &a->a_vals[i], ACL_READ, &acl_state ) )
 				{
@@ -1423,66 +1387,117 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 					continue;
 				}
 
-				if ( op->o_vrFilter && e_flags[j][i] == 0 ){
+				if ( op->o_vrFilter && o_flags[j][i] == 0 ){
 					continue;
 				}
 
-				if (( rc = ber_printf( ber, "O", &a->a_vals[i] )) == -1 ) {
-					Debug( LDAP_DEBUG_ANY,
-						"send_search_entry: conn %lu  ber_printf failed\n", 
-						op->o_connid );
-
-					if ( op->o_res_ber == NULL ) ber_free_buf( ber );
-					set_ldap_error( rs, LDAP_OTHER,
-						"encoding values error" );
-					rc = rs->sr_err;
-					goto error_return;
-				}
+				s->sa_vals[i] = 1;
+				s->sa_setlen += ber_calc_len( LBER_OCTETSTRING,
+					a->a_vals[i].bv_len );
 			}
 		}
 
-		if (( rc = ber_printf( ber, /*{[*/ "]N}" )) == -1 ) {
+		s->sa_len = ber_calc_len( LBER_OCTETSTRING, desc->ad_cname.bv_len ) +
+			ber_calc_len( LBER_SET, s->sa_setlen );
+		attrs_len += ber_calc_len( LBER_SEQUENCE, s->sa_len );
+	}
+
+	/* free e_flags */
+	if ( e_flags ) {
+		slap_sl_free( e_flags, op->o_tmpmemctx );
+		e_flags = NULL;
+	}
+	if ( o_flags ) {
+		slap_sl_free( o_flags, op->o_tmpmemctx );
+		o_flags = NULL;
+	}
+
+	/* controls are small, encode them aside to learn their size */
+	if ( rs->sr_ctrls ) {
+		ber_init2( cber, NULL, LBER_USE_DER );
+		ber_set_option( cber, LBER_OPT_BER_MEMCTX, &op->o_tmpmemctx );
+		if ( send_ldap_controls( op, cber, rs->sr_ctrls ) == -1 ||
+			ber_flatten2( cber, &ctrls, 0 ) == -1 )
+		{
 			Debug( LDAP_DEBUG_ANY,
 				"send_search_entry: conn %lu  ber_printf failed\n",
 				op->o_connid );
 
-			if ( op->o_res_ber == NULL ) ber_free_buf( ber );
-			set_ldap_error( rs, LDAP_OTHER, "encode end error" );
+			ber_free_buf( cber );
+			set_ldap_error( rs, LDAP_OTHER, "encode controls error" );
 			rc = rs->sr_err;
 			goto error_return;
 		}
 	}
 
-	/* free e_flags */
-	if ( e_flags ) {
-		slap_sl_free( e_flags, op->o_tmpmemctx );
-		e_flags = NULL;
+	/* a complete LDAPMessage, unless appending to a read back control
+	 * or a CLDAPv2 response */
+	msg = op->o_res_ber == NULL;
+#ifdef LDAP_CONNECTIONLESS
+	if ( op->o_conn && op->o_conn->c_is_udp ) {
+		msg = op->o_protocol != LDAP_VERSION2;
 	}
+#endif
 
-	rc = ber_printf( ber, /*{{*/ "}N}" );
+	entry_len = ber_calc_len( LBER_OCTETSTRING, rs->sr_entry->e_name.bv_len ) +
+		ber_calc_len( LBER_SEQUENCE, attrs_len );
+	msg_len = ber_calc_int_len( op->o_msgid, LBER_INTEGER ) +
+		ber_calc_len( LDAP_RES_SEARCH_ENTRY, entry_len ) + ctrls.bv_len;
 
-	if( rc != -1 ) {
-		rc = send_ldap_controls( op, ber, rs->sr_ctrls );
+	if ( op->o_res_ber ) {
+		/* read back control or LDAP_CONNECTIONLESS */
+	    ber = op->o_res_ber;
+	} else {
+		struct berval	bv;
+
+		bv.bv_len = ber_calc_len( LBER_SEQUENCE, msg_len );
+		bv.bv_val = op->o_tmpalloc( bv.bv_len, op->o_tmpmemctx );
+
+		ber_init2( ber, &bv, LBER_USE_DER );
+		ber_set_option( ber, LBER_OPT_BER_MEMCTX, &op->o_tmpmemctx );
 	}
 
-	if( rc != -1 ) {
-#ifdef LDAP_CONNECTIONLESS
-		if( op->o_conn && op->o_conn->c_is_udp ) {
-			if ( op->o_protocol != LDAP_VERSION2 ) {
-				rc = ber_printf( ber, /*{*/ "N}" );
-			}
-		} else
-#endif
-		if ( op->o_res_ber == NULL ) {
-			rc = ber_printf( ber, /*{*/ "N}" );
-		}
+	/* Second pass: write it out, every length is already known */
+	rc = 0;
+	if ( msg ) {
+		if ( ber_put_header( ber, LBER_SEQUENCE, msg_len ) == -1 ||
+			ber_put_int( ber, op->o_msgid, LBER_INTEGER ) == -1 )
+			rc = -1;
+	}
+	if ( rc != -1 &&
+		( ber_put_header( ber, LDAP_RES_SEARCH_ENTRY, entry_len ) == -1 ||
+		ber_put_berval( ber, &rs->sr_entry->e_name, LBER_OCTETSTRING ) == -1 ||
+		ber_put_header( ber, LBER_SEQUENCE, attrs_len ) == -1 ) )
+		rc = -1;
+
+	for ( a = rs->sr_entry->e_attrs, j = 0; rc != -1 && a != NULL;
+		a = a->a_next, j++ )
+	{
+		if ( sa[j].sa_send )
+			rc = send_search_entry_attr( ber, a, &sa[j] );
+	}
+	for ( a = rs->sr_operational_attrs, j = k; rc != -1 && a != NULL;
+		a = a->a_next, j++ )
+	{
+		if ( sa[j].sa_send )
+			rc = send_search_entry_attr( ber, a, &sa[j] );
 	}
 
+	if ( rc != -1 && ctrls.bv_len ) {
+		rc = ber_write( ber, ctrls.bv_val, ctrls.bv_len, 0 );
+	}
+
+	if ( rs->sr_ctrls ) {
+		ber_free_buf( cber );
+	}
+	slap_sl_free( sa, op->o_tmpmemctx );
+	sa = NULL;
+
 	if ( rc == -1 ) {
 		Debug( LDAP_DEBUG_ANY, "ber_printf failed\n" );
 
 		if ( op->o_res_ber == NULL ) ber_free_buf( ber );
-		set_ldap_error( rs, LDAP_OTHER, "encode entry end error" );
+		set_ldap_error( rs, LDAP_OTHER, "encode entry error" );
 		rc = rs->sr_err;
 		goto error_return;
 	}
@@ -1526,6 +1541,12 @@ error_return:;
 	if ( e_flags ) {
 		slap_sl_free( e_flags, op->o_tmpmemctx );
 	}
+	if ( o_flags ) {
+		slap_sl_free( o_flags, op->o_tmpmemctx );
+	}
+	if ( sa ) {
+		slap_sl_free( sa, op->o_tmpmemctx );
+	}
 
 	/* FIXME: Can break if rs now contains an extended response */
 	if ( rs->sr_operational_attrs ) {
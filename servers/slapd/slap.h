@@ -144,6 +144,8 @@ LDAP_BEGIN_DECL
 
 #define SLAP_CONN_MAX_PENDING_DEFAULT	100
 #define SLAP_CONN_MAX_PENDING_AUTH	1000
+#define SLAP_CONN_MAX_BATCH_DEFAULT	32
+#define SLAP_CONN_MAX_BATCH_LIMIT	256
 #define SLAP_MAX_FILTER_DEPTH_DEFAULT	1000
 
 #define SLAP_TEXT_BUFLEN (256)
@@ -2969,6 +2971,8 @@ struct Connection {
 	char	c_needs_tls_accept;	/* true if SSL_accept should be called */
 #endif
 	char	c_sasl_layers;	 /* true if we need to install SASL i/o handlers */
+	char	c_needs_compress;	/* true if we need to install compression */
+	signed char	c_compress_level;	/* zlib level for c_needs_compress */
 	char	c_sasl_done;		/* SASL completed once */
 	void	*c_sasl_authctx;	/* SASL authentication context */
 	void	*c_sasl_sockctx;	/* SASL security layer context */
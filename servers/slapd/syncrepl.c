@@ -60,6 +60,20 @@ static AttributeDescription *sy_ad_dseeLastChange;
 
 struct syncinfo_s;
 
+/* The present list is a table of buckets indexed by the first two
+ * bytes of the UUID, each holding a sorted array of the remaining
+ * bytes. That costs PRESENT_KEYLEN bytes per UUID instead of an
+ * allocation plus an Avlnode apiece.
+ */
+#define	PRESENT_NBUCKETS	65536
+#define	PRESENT_KEYLEN	(UUIDLEN-2)
+
+typedef struct presentbucket {
+	unsigned char	*pb_keys;
+	unsigned	pb_num;
+	unsigned	pb_max;
+} presentbucket;
+
 struct nonpresent_entry {
 	struct berval *npe_name;
 	struct berval *npe_nname;
@@ -156,12 +170,18 @@ typedef struct syncinfo_s {
 	int			si_syncdata;
 	int			si_logstate;
 	int			si_lazyCommit;
+	int			si_deltamods;	/* ask for changes, not entries */
+	int			si_emptyload;	/* refreshing into an empty DB */
+	int			si_refreshbatch;	/* refresh entries per txn */
+	int			si_compress;	/* zlib level, 0 for none */
+	int			si_batchcnt;
+	OpExtra			*si_batchtxn;
 	int			si_got;
 	int			si_strict_refresh;	/* stop listening during fallback refresh */
 	int			si_too_old;
 	int			si_is_configdb;
 	ber_int_t	si_msgid;
-	Avlnode			*si_presentlist;
+	presentbucket		*si_presentlist;
 	LDAP			*si_ld;
 	Connection		*si_conn;
 	LDAP_LIST_HEAD(np, nonpresent_entry)	si_nonpresentlist;
@@ -180,6 +200,8 @@ typedef struct syncinfo_s {
 	struct berval	si_connaddr;
 	struct berval	si_lastCookieRcvd;
 	struct berval	si_lastCookieSent;
+	ber_len_t	si_bytesRcvd;	/* compressed, this connection */
+	ber_len_t	si_bytesInflated;
 	struct berval	si_monitor_ndn;
 	char	si_connaddrbuf[LDAP_IPADDRLEN];
 
@@ -187,11 +209,10 @@ typedef struct syncinfo_s {
 	ldap_pvt_thread_mutex_t	si_mutex;
 } syncinfo_t;
 
-static int syncuuid_cmp( const void *, const void * );
 static int presentlist_insert( syncinfo_t* si, struct berval *syncUUID );
-static void presentlist_delete( Avlnode **av, struct berval *syncUUID );
-static char *presentlist_find( Avlnode *av, struct berval *syncUUID );
-static int presentlist_free( Avlnode *av );
+static void presentlist_delete( presentbucket *pl, struct berval *syncUUID );
+static int presentlist_find( presentbucket *pl, struct berval *syncUUID );
+static int presentlist_free( presentbucket *pl );
 static void syncrepl_del_nonpresent( Operation *, syncinfo_t *, BerVarray, struct sync_cookie *, int );
 static int syncrepl_message_to_op(
 					syncinfo_t *, Operation *, LDAPMessage *, int );
@@ -202,6 +223,10 @@ static int syncrepl_entry(
 					syncinfo_t *, Operation*, Entry*,
 					Modifications**,int, struct berval*,
 					struct berval *cookieCSN );
+static int syncrepl_entry_mods(
+					syncinfo_t *, Operation *, LDAPMessage *,
+					BerElement *, struct berval *,
+					struct berval *cookieCSN );
 static int syncrepl_updateCookie(
 					syncinfo_t *, Operation *,
 					struct sync_cookie *, int save );
@@ -578,8 +603,8 @@ ldap_sync_search(
 {
 	BerElementBuffer berbuf;
 	BerElement *ber = (BerElement *)&berbuf;
-	LDAPControl c[3], *ctrls[4];
-	int rc;
+	LDAPControl c[4], *ctrls[5];
+	int rc, nc;
 	int rhint;
 	char *base;
 	char **attrs, *lattrs[9];
@@ -762,16 +787,31 @@ ldap_sync_search(
 		BER_BVZERO( &c[1].ldctl_value );
 		c[1].ldctl_iscritical = 1;
 		ctrls[1] = &c[1];
+		nc = 2;
 
 		if ( !BER_BVISNULL( &si->si_bindconf.sb_authzId ) ) {
-			c[2].ldctl_oid = LDAP_CONTROL_PROXY_AUTHZ;
-			c[2].ldctl_value = si->si_bindconf.sb_authzId;
-			c[2].ldctl_iscritical = 1;
-			ctrls[2] = &c[2];
-			ctrls[3] = NULL;
-		} else {
-			ctrls[2] = NULL;
+			c[nc].ldctl_oid = LDAP_CONTROL_PROXY_AUTHZ;
+			c[nc].ldctl_value = si->si_bindconf.sb_authzId;
+			c[nc].ldctl_iscritical = 1;
+			ctrls[nc] = &c[nc];
+			nc++;
+		}
+
+		/* Changes can only be applied as sent if we keep everything
+		 * the provider has, as is, and nobody else writes here.
+		 */
+		if ( si->si_deltamods && abs(si->si_type) == LDAP_SYNC_REFRESH_AND_PERSIST &&
+			!si->si_syncdata && si->si_allattrs && si->si_allopattrs &&
+			!si->si_attrsonly && !si->si_exattrs && !si->si_rewrite &&
+			!SLAP_MULTIPROVIDER( si->si_be ) )
+		{
+			c[nc].ldctl_oid = LDAP_CONTROL_X_SYNC_MODS;
+			BER_BVZERO( &c[nc].ldctl_value );
+			c[nc].ldctl_iscritical = 0;
+			ctrls[nc] = &c[nc];
+			nc++;
 		}
+		ctrls[nc] = NULL;
 	}
 
 	si->si_refreshDone = 0;
@@ -1013,6 +1053,44 @@ check_syncprov(
 	return changed;
 }
 
+/* Is this consumer the only thing writing to its database? */
+static int
+syncrepl_sole_writer(
+	syncinfo_t *si )
+{
+	return !si->si_is_configdb && !SLAP_MULTIPROVIDER( si->si_be ) &&
+		si->si_cookieState->cs_ref == 1;
+}
+
+/* Overlays that act on a write as soon as it is answered, before a
+ * refresh batch is committed. If the batch is then aborted they have
+ * already passed on changes the database never kept.
+ */
+static const char *syncrepl_batch_unsafe[] = {
+	"syncprov",		/* sends them to our own consumers */
+	"accesslog",	/* logs them */
+	"auditlog",		/* writes them out */
+	NULL
+};
+
+/* Can refresh entries be applied in batches? */
+static int
+syncrepl_batch_safe(
+	syncinfo_t *si )
+{
+	int i;
+
+	if ( !syncrepl_sole_writer( si ))
+		return 0;
+	for ( i = 0; syncrepl_batch_unsafe[i]; i++ ) {
+		if ( overlay_is_inst( si->si_be, syncrepl_batch_unsafe[i] ) ||
+			( si->si_wbe != si->si_be &&
+				overlay_is_inst( si->si_wbe, syncrepl_batch_unsafe[i] )))
+			return 0;
+	}
+	return 1;
+}
+
 static int
 do_syncrep1(
 	Operation *op,
@@ -1061,6 +1139,18 @@ do_syncrep1(
 
 	ldap_set_option( si->si_ld, LDAP_OPT_REFERRALS, LDAP_OPT_OFF );
 
+	si->si_bytesRcvd = si->si_bytesInflated = 0;
+	if ( si->si_compress ) {
+		/* not fatal, the provider may not support it */
+		rc = ldap_start_compress_s( si->si_ld, si->si_compress, NULL, NULL );
+		if ( rc != LDAP_SUCCESS ) {
+			Debug( LDAP_DEBUG_ANY, "do_syncrep1: %s "
+				"unable to start compression: %s (%d)\n",
+				si->si_ridtxt, ldap_err2string( rc ), rc );
+		}
+		rc = LDAP_SUCCESS;
+	}
+
 	si->si_syncCookie.rid = si->si_rid;
 
 	/* whenever there are multiple data sources possible, advertise sid */
@@ -1180,6 +1270,32 @@ do_syncrep1(
 		}
 	}
 
+	/* With no sync state and nothing at the search base, every entry
+	 * of this refresh is new and needn't be looked up by entryUUID.
+	 */
+	si->si_emptyload = 0;
+	if ( !si->si_syncCookie.ctxcsn && syncrepl_sole_writer( si ) &&
+		si->si_syncdata != SYNCDATA_CHANGELOG
+#ifdef LDAP_CONTROL_X_DIRSYNC
+		&& si->si_ctype != MSAD_DIRSYNC
+#endif
+		) {
+		BackendDB *be = op->o_bd;
+		Entry *e = NULL;
+
+		op->o_bd = si->si_be;
+		if ( be_entry_get_rw( op, si->si_rewrite ? &si->si_suffixm : &si->si_base,
+			NULL, NULL, 0, &e ) == LDAP_NO_SUCH_OBJECT ) {
+			si->si_emptyload = 1;
+			Debug( LDAP_DEBUG_SYNC, "do_syncrep1: %s "
+				"database is empty, loading without lookups\n",
+				si->si_ridtxt );
+		} else if ( e ) {
+			be_entry_release_r( op, e );
+		}
+		op->o_bd = be;
+	}
+
 	Debug( LDAP_DEBUG_SYNC, "do_syncrep1: %s starting refresh (sending cookie=%s)\n",
 		si->si_ridtxt, si->si_syncCookie.octet_str.bv_val ?
 		si->si_syncCookie.octet_str.bv_val : "" );
@@ -1313,6 +1429,87 @@ get_pmutex(
 	return 0;
 }
 
+/* During refresh, apply up to si_refreshbatch entries in a single
+ * backend transaction instead of committing each one. The write lock
+ * is held across entries, so this is only done when this consumer is
+ * the database's sole writer, and nothing on the database acts on the
+ * entries before they are committed.
+ */
+static void
+syncrepl_batch_begin(
+	syncinfo_t *si,
+	Operation *op )
+{
+	BackendDB *be = op->o_bd;
+
+	if ( si->si_batchtxn || !si->si_refreshbatch ||
+		!SLAP_TXNS( si->si_wbe ) || !syncrepl_batch_safe( si ))
+		return;
+
+	op->o_bd = si->si_wbe;
+	if ( op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_BEGIN, &si->si_batchtxn ) ) {
+		Debug( LDAP_DEBUG_ANY, "syncrepl_batch_begin: %s "
+			"couldn't start DB transaction\n", si->si_ridtxt );
+		si->si_batchtxn = NULL;
+	}
+	op->o_bd = be;
+	si->si_batchcnt = 0;
+}
+
+static int
+syncrepl_batch_end(
+	syncinfo_t *si,
+	Operation *op,
+	int commit )
+{
+	BackendDB *be = op->o_bd;
+	int rc = LDAP_SUCCESS;
+
+	if ( !si->si_batchtxn )
+		return rc;
+
+	LDAP_SLIST_REMOVE( &op->o_extra, si->si_batchtxn, OpExtra, oe_next );
+	op->o_bd = si->si_wbe;
+	if ( commit ) {
+		rc = op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_COMMIT, &si->si_batchtxn );
+		if ( rc ) {
+			Debug( LDAP_DEBUG_ANY, "syncrepl_batch_end: %s "
+				"commit of %d entries failed (%d)\n",
+				si->si_ridtxt, si->si_batchcnt, rc );
+			rc = LDAP_OTHER;
+		} else {
+			Debug( LDAP_DEBUG_SYNC, "syncrepl_batch_end: %s "
+				"committed %d entries\n", si->si_ridtxt, si->si_batchcnt );
+		}
+	} else {
+		op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_ABORT, &si->si_batchtxn );
+	}
+	op->o_bd = be;
+	si->si_batchtxn = NULL;
+	si->si_batchcnt = 0;
+	return rc;
+}
+
+/* Don't keep a refresh batch open while waiting on the network */
+static int
+syncrepl_result(
+	syncinfo_t *si,
+	Operation *op,
+	struct timeval *tout,
+	LDAPMessage **msg )
+{
+	if ( si->si_batchtxn ) {
+		struct timeval zero = { 0, 0 };
+		int rc = ldap_result( si->si_ld, si->si_msgid, LDAP_MSG_ONE, &zero, msg );
+
+		if ( rc )
+			return rc;
+		if ( syncrepl_batch_end( si, op, 1 ) )
+			return SYNC_ERROR;
+	}
+	return ldap_result( si->si_ld, si->si_msgid, LDAP_MSG_ONE, tout, msg );
+}
+
 static int
 do_syncrep2(
 	Operation *op,
@@ -1359,8 +1556,7 @@ do_syncrep2(
 		tout.tv_sec = si->si_bindconf.sb_timeout_api;
 	}
 
-	while ( ( rc = ldap_result( si->si_ld, si->si_msgid, LDAP_MSG_ONE,
-		&tout, &msg ) ) > 0 )
+	while ( ( rc = syncrepl_result( si, op, &tout, &msg ) ) > 0 )
 	{
 		int				match, punlock, syncstate;
 		struct berval	*retdata, syncUUID[2], cookie = BER_BVNULL;
@@ -1377,6 +1573,20 @@ do_syncrep2(
 			goto done;
 		}
 		gettimeofday( &si->si_lastcontact, NULL );
+		if ( si->si_compress ) {
+			Sockbuf *sb;
+			ldap_pvt_compress_stats cs;
+
+			ldap_get_option( si->si_ld, LDAP_OPT_SOCKBUF, &sb );
+			if ( !ldap_pvt_compress_get_stats( sb, &cs ) ) {
+				si->si_bytesRcvd = cs.cs_wire_in;
+				si->si_bytesInflated = cs.cs_raw_in;
+			}
+		}
+		/* only entries are batched, finish any batch before the rest */
+		if ( ldap_msgtype( msg ) != LDAP_RES_SEARCH_ENTRY &&
+			( rc = syncrepl_batch_end( si, op, 1 ) ) )
+			goto done;
 		switch( ldap_msgtype( msg ) ) {
 		case LDAP_RES_SEARCH_ENTRY:
 #ifdef LDAP_CONTROL_X_DIRSYNC
@@ -1579,6 +1789,30 @@ logerr:
 					default:
 						break;
 					}
+			} else if ( syncstate == LDAP_SYNC_MODIFY && si->si_deltamods &&
+				ber_peek_tag( ber, &len ) == LDAP_TAG_SYNC_MODS )
+			{
+				modlist = NULL;
+				if ( punlock < 0 ) {
+					if (( rc = get_pmutex( si ))) {
+						ldap_controls_free( rctrls );
+						goto done;
+					}
+				}
+				rc = syncrepl_entry_mods( si, op, msg, ber, syncUUID,
+					syncCookie.ctxcsn );
+				if ( rc == LDAP_SUCCESS && syncCookie.ctxcsn ) {
+					rc = syncrepl_updateCookie( si, op, &syncCookie, 0 );
+				} else if ( rc != LDAP_SUCCESS ) {
+					/* the change didn't fit our copy, fetch it again */
+					bdn.bv_val[bdn.bv_len] = '\0';
+					Debug( LDAP_DEBUG_ANY, "do_syncrep2: %s "
+						"modifications don't apply to (%s), switching to REFRESH\n",
+						si->si_ridtxt, bdn.bv_val );
+					rc = LDAP_SYNC_REFRESH_REQUIRED;
+				}
+				if ( punlock < 0 )
+					ldap_pvt_thread_mutex_unlock( &si->si_cookieState->cs_pmutex );
 			} else if ( ( rc = syncrepl_message_to_entry( si, op, msg,
 				&modlist, &entry, syncstate, syncUUID ) ) == LDAP_SUCCESS )
 			{
@@ -1590,10 +1824,18 @@ logerr:
 						goto done;
 					}
 				}
-				if ( ( rc = syncrepl_entry( si, op, entry, &modlist,
-					syncstate, syncUUID, syncCookie.ctxcsn ) ) == LDAP_SUCCESS &&
-					syncCookie.ctxcsn )
-				{
+				if ( refreshing )
+					syncrepl_batch_begin( si, op );
+				rc = syncrepl_entry( si, op, entry, &modlist,
+					syncstate, syncUUID, syncCookie.ctxcsn );
+				if ( rc != LDAP_SUCCESS ) {
+					/* the failed op may have left partial writes behind */
+					syncrepl_batch_end( si, op, 0 );
+				} else if ( si->si_batchtxn &&
+					++si->si_batchcnt >= si->si_refreshbatch ) {
+					rc = syncrepl_batch_end( si, op, 1 );
+				}
+				if ( rc == LDAP_SUCCESS && syncCookie.ctxcsn ) {
 					rc = syncrepl_updateCookie( si, op, &syncCookie, 0 );
 				}
 				if ( punlock < 0 )
@@ -2014,6 +2256,8 @@ logerr:
 		if ( ldap_pvt_thread_pool_pausing( &connection_pool )) {
 			slap_sync_cookie_free( &syncCookie, 0 );
 			slap_sync_cookie_free( &syncCookie_req, 0 );
+			if ( syncrepl_batch_end( si, op, 1 ) )
+				return SYNC_ERROR;
 			return SYNC_PAUSED;
 		}
 	}
@@ -2025,6 +2269,8 @@ logerr:
 	}
 
 done:
+	if ( syncrepl_batch_end( si, op, 1 ) && !rc )
+		rc = SYNC_ERROR;
 	if ( err != LDAP_SUCCESS ) {
 		Debug( LDAP_DEBUG_ANY,
 			"do_syncrep2: %s (%d) %s\n",
@@ -3621,6 +3867,161 @@ done:
 	return rc;
 }
 
+/* Apply the changes sent in the Sync State control of a
+ * LDAP_SYNC_MODIFY instead of the whole entry. If they don't
+ * apply cleanly to our copy of the entry we have lost sync.
+ */
+static int
+syncrepl_entry_mods(
+	syncinfo_t	*si,
+	Operation	*op,
+	LDAPMessage	*msg,
+	BerElement	*ber,
+	struct berval	*syncUUID,
+	struct berval	*syncCSN )
+{
+	Backend *be = op->o_bd;
+	SlapReply rs = { REP_RESULT };
+	slap_callback cb = { NULL, syncrepl_null_callback, NULL, NULL };
+	req_modify_s ms;
+	Modifications *modlist = NULL, *mod, **modtail;
+	Entry *e = NULL;
+	Attribute *a;
+
+	const char	*text;
+	char txtbuf[SLAP_TEXT_BUFLEN];
+	size_t textlen = sizeof txtbuf;
+
+	struct berval	bdn, bv2, dn = BER_BVNULL, ndn = BER_BVNULL;
+	int		rc, i, sid, is_ctx, queued = 0;
+
+	rc = ldap_get_dn_ber( si->si_ld, msg, NULL, &bdn );
+	if ( rc != LDAP_SUCCESS ) {
+		Debug( LDAP_DEBUG_ANY, "syncrepl_entry_mods: %s dn get failed (%d)\n",
+			si->si_ridtxt, rc );
+		return rc;
+	}
+
+	REWRITE_DN( si, bdn, bv2, dn, ndn );
+	if ( rc != LDAP_SUCCESS ) {
+		Debug( LDAP_DEBUG_ANY, "syncrepl_entry_mods: %s "
+			"dn \"%s\" normalization failed (%d)\n",
+			si->si_ridtxt, bdn.bv_val, rc );
+		return rc;
+	}
+
+	rc = slap_parse_modlist( op, &rs, ber, &ms );
+	if ( rc != LDAP_SUCCESS ) {
+		Debug( LDAP_DEBUG_ANY, "syncrepl_entry_mods: %s %s (%s)\n",
+			si->si_ridtxt, rs.sr_text, dn.bv_val );
+		goto done;
+	}
+	modlist = ms.rs_mods.rs_modlist;
+	if ( modlist == NULL ) {
+		rc = LDAP_PROTOCOL_ERROR;
+		goto done;
+	}
+
+	Debug( LDAP_DEBUG_SYNC,
+		"syncrepl_entry_mods: %s LDAP_RES_SEARCH_ENTRY(LDAP_SYNC_MODIFY) dn=%s csn=%s\n",
+		si->si_ridtxt, dn.bv_val, syncCSN ? syncCSN->bv_val : "(none)" );
+
+	/* Check we're not covered by current contextCSN */
+	if ( syncCSN ) {
+		sid = slap_parse_csn_sid( syncCSN );
+		ldap_pvt_thread_mutex_lock( &si->si_cookieState->cs_mutex );
+		for ( i=0;
+			i < si->si_cookieState->cs_num &&
+				sid <= si->si_cookieState->cs_sids[i];
+			i++ ) {
+			if ( si->si_cookieState->cs_sids[i] == sid &&
+				ber_bvcmp( syncCSN, &si->si_cookieState->cs_vals[i] ) <= 0 ) {
+				Debug( LDAP_DEBUG_SYNC, "syncrepl_entry_mods: %s "
+					"entry '%s' csn=%s not new enough, ignored\n",
+					si->si_ridtxt, dn.bv_val, syncCSN->bv_val );
+				ldap_pvt_thread_mutex_unlock( &si->si_cookieState->cs_mutex );
+				goto done;
+			}
+		}
+		ldap_pvt_thread_mutex_unlock( &si->si_cookieState->cs_mutex );
+	}
+
+	rc = slap_mods_check( op, modlist, &text, txtbuf, textlen, NULL );
+	if ( rc != LDAP_SUCCESS ) {
+		Debug( LDAP_DEBUG_ANY, "syncrepl_entry_mods: %s mods check (%s)\n",
+			si->si_ridtxt, text );
+		goto done;
+	}
+
+	/* Drop all updates to the contextCSN of the context entry
+	 * (ITS#4622, etc.)
+	 */
+	is_ctx = dn_match( &ndn, &be->be_nsuffix[0] );
+	for ( modtail = &modlist; *modtail ; ) {
+		mod = *modtail;
+		if ( is_ctx && mod->sml_desc == slap_schema.si_ad_contextCSN ) {
+			*modtail = mod->sml_next;
+			slap_mod_free( &mod->sml_mod, 0 );
+			ch_free( mod );
+		} else {
+			modtail = &mod->sml_next;
+		}
+	}
+	if ( modlist == NULL )
+		goto done;
+
+	/* The changes must be made to the entry we know by this UUID */
+	rc = be_entry_get_rw( op, &ndn, NULL, NULL, 0, &e );
+	if ( rc == LDAP_SUCCESS ) {
+		a = attr_find( e->e_attrs, slap_schema.si_ad_entryUUID );
+		if ( !a || !bvmatch( &a->a_nvals[0], syncUUID ))
+			rc = LDAP_NO_SUCH_OBJECT;
+		be_entry_release_r( op, e );
+	}
+	if ( rc != LDAP_SUCCESS ) {
+		rc = LDAP_NO_SUCH_OBJECT;
+		goto done;
+	}
+
+	if ( syncCSN ) {
+		slap_queue_csn( op, syncCSN );
+		queued = 1;
+	}
+
+	op->o_tag = LDAP_REQ_MODIFY;
+	op->o_req_dn = dn;
+	op->o_req_ndn = ndn;
+	op->orm_modlist = modlist;
+	op->orm_increment = ms.rs_increment;
+	op->orm_no_opattrs = 1;
+	op->o_callback = &cb;
+	op->o_bd = si->si_wbe;
+	slap_op_time( &op->o_time, &op->o_tincr );
+
+	rs_reinit( &rs, REP_RESULT );
+	rc = op->o_bd->be_modify( op, &rs );
+	/* the backend has graduated the CSN */
+	queued = 0;
+	modlist = op->orm_modlist;
+	op->orm_no_opattrs = 0;
+	op->o_bd = be;
+	Debug( rc ? LDAP_DEBUG_ANY : LDAP_DEBUG_SYNC,
+		"syncrepl_entry_mods: %s be_modify %s (%d)\n",
+		si->si_ridtxt, op->o_req_dn.bv_val, rc );
+
+done:
+	if ( queued )
+		slap_graduate_commit_csn( op );
+	if ( !BER_BVISNULL( &op->o_csn ) )
+		op->o_tmpfree( op->o_csn.bv_val, op->o_tmpmemctx );
+	BER_BVZERO( &op->o_csn );
+	if ( modlist )
+		slap_mods_free( modlist, 1 );
+	op->o_tmpfree( ndn.bv_val, op->o_tmpmemctx );
+	op->o_tmpfree( dn.bv_val, op->o_tmpmemctx );
+	return rc;
+}
+
 #ifdef LDAP_CONTROL_X_DIRSYNC
 static int
 syncrepl_dirsync_message(
@@ -4019,7 +4420,35 @@ typedef struct dninfo {
 	AttributeDescription *newDesc;	/* for renames */
 } dninfo;
 
-#define HASHUUID	1
+/* Binary search a bucket. Returns 1 if found, with *slot set to
+ * its position, or 0 with *slot set to the insertion point.
+ */
+static int
+presentbucket_search(
+	presentbucket *pb,
+	unsigned char *key,
+	unsigned *slot )
+{
+	unsigned base = 0, n = pb->pb_num;
+
+	while ( n ) {
+		unsigned pivot = n >> 1, i = base + pivot;
+		int rc = memcmp( key, pb->pb_keys + i * PRESENT_KEYLEN, PRESENT_KEYLEN );
+
+		if ( !rc ) {
+			*slot = i;
+			return 1;
+		}
+		if ( rc > 0 ) {
+			base = i + 1;
+			n -= pivot + 1;
+		} else {
+			n = pivot;
+		}
+	}
+	*slot = base;
+	return 0;
+}
 
 /* return 1 if inserted, 0 otherwise */
 static int
@@ -4027,96 +4456,86 @@ presentlist_insert(
 	syncinfo_t* si,
 	struct berval *syncUUID )
 {
-	char *val;
-
-#ifdef HASHUUID
-	Avlnode **av;
+	presentbucket *pb;
+	unsigned char *key, *ptr;
 	unsigned short s;
+	unsigned slot;
 
 	if ( !si->si_presentlist )
-		si->si_presentlist = ch_calloc(65536, sizeof( Avlnode * ));
-
-	av = (Avlnode **)si->si_presentlist;
+		si->si_presentlist = ch_calloc( PRESENT_NBUCKETS, sizeof( presentbucket ));
 
-	val = ch_malloc(UUIDLEN-2);
-	memcpy(&s, syncUUID->bv_val, 2);
-	memcpy(val, syncUUID->bv_val+2, UUIDLEN-2);
+	memcpy( &s, syncUUID->bv_val, 2 );
+	pb = &si->si_presentlist[s];
+	key = (unsigned char *)syncUUID->bv_val + 2;
 
-	if ( ldap_avl_insert( &av[s], val,
-		syncuuid_cmp, ldap_avl_dup_error ) )
-	{
-		ch_free( val );
+	if ( presentbucket_search( pb, key, &slot ))
 		return 0;
-	}
-#else
-	val = ch_malloc(UUIDLEN);
 
-	AC_MEMCPY( val, syncUUID->bv_val, UUIDLEN );
-
-	if ( ldap_avl_insert( &si->si_presentlist, val,
-		syncuuid_cmp, ldap_avl_dup_error ) )
-	{
-		ch_free( val );
-		return 0;
+	if ( pb->pb_num == pb->pb_max ) {
+		pb->pb_max = pb->pb_max ? pb->pb_max + ( pb->pb_max >> 1 ) : 8;
+		pb->pb_keys = ch_realloc( pb->pb_keys, pb->pb_max * PRESENT_KEYLEN );
 	}
-#endif
+	ptr = pb->pb_keys + slot * PRESENT_KEYLEN;
+	AC_MEMCPY( ptr + PRESENT_KEYLEN, ptr, ( pb->pb_num - slot ) * PRESENT_KEYLEN );
+	AC_MEMCPY( ptr, key, PRESENT_KEYLEN );
+	pb->pb_num++;
 
 	return 1;
 }
 
-static char *
+static int
 presentlist_find(
-	Avlnode *av,
+	presentbucket *pl,
 	struct berval *val )
 {
-#ifdef HASHUUID
-	Avlnode **a2 = (Avlnode **)av;
 	unsigned short s;
+	unsigned slot;
 
-	if (!av)
-		return NULL;
+	if ( !pl )
+		return 0;
 
-	memcpy(&s, val->bv_val, 2);
-	return ldap_avl_find( a2[s], val->bv_val+2, syncuuid_cmp );
-#else
-	return ldap_avl_find( av, val->bv_val, syncuuid_cmp );
-#endif
+	memcpy( &s, val->bv_val, 2 );
+	return presentbucket_search( &pl[s], (unsigned char *)val->bv_val + 2, &slot );
 }
 
 static int
-presentlist_free( Avlnode *av )
+presentlist_free( presentbucket *pl )
 {
-#ifdef HASHUUID
-	Avlnode **a2 = (Avlnode **)av;
 	int i, count = 0;
 
-	if ( av ) {
-		for (i=0; i<65536; i++) {
-			if (a2[i])
-				count += ldap_avl_free( a2[i], ch_free );
+	if ( pl ) {
+		for ( i = 0; i < PRESENT_NBUCKETS; i++ ) {
+			count += pl[i].pb_num;
+			ch_free( pl[i].pb_keys );
 		}
-		ch_free( av );
+		ch_free( pl );
 	}
 	return count;
-#else
-	return ldap_avl_free( av, ch_free );
-#endif
 }
 
 static void
 presentlist_delete(
-	Avlnode **av,
+	presentbucket *pl,
 	struct berval *val )
 {
-#ifdef HASHUUID
-	Avlnode **a2 = *(Avlnode ***)av;
+	presentbucket *pb;
 	unsigned short s;
-
-	memcpy(&s, val->bv_val, 2);
-	ldap_avl_delete( &a2[s], val->bv_val+2, syncuuid_cmp );
-#else
-	ldap_avl_delete( av, val->bv_val, syncuuid_cmp );
-#endif
+	unsigned slot;
+
+	memcpy( &s, val->bv_val, 2 );
+	pb = &pl[s];
+	if ( !presentbucket_search( pb, (unsigned char *)val->bv_val + 2, &slot ))
+		return;
+
+	pb->pb_num--;
+	if ( !pb->pb_num ) {
+		ch_free( pb->pb_keys );
+		pb->pb_keys = NULL;
+		pb->pb_max = 0;
+	} else {
+		unsigned char *ptr = pb->pb_keys + slot * PRESENT_KEYLEN;
+		AC_MEMCPY( ptr, ptr + PRESENT_KEYLEN, ( pb->pb_num - slot ) * PRESENT_KEYLEN );
+	}
 }
 
 static int
@@ -4233,10 +4652,19 @@ syncrepl_entry(
 	dni.modlist = modlist;
 	dni.syncstate = syncstate;
 
-	rc = be->be_search( op, &rs_search );
-	Debug( LDAP_DEBUG_SYNC,
-			"syncrepl_entry: %s be_search (%d)\n", 
-			si->si_ridtxt, rc );
+	/* Loading into an empty database, an entry not seen before in
+	 * this refresh can't be present yet; if its DN somehow is, the
+	 * add below falls back to a lookup by DN.
+	 */
+	if ( si->si_emptyload && !si->si_refreshDone && syncuuid_inserted &&
+		syncstate == LDAP_SYNC_ADD ) {
+		rc = LDAP_SUCCESS;
+	} else {
+		rc = be->be_search( op, &rs_search );
+		Debug( LDAP_DEBUG_SYNC,
+				"syncrepl_entry: %s be_search (%d)\n", 
+				si->si_ridtxt, rc );
+	}
 
 	op->o_dont_replicate = 0;
 	if ( !BER_BVISNULL( &op->ors_filterstr ) ) {
@@ -5254,6 +5682,11 @@ syncrepl_updateCookie(
 	mod.sml_nvalues = NULL;
 	mod.sml_next = NULL;
 
+	/* never record a cookie ahead of uncommitted entries */
+	rc = syncrepl_batch_end( si, op, 1 );
+	if ( rc )
+		return rc;
+
 	ldap_pvt_thread_mutex_lock( &si->si_cookieState->cs_mutex );
 	while ( si->si_cookieState->cs_updating )
 		ldap_pvt_thread_cond_wait( &si->si_cookieState->cs_cond, &si->si_cookieState->cs_mutex );
@@ -6022,7 +6455,7 @@ nonpresent_callback(
 	syncinfo_t *si = op->o_callback->sc_private;
 	Attribute *a;
 	int count = 0;
-	char *present_uuid = NULL;
+	int present_uuid = 0;
 	struct nonpresent_entry *np_entry;
 	struct sync_cookie *syncCookie = op->o_controls[slap_cids.sc_LDAPsync];
 
@@ -6054,7 +6487,7 @@ nonpresent_callback(
 			return LDAP_SUCCESS;
 		}
 
-		if ( present_uuid == NULL ) {
+		if ( !present_uuid ) {
 			int covered = 1; /* covered by our new contextCSN? */
 
 			if ( !syncCookie )
@@ -6089,8 +6522,7 @@ nonpresent_callback(
 			}
 
 		} else {
-			presentlist_delete( &si->si_presentlist, &a->a_nvals[0] );
-			ch_free( present_uuid );
+			presentlist_delete( si->si_presentlist, &a->a_nvals[0] );
 		}
 	}
 	return LDAP_SUCCESS;
@@ -6199,16 +6631,6 @@ done:;
 	return new;
 }
 
-static int
-syncuuid_cmp( const void* v_uuid1, const void* v_uuid2 )
-{
-#ifdef HASHUUID
-	return ( memcmp( v_uuid1, v_uuid2, UUIDLEN-2 ));
-#else
-	return ( memcmp( v_uuid1, v_uuid2, UUIDLEN ));
-#endif
-}
-
 void
 syncinfo_free( syncinfo_t *sie, int free_all )
 {
@@ -6424,6 +6846,9 @@ config_suffixm( ConfigArgs *c, syncinfo_t *si )
 #define SUFFIXMSTR		"suffixmassage"
 #define	STRICT_REFRESH	"strictrefresh"
 #define LAZY_COMMIT		"lazycommit"
+#define DELTA_MODS		"deltamods"
+#define REFRESHBATCHSTR		"refreshbatch"
+#define COMPRESSSTR		"compress"
 
 /* FIXME: undocumented */
 #define EXATTRSSTR		"exattrs"
@@ -6951,6 +7376,33 @@ parse_syncrepl_line(
 					STRLENOF( LAZY_COMMIT ) ) )
 		{
 			si->si_lazyCommit = 1;
+		} else if ( !strncasecmp( c->argv[ i ], DELTA_MODS,
+					STRLENOF( DELTA_MODS ) ) )
+		{
+			si->si_deltamods = 1;
+		} else if ( !strncasecmp( c->argv[ i ], COMPRESSSTR "=",
+					STRLENOF( COMPRESSSTR "=" ) ) )
+		{
+			val = c->argv[ i ] + STRLENOF( COMPRESSSTR "=" );
+			if ( lutil_atoi( &si->si_compress, val ) != 0 ||
+				si->si_compress < 0 || si->si_compress > 9 ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"invalid compression level \"%s\".\n",
+					val );
+				Debug( LDAP_DEBUG_ANY, "%s: %s.\n", c->log, c->cr_msg );
+				return 1;
+			}
+		} else if ( !strncasecmp( c->argv[ i ], REFRESHBATCHSTR "=",
+					STRLENOF( REFRESHBATCHSTR "=" ) ) )
+		{
+			val = c->argv[ i ] + STRLENOF( REFRESHBATCHSTR "=" );
+			if ( lutil_atoi( &si->si_refreshbatch, val ) != 0 || si->si_refreshbatch < 0 ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"invalid refresh batch size \"%s\".\n",
+					val );
+				Debug( LDAP_DEBUG_ANY, "%s: %s.\n", c->log, c->cr_msg );
+				return 1;
+			}
 		} else if ( !bindconf_parse( c->argv[i], &si->si_bindconf ) ) {
 			si->si_got |= GOT_BINDCONF;
 		} else {
@@ -7032,7 +7484,8 @@ static ObjectClass	*oc_olmSyncRepl;
 static AttributeDescription	*ad_olmProviderURIList,
 	*ad_olmConnection, *ad_olmSyncPhase,
 	*ad_olmNextConnect, *ad_olmLastConnect, *ad_olmLastContact,
-	*ad_olmLastCookieRcvd, *ad_olmLastCookieSent;
+	*ad_olmLastCookieRcvd, *ad_olmLastCookieSent,
+	*ad_olmBytesRcvd, *ad_olmBytesInflated;
 
 static struct {
 	char *name;
@@ -7108,6 +7561,20 @@ static struct {
 		"NO-USER-MODIFICATION "
 		"USAGE dSAOperation )",
 		&ad_olmLastCookieSent },
+	{ "( olmSyncReplAttributes:9 "
+		"NAME ( 'olmSRCompressedBytesRcvd' ) "
+		"DESC 'Compressed bytes received on the current connection' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmBytesRcvd },
+	{ "( olmSyncReplAttributes:10 "
+		"NAME ( 'olmSRInflatedBytesRcvd' ) "
+		"DESC 'Size of the compressed data received once inflated' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmBytesInflated },
 	{ NULL }
 };
 
@@ -7127,6 +7594,8 @@ static struct {
 			"$ olmSRLastContact "
 			"$ olmSRLastCookieRcvd "
 			"$ olmSRLastCookieSent "
+			"$ olmSRCompressedBytesRcvd "
+			"$ olmSRInflatedBytesRcvd "
 			") )",
 		&oc_olmSyncRepl },
 	{ NULL }
@@ -7305,6 +7774,26 @@ syncrepl_monitor_update(
 		ber_bvreplace( &a->a_vals[0], &si->si_lastCookieSent );
 	ldap_pvt_thread_mutex_unlock( &si->si_monitor_mutex );
 
+	{
+		char buf[ LDAP_PVT_INTTYPE_CHARS(unsigned long) ];
+		struct berval bv;
+
+		a = a->a_next;
+		if ( a->a_desc != ad_olmBytesRcvd )
+			return SLAP_CB_CONTINUE;
+
+		bv.bv_val = buf;
+		bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", (unsigned long)si->si_bytesRcvd );
+		ber_bvreplace( &a->a_vals[0], &bv );
+
+		a = a->a_next;
+		if ( a->a_desc != ad_olmBytesInflated )
+			return SLAP_CB_CONTINUE;
+
+		bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", (unsigned long)si->si_bytesInflated );
+		ber_bvreplace( &a->a_vals[0], &bv );
+	}
+
 	return SLAP_CB_CONTINUE;
 }
 
@@ -7382,6 +7871,11 @@ syncrepl_monitor_add(
 		attr_merge_normalize_one( e, ad_olmLastCookieRcvd, &bv, NULL );
 		attr_merge_normalize_one( e, ad_olmLastCookieSent, &bv, NULL );
 	}
+	{
+		struct berval bv = BER_BVC("0");
+		attr_merge_normalize_one( e, ad_olmBytesRcvd, &bv, NULL );
+		attr_merge_normalize_one( e, ad_olmBytesInflated, &bv, NULL );
+	}
 	{
 		monitor_callback_t *cb = ch_calloc( sizeof( monitor_callback_t ), 1 );
 		cb->mc_update = syncrepl_monitor_update;
@@ -7770,6 +8264,23 @@ syncrepl_unparse( syncinfo_t *si, struct berval *bv )
 		ptr = lutil_strcopy( ptr, " " LAZY_COMMIT );
 	}
 
+	if ( si->si_deltamods ) {
+		if ( WHATSLEFT <= STRLENOF( " " DELTA_MODS ) ) return;
+		ptr = lutil_strcopy( ptr, " " DELTA_MODS );
+	}
+
+	if ( si->si_refreshbatch ) {
+		len = snprintf( ptr, WHATSLEFT, " " REFRESHBATCHSTR "=%d", si->si_refreshbatch );
+		if ( WHATSLEFT <= len ) return;
+		ptr += len;
+	}
+
+	if ( si->si_compress ) {
+		len = snprintf( ptr, WHATSLEFT, " " COMPRESSSTR "=%d", si->si_compress );
+		if ( WHATSLEFT <= len ) return;
+		ptr += len;
+	}
+
 	bc.bv_len = ptr - buf;
 	bc.bv_val = buf;
 	ber_dupbv( bv, &bc );
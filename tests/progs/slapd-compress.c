@@ -0,0 +1,240 @@
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1999-2024 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+
+#include "ac/stdlib.h"
+#include "ac/errno.h"
+#include "ac/socket.h"
+#include "ac/string.h"
+#include "ac/unistd.h"
+
+#ifdef HAVE_POLL
+#include <poll.h>
+#endif
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "ldap.h"
+#include "lber_pvt.h"
+#include "lutil.h"
+
+/* Negotiates stream compression with LDAP_EXOP_X_START_COMPRESS, then
+ * either reads a subtree through the compressed stream and prints the
+ * number of entries, or (-z) sends one small packet that inflates to a
+ * well-formed search request far larger than any frame a peer produces,
+ * and checks that the server drops the connection instead of answering.
+ * The exit status is the LDAP result code of the first failure.
+ */
+
+/* above the frame limit, below sockbuf_max_incoming_auth */
+#define BOMB_SIZE	(512*1024)
+
+static void
+usage( char *name )
+{
+	fprintf( stderr, "usage: %s -H <uri> [-D <dn> -w <passwd>] "
+		"[-b <base>] [-l <level>] [-z]\n",
+		name );
+	exit( EXIT_FAILURE );
+}
+
+#ifdef HAVE_ZLIB
+static int
+do_bomb( LDAP *ld )
+{
+	BerElement *ber;
+	struct berval bv;
+	z_stream zs = { 0 };
+	unsigned char *pkt;
+	char *value;
+	ber_len_t size, len;
+	ber_socket_t sd;
+	char c;
+	int rc;
+
+	value = malloc( BOMB_SIZE + 1 );
+	size = 4 + BOMB_SIZE / 64;
+	pkt = malloc( size );
+	ber = ber_alloc_t( LBER_USE_DER );
+	if ( value == NULL || pkt == NULL || ber == NULL ) {
+		fprintf( stderr, "out of memory\n" );
+		return LDAP_NO_MEMORY;
+	}
+	memset( value, 'x', BOMB_SIZE );
+	value[BOMB_SIZE] = '\0';
+
+	/* base search of the root DSE with a huge equality filter */
+	rc = ber_printf( ber, "{it{seeiibt{ss}{}}}",
+		2, LDAP_REQ_SEARCH, "", LDAP_SCOPE_BASE, LDAP_DEREF_NEVER,
+		0, 0, 0, LDAP_FILTER_EQUALITY, "objectClass", value );
+	if ( rc == -1 || ber_flatten2( ber, &bv, 0 ) == -1 ) {
+		fprintf( stderr, "encoding failed\n" );
+		return LDAP_ENCODING_ERROR;
+	}
+
+	/* the server's inflate stream has seen nothing yet */
+	deflateInit( &zs, Z_BEST_COMPRESSION );
+	zs.next_in = (unsigned char *)bv.bv_val;
+	zs.avail_in = bv.bv_len;
+	zs.next_out = pkt + 4;
+	zs.avail_out = size - 4;
+	rc = deflate( &zs, Z_SYNC_FLUSH );
+	if ( rc != Z_OK || zs.avail_in ) {
+		fprintf( stderr, "deflate failed (%d)\n", rc );
+		return LDAP_OTHER;
+	}
+	len = zs.next_out - pkt - 4;
+	deflateEnd( &zs );
+
+	pkt[0] = (len >> 24) & 0xff;
+	pkt[1] = (len >> 16) & 0xff;
+	pkt[2] = (len >> 8) & 0xff;
+	pkt[3] = len & 0xff;
+
+	printf( "sending %lu bytes inflating to %lu\n",
+		(unsigned long)len + 4, (unsigned long)bv.bv_len );
+
+	/* bypass the Sockbuf, it would compress the packet again */
+	ldap_get_option( ld, LDAP_OPT_DESC, &sd );
+	if ( write( sd, pkt, len + 4 ) != len + 4 ) {
+		perror( "write" );
+		return LDAP_SERVER_DOWN;
+	}
+	ber_free( ber, 1 );
+	free( value );
+	free( pkt );
+
+#ifdef HAVE_POLL
+	{
+		struct pollfd pfd;
+
+		pfd.fd = sd;
+		pfd.events = POLLIN;
+		if ( poll( &pfd, 1, 10000 ) <= 0 ) {
+			fprintf( stderr, "server kept the connection open\n" );
+			return LDAP_OTHER;
+		}
+	}
+#endif
+	rc = read( sd, &c, 1 );
+	if ( rc > 0 ) {
+		fprintf( stderr, "server answered the packet\n" );
+		return LDAP_OTHER;
+	}
+
+	printf( "server closed the connection\n" );
+	return LDAP_SUCCESS;
+}
+#endif /* HAVE_ZLIB */
+
+int
+main( int argc, char **argv )
+{
+	LDAP *ld = NULL;
+	LDAPMessage *res = NULL;
+	char *uri = NULL, *dn = NULL, *base = NULL;
+	struct berval pass = BER_BVNULL;
+	int version = LDAP_VERSION3;
+	int level = 6, bomb = 0;
+	int i, rc;
+
+	while ( ( i = getopt( argc, argv, "b:D:H:l:w:z" ) ) != EOF ) {
+		switch ( i ) {
+		case 'b':
+			base = optarg;
+			break;
+
+		case 'D':
+			dn = optarg;
+			break;
+
+		case 'H':
+			uri = optarg;
+			break;
+
+		case 'l':
+			if ( lutil_atoi( &level, optarg ) != 0 ) {
+				usage( argv[0] );
+			}
+			break;
+
+		case 'w':
+			ber_str2bv( optarg, 0, 1, &pass );
+			memset( optarg, '*', pass.bv_len );
+			break;
+
+		case 'z':
+			bomb = 1;
+			break;
+
+		default:
+			usage( argv[0] );
+			break;
+		}
+	}
+
+	if ( uri == NULL || ( base == NULL && !bomb ) ) {
+		usage( argv[0] );
+	}
+
+	rc = ldap_initialize( &ld, uri );
+	if ( rc != LDAP_SUCCESS ) {
+		fprintf( stderr, "ldap_initialize: %s (%d)\n",
+			ldap_err2string( rc ), rc );
+		exit( rc );
+	}
+	ldap_set_option( ld, LDAP_OPT_PROTOCOL_VERSION, &version );
+
+	rc = ldap_sasl_bind_s( ld, dn, LDAP_SASL_SIMPLE, &pass,
+		NULL, NULL, NULL );
+	if ( rc != LDAP_SUCCESS ) {
+		fprintf( stderr, "ldap_sasl_bind_s: %s (%d)\n",
+			ldap_err2string( rc ), rc );
+		exit( rc );
+	}
+
+	rc = ldap_start_compress_s( ld, level, NULL, NULL );
+	if ( rc != LDAP_SUCCESS ) {
+		fprintf( stderr, "ldap_start_compress_s: %s (%d)\n",
+			ldap_err2string( rc ), rc );
+		exit( rc );
+	}
+
+	if ( bomb ) {
+#ifdef HAVE_ZLIB
+		rc = do_bomb( ld );
+#endif
+		ldap_unbind_ext( ld, NULL, NULL );
+		exit( rc );
+	}
+
+	rc = ldap_search_ext_s( ld, base, LDAP_SCOPE_SUBTREE, NULL, NULL, 0,
+		NULL, NULL, NULL, LDAP_NO_LIMIT, &res );
+	if ( rc != LDAP_SUCCESS ) {
+		fprintf( stderr, "ldap_search_ext_s: %s (%d)\n",
+			ldap_err2string( rc ), rc );
+		exit( rc );
+	}
+	printf( "%d entries\n", ldap_count_entries( ld, res ) );
+	ldap_msgfree( res );
+
+	ldap_unbind_ext( ld, NULL, NULL );
+	exit( EXIT_SUCCESS );
+}
@@ -191,6 +191,9 @@ LLOADDANONCONF=$DATADIR/lloadd-anon.conf
 LLOADDUNREACHABLECONF=$DATADIR/lloadd-backend-issues.conf
 LLOADDTLSCONF=$DATADIR/lloadd-tls.conf
 LLOADDSASLCONF=$DATADIR/lloadd-sasl.conf
+LLOADDCACHECONF=$DATADIR/lloadd-cache.conf
+LLOADDAFFINITYCONF=$DATADIR/lloadd-affinity.conf
+LLOADDADAPTIVECONF=$DATADIR/lloadd-adaptive.conf
 
 # generated files
 CONF1=$TESTDIR/slapd.1.conf
@@ -272,6 +275,7 @@ LDAPEXOP="$CLIENTDIR/ldapexop $TOOLARGS"
 SLAPDTESTER=$PROGDIR/slapd-tester
 LDIFFILTER=$PROGDIR/ldif-filter
 SLAPDMTREAD=$PROGDIR/slapd-mtread
+SLAPDCOMPRESS=$PROGDIR/slapd-compress
 LVL=${SLAPD_DEBUG-0x4105}
 LOCALHOST=localhost
 LOCALIP=127.0.0.1